@@ -0,0 +1,444 @@
+// Microbenchmarks for the building blocks of a deqn run.
+//
+// Run under mpirun, e.g. mpirun -n 4 build/deqn-bench --reps 20
+// Single-rank cases run on rank 0 only; exchange cases use 1, 2, 4, ... ranks
+// up to the world size. Each case is run --warmup times untimed, then --reps
+// times timed, and the distribution of the samples is reported. For the
+// multi-rank cases a sample is the time of the slowest rank.
+#include <mpi.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "tools-inl.h"
+#include "config_file.h"
+#include "mesh.h"
+#include "distributed_mesh.h"
+#include "static_mesh.h"
+#include "static_blocking_mesh.h"
+#include "dynamic_mesh.h"
+#include "calculation.h"
+#include "data_source.h"
+#include "vtk_writer.h"
+
+namespace {
+  struct Options {
+    int reps;
+    int warmup;
+    std::string filter;
+    std::string outdir;
+  };
+
+  struct Stats {
+    double min;
+    double median;
+    double mean;
+    double max;
+    double stddev;
+  };
+
+  class Case {
+   public:
+    virtual ~Case() {}
+    virtual void run() = 0;
+  };
+
+  class DiffuseCase : public Case {
+   public:
+    DiffuseCase(Calculation *calculation_, double dt_) : _calculation(calculation_), _dt(dt_) {}
+    void run() { _calculation->step(_dt); }
+   private:
+    Calculation *_calculation;
+    double _dt;
+  };
+
+  class ReflectCase : public Case {
+   public:
+    ReflectCase(Mesh *mesh_, int boundary_) : _mesh(mesh_), _boundary(boundary_) {}
+    void run() { _mesh->reflect_boundary(_boundary); }
+   private:
+    Mesh *_mesh;
+    int _boundary;
+  };
+
+  // A dynamic mesh's exchange depends on its phase, so it is run through
+  // advance(), which exchanges and flips the phase every step at depth 1:
+  // samples alternate the prograde (rows down) and retrograde (rows up) ones
+  class ExchangeCase : public Case {
+   public:
+    ExchangeCase(DistributedMesh *mesh_, bool advance_) : _mesh(mesh_), _advance(advance_) {}
+    void run() {
+      if (_advance) {
+        _mesh->advance();
+      } else {
+        _mesh->exchange_boundaries();
+      }
+    }
+   private:
+    DistributedMesh *_mesh;
+    bool _advance;
+  };
+
+  class WriteCase : public Case {
+   public:
+    WriteCase(VtkWriter *writer_) : _writer(writer_), _step(0) {}
+    void run() { _writer->write(_step++, 0.0); }
+    int get_steps() const { return _step; }
+   private:
+    VtkWriter *_writer;
+    int _step;
+  };
+
+  class PopulateCase : public Case {
+   public:
+    PopulateCase(DataSource *source_, Mesh *mesh_) : _source(source_), _mesh(mesh_) {}
+    void run() { _source->populate(_mesh); }
+   private:
+    DataSource *_source;
+    Mesh *_mesh;
+  };
+
+  Stats summarize(std::vector<double> samples_) {
+    Stats stats;
+    std::sort(samples_.begin(), samples_.end());
+    const std::size_t n = samples_.size();
+    stats.min = samples_.front();
+    stats.max = samples_.back();
+    stats.median = (n % 2) ? samples_[n / 2]
+                           : 0.5 * (samples_[n / 2 - 1] + samples_[n / 2]);
+    double sum = 0;
+    for (std::size_t s = 0; s < n; ++s) {
+      sum += samples_[s];
+    }
+    stats.mean = sum / n;
+    double squares = 0;
+    for (std::size_t s = 0; s < n; ++s) {
+      squares += (samples_[s] - stats.mean) * (samples_[s] - stats.mean);
+    }
+    stats.stddev = n > 1 ? std::sqrt(squares / (n - 1)) : 0.0;
+    return stats;
+  }
+
+  // Times case_ on every rank of comm_, each sample is the slowest rank's time
+  std::vector<double> time_case(Case& case_, MPI_Comm comm_, const Options& opts_) {
+    for (int rep = 0; rep < opts_.warmup; ++rep) {
+      case_.run();
+    }
+    std::vector<double> samples;
+    for (int rep = 0; rep < opts_.reps; ++rep) {
+      MPI_Barrier(comm_);
+      const double start = monotonic_seconds();
+      case_.run();
+      double elapsed = monotonic_seconds() - start;
+      double slowest = 0;
+      MPI_Allreduce(&elapsed, &slowest, 1, MPI_DOUBLE, MPI_MAX, comm_);
+      samples.push_back(slowest);
+    }
+    return samples;
+  }
+
+  void print_header() {
+    std::cout << std::left << std::setw(18) << "case"
+              << std::setw(34) << "parameters"
+              << std::right
+              << std::setw(11) << "min(s)"
+              << std::setw(11) << "median(s)"
+              << std::setw(11) << "mean(s)"
+              << std::setw(11) << "max(s)"
+              << std::setw(11) << "stddev(s)"
+              << std::setw(16) << "rate" << std::endl;
+  }
+
+  // work_ is the amount of work done per sample, reported per median second
+  void print_row(const std::string& name_,
+                 const std::string& params_,
+                 const std::vector<double>& samples_,
+                 double work_,
+                 const std::string& unit_) {
+    Stats stats = summarize(samples_);
+    std::ostringstream rate;
+    rate.setf(std::ios::fixed, std::ios::floatfield);
+    rate.precision(1);
+    rate << work_ / stats.median << " " << unit_;
+    std::cout << std::left << std::setw(18) << name_
+              << std::setw(34) << params_
+              << std::right << std::scientific << std::setprecision(3)
+              << std::setw(11) << stats.min
+              << std::setw(11) << stats.median
+              << std::setw(11) << stats.mean
+              << std::setw(11) << stats.max
+              << std::setw(11) << stats.stddev
+              << std::setw(16) << rate.str() << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+  }
+
+  bool selected(const Options& opts_, const std::string& name_) {
+    return opts_.filter.empty() || name_.find(opts_.filter) != std::string::npos;
+  }
+
+  void configure_domain(ConfigFile& config_, int rows_, int cols_, const std::string& mesh_type_) {
+    std::ostringstream dims;
+    dims << rows_ << " " << cols_;
+    config_.set("logical_dimensions", dims.str());
+    config_.set("physical_dimensions", dims.str());
+    config_.set("mesh_type", mesh_type_);
+    std::ostringstream subregions;
+    subregions << 0.25 * rows_ << " " << 0.25 * cols_ << " "
+               << 0.75 * rows_ << " " << 0.75 * cols_;
+    config_.set("subregions", subregions.str());
+  }
+
+  DistributedMesh *make_mesh(const std::string& mesh_type_,
+                             const ConfigFile& config_,
+                             MPI_Comm cart_comm_,
+                             const std::vector<int>& dim_nodes_) {
+    if (mesh_type_ == "static") {
+      return new StaticMesh(config_, cart_comm_, dim_nodes_);
+    } else if (mesh_type_ == "static_blocking") {
+      return new StaticBlockingMesh(config_, cart_comm_, dim_nodes_);
+    } else if (mesh_type_ == "dynamic") {
+      return new DynamicMesh(config_, cart_comm_, dim_nodes_);
+    }
+    std::stringstream ss;
+    ss << "Unknown mesh type: " << mesh_type_;
+    throw std::logic_error(ss.str());
+  }
+
+  MPI_Comm make_cart(MPI_Comm comm_, std::vector<int>& dim_nodes_) {
+    int size;
+    MPI_Comm_size(comm_, &size);
+    std::vector<int> periods(2, 0);
+    MPI_Dims_create(size, 2, &dim_nodes_[0]);
+    MPI_Comm cart_comm;
+    MPI_Cart_create(comm_, 2, &dim_nodes_[0], &periods[0], 0, &cart_comm);
+    return cart_comm;
+  }
+
+  std::string domain_params(int rows_, int cols_, int ranks_) {
+    std::ostringstream ss;
+    ss << "rows=" << rows_ << " cols=" << cols_ << " ranks=" << ranks_;
+    return ss.str();
+  }
+
+  const int kDomainSizes[] = {64, 256, 1024, 2048};
+  const int kDomainSizeCount = sizeof(kDomainSizes) / sizeof(kDomainSizes[0]);
+
+  void bench_diffuse(const Options& opts_) {
+    std::vector<int> dim_nodes(2, 1);
+    MPI_Comm cart_comm = make_cart(MPI_COMM_SELF, dim_nodes);
+    for (int s = 0; s < kDomainSizeCount; ++s) {
+      const int n = kDomainSizes[s];
+      ConfigFile config;
+      configure_domain(config, n, n, "static");
+      StaticMesh mesh(config, cart_comm, dim_nodes);
+      DataSource source(config);
+      source.populate(&mesh);
+      Calculation calculation(config, &mesh);
+      DiffuseCase diffuse(&calculation, 0.1);
+      std::vector<double> samples = time_case(diffuse, MPI_COMM_SELF, opts_);
+      print_row("diffuse", domain_params(n, n, 1), samples, 1.0e-6 * n * n, "Mcell/s");
+    }
+    MPI_Comm_free(&cart_comm);
+  }
+
+  void bench_reflect(const Options& opts_) {
+    const char *names[] = {"reflect_top", "reflect_bottom", "reflect_left", "reflect_right"};
+    std::vector<int> dim_nodes(2, 1);
+    MPI_Comm cart_comm = make_cart(MPI_COMM_SELF, dim_nodes);
+    for (int s = 0; s < kDomainSizeCount; ++s) {
+      const int n = kDomainSizes[s];
+      ConfigFile config;
+      configure_domain(config, n, n, "static");
+      StaticMesh mesh(config, cart_comm, dim_nodes);
+      DataSource source(config);
+      source.populate(&mesh);
+      for (int boundary = TOP; boundary <= RIGHT; ++boundary) {
+        ReflectCase reflect(&mesh, boundary);
+        std::vector<double> samples = time_case(reflect, MPI_COMM_SELF, opts_);
+        print_row(names[boundary], domain_params(n, n, 1), samples, 1.0e-6 * n, "Mcell/s");
+      }
+    }
+    MPI_Comm_free(&cart_comm);
+  }
+
+  // Bytes this rank sends in one exchange, for a dynamic mesh in a phase it sends in
+  double halo_bytes(const std::string& mesh_type_, DistributedMesh& mesh_) {
+    if (mesh_type_ == "dynamic") {
+      // two full augmented rows, down after a prograde step and up after a
+      // retrograde one
+      return mesh_.has_bottom_neighbour() || mesh_.has_top_neighbour()
+          ? 2.0 * mesh_.get_node_augmented_col_count() * sizeof(double) : 0.0;
+    }
+    const int rows = (mesh_.has_top_neighbour() ? 1 : 0) + (mesh_.has_bottom_neighbour() ? 1 : 0);
+    const int cols = (mesh_.has_left_neighbour() ? 1 : 0) + (mesh_.has_right_neighbour() ? 1 : 0);
+    return sizeof(double) * (rows * mesh_.get_node_core_col_count()
+                             + cols * mesh_.get_node_core_row_count());
+  }
+
+  void bench_exchange(const Options& opts_) {
+    const char *mesh_types[] = {"static", "static_blocking", "dynamic"};
+    const int message_sizes[] = {64, 1024, 16384};
+    const int rows_per_rank = 32;
+    int world_rank, world_size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    for (int ranks = 1; ranks <= world_size; ranks *= 2) {
+      MPI_Comm comm;
+      MPI_Comm_split(MPI_COMM_WORLD, world_rank < ranks ? 0 : MPI_UNDEFINED, world_rank, &comm);
+      if (comm != MPI_COMM_NULL) {
+        for (int t = 0; t < 3; ++t) {
+          const std::string mesh_type(mesh_types[t]);
+          std::vector<int> dim_nodes(2, 0);
+          if (mesh_type == "dynamic") {
+            // DynamicMesh only shifts rows, so decompose vertically
+            dim_nodes[1] = 1;
+          }
+          MPI_Comm cart_comm = make_cart(comm, dim_nodes);
+          for (int m = 0; m < 3; ++m) {
+            const int rows = rows_per_rank * dim_nodes[0];
+            const int cols = message_sizes[m] * dim_nodes[1];
+            ConfigFile config;
+            configure_domain(config, rows, cols, mesh_type);
+            DistributedMesh *mesh = make_mesh(mesh_type, config, cart_comm, dim_nodes);
+            DataSource source(config);
+            source.populate(mesh);
+            ExchangeCase exchange(mesh, mesh_type == "dynamic");
+            std::vector<double> samples = time_case(exchange, cart_comm, opts_);
+            double bytes = halo_bytes(mesh_type, *mesh);
+            double max_bytes = 0;
+            MPI_Reduce(&bytes, &max_bytes, 1, MPI_DOUBLE, MPI_MAX, 0, cart_comm);
+            if (world_rank == 0) {
+              std::ostringstream params;
+              params << mesh_type << " msg=" << message_sizes[m] << " ranks=" << ranks;
+              print_row("exchange", params.str(), samples, 1.0e-6 * max_bytes, "MB/s");
+            }
+            delete mesh;
+          }
+          MPI_Comm_free(&cart_comm);
+        }
+        MPI_Comm_free(&comm);
+      }
+      MPI_Barrier(MPI_COMM_WORLD);
+    }
+  }
+
+  void bench_write(const Options& opts_) {
+    std::vector<int> dim_nodes(2, 1);
+    MPI_Comm cart_comm = make_cart(MPI_COMM_SELF, dim_nodes);
+    const int sizes[] = {64, 256, 1024};
+    for (int s = 0; s < 3; ++s) {
+      const int n = sizes[s];
+      ConfigFile config;
+      configure_domain(config, n, n, "static");
+      StaticMesh mesh(config, cart_comm, dim_nodes);
+      DataSource source(config);
+      source.populate(&mesh);
+      std::ostringstream basename;
+      basename << opts_.outdir << "/bench_" << n;
+      VtkWriter writer(basename.str(), &mesh, 0, 1);
+      WriteCase write(&writer);
+      std::vector<double> samples = time_case(write, MPI_COMM_SELF, opts_);
+      // All dumps of one size are the same size, so measure the first
+      std::ostringstream first;
+      first << basename.str() << ".0.0.vtk";
+      struct stat info;
+      double bytes = stat(first.str().c_str(), &info) == 0 ? info.st_size : 0.0;
+      print_row("vtk_write", domain_params(n, n, 1), samples, 1.0e-6 * bytes, "MB/s");
+      for (int step = 0; step < write.get_steps(); ++step) {
+        std::ostringstream dump;
+        dump << basename.str() << "." << step << ".0.vtk";
+        unlink(dump.str().c_str());
+      }
+      unlink((basename.str() + ".visit").c_str());
+    }
+    MPI_Comm_free(&cart_comm);
+  }
+
+  void bench_populate(const Options& opts_) {
+    std::vector<int> dim_nodes(2, 1);
+    MPI_Comm cart_comm = make_cart(MPI_COMM_SELF, dim_nodes);
+    for (int s = 0; s < kDomainSizeCount; ++s) {
+      const int n = kDomainSizes[s];
+      ConfigFile config;
+      configure_domain(config, n, n, "static");
+      StaticMesh mesh(config, cart_comm, dim_nodes);
+      DataSource source(config);
+      PopulateCase populate(&source, &mesh);
+      std::vector<double> samples = time_case(populate, MPI_COMM_SELF, opts_);
+      print_row("populate", domain_params(n, n, 1), samples, 1.0e-6 * n * n, "Mcell/s");
+    }
+    MPI_Comm_free(&cart_comm);
+  }
+
+  void usage() {
+    std::cerr << "Usage: deqn-bench [--reps N] [--warmup N] [--filter NAME] [--outdir DIR]\n"
+                 "  NAME matches diffuse, reflect, exchange, vtk_write or populate"
+              << std::endl;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+  int world_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  Options opts;
+  opts.reps = 10;
+  opts.warmup = 2;
+  opts.outdir = "/tmp";
+  for (int arg = 1; arg < argc; ++arg) {
+    std::string flag(argv[arg]);
+    if (arg + 1 < argc && flag == "--reps") {
+      opts.reps = std::atoi(argv[++arg]);
+    } else if (arg + 1 < argc && flag == "--warmup") {
+      opts.warmup = std::atoi(argv[++arg]);
+    } else if (arg + 1 < argc && flag == "--filter") {
+      opts.filter = argv[++arg];
+    } else if (arg + 1 < argc && flag == "--outdir") {
+      opts.outdir = argv[++arg];
+    } else {
+      if (world_rank == 0) {
+        usage();
+      }
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+  }
+  if (opts.reps < 1) {
+    opts.reps = 1;
+  }
+  try {
+    if (world_rank == 0) {
+      print_header();
+      if (selected(opts, "diffuse")) {
+        bench_diffuse(opts);
+      }
+      if (selected(opts, "reflect")) {
+        bench_reflect(opts);
+      }
+    }
+    if (selected(opts, "exchange")) {
+      bench_exchange(opts);
+    }
+    if (world_rank == 0) {
+      if (selected(opts, "vtk_write")) {
+        bench_write(opts);
+      }
+      if (selected(opts, "populate")) {
+        bench_populate(opts);
+      }
+    }
+  } catch (std::logic_error& ex) {
+    std::cerr << "Exception thrown: " << ex.what() << std::endl;
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  MPI_Finalize();
+  return 0;
+}
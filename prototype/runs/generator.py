@@ -38,7 +38,7 @@ def main():
     cfg_tmpl = generate_template(args.cfg_tmpl)
     pbs_tmpl = generate_template(args.pbs_tmpl)
     name_tmpl = jinja2.Template(args.name)
-    for nodes in xrange(args.min_nodes, args.max_nodes):
+    for nodes in range(args.min_nodes, args.max_nodes):
         for mesh in ['static', 'dynamic']:
             run_properties = {'mesh': mesh,
                               'nodes': nodes,
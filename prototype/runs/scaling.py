@@ -0,0 +1,252 @@
+#!/usr/bin/env python3
+"""Local strong/weak scaling sweep for deqn.
+
+Runs every combination of rank count, mesh type, decomposition layout and
+problem size through an MPI launcher, parses the wallclock and per-phase
+timings deqn prints, and writes one CSV row per run plus speedup/efficiency
+tables (best of --repeats) to stdout.
+
+Strong scaling keeps the global size fixed (--sizes is the global domain),
+weak scaling keeps the per-rank size fixed (--sizes is the block per rank,
+the global domain grows with the decomposition).
+
+  ./scaling.py --ranks 1 2 4 --meshes static dynamic --layouts rows auto \\
+               --sizes 512x512 --mode both --steps 200 --csv scaling.csv
+"""
+from __future__ import print_function
+import argparse
+import csv
+import errno
+import os
+import re
+import shlex
+import subprocess
+import sys
+
+PHASES = ['compute', 'reflect', 'halo_post', 'halo_wait', 'output']
+WALLCLOCK_RE = re.compile(r'Timings: wallclock:\s*([0-9.eE+-]+)s')
+PHASE_RE = re.compile(r'^\s+(\w+)\s+min (\S+) mean (\S+) max (\S+) imbalance (\S+)')
+CELL_SIZE = 0.1  # physical size of a cell, matches templates/config.in.tmpl
+TIMESTEP = 0.001  # stable for CELL_SIZE (rx + ry = 0.2)
+
+CONFIG = """debug false
+visualize false
+performance_report false
+name {name}
+mesh_type {mesh}
+logical_dimensions {rows} {cols}
+physical_dimensions {height} {width}
+start_time 0.0
+end_time {end_time}
+timestep {timestep}
+subregions {sub_row_min} {sub_col_min} {sub_row_max} {sub_col_max}
+output_rate {steps}
+dim_nodes {dim_rows} {dim_cols}
+"""
+
+
+def process_arguments():
+    parser = argparse.ArgumentParser(description='deqn scaling study')
+    parser.add_argument('--ranks', type=int, nargs='+', default=[1, 2, 4])
+    parser.add_argument('--meshes', nargs='+', default=['static', 'dynamic'],
+                        help='static, static_blocking and/or dynamic')
+    parser.add_argument('--layouts', nargs='+', default=['rows'],
+                        help='rows (N x 1), cols (1 x N) and/or auto (near square)')
+    parser.add_argument('--sizes', nargs='+', default=['512x512'],
+                        help='ROWSxCOLS, global for strong, per rank for weak')
+    parser.add_argument('--mode', choices=['strong', 'weak', 'both'],
+                        default='strong')
+    parser.add_argument('--steps', type=int, default=100)
+    parser.add_argument('--repeats', type=int, default=3)
+    parser.add_argument('--binary', default=os.path.join(
+        os.path.dirname(os.path.abspath(__file__)), '..', 'build', 'deqn'))
+    parser.add_argument('--launcher', default='mpirun -np {ranks}',
+                        help='launch command, {ranks} is substituted')
+    parser.add_argument('--config_dir', default='scaling_config')
+    parser.add_argument('--csv', default='scaling.csv')
+    parser.add_argument('--timeout', type=int, default=3600)
+    parser.add_argument('--dry_run', action='store_true',
+                        help='print the commands without running them')
+    return parser.parse_args()
+
+
+def ensure_path_exists(path):
+    try:
+        os.makedirs(path)
+    except OSError as exception:
+        if exception.errno != errno.EEXIST:
+            raise
+
+
+def parse_size(size):
+    rows, cols = size.lower().split('x')
+    return int(rows), int(cols)
+
+
+def near_square_dims(ranks):
+    # Same shape MPI_Dims_create picks for 2D: factors as close as possible,
+    # larger one first
+    best = (ranks, 1)
+    for factor in range(1, int(ranks ** 0.5) + 1):
+        if ranks % factor == 0:
+            best = (ranks // factor, factor)
+    return best
+
+
+def layout_dims(layout, ranks):
+    if layout == 'rows':
+        return ranks, 1
+    if layout == 'cols':
+        return 1, ranks
+    if layout == 'auto':
+        return near_square_dims(ranks)
+    raise ValueError('Unknown layout: {}'.format(layout))
+
+
+def write_config(path, name, mesh, rows, cols, dims, steps):
+    height = rows * CELL_SIZE
+    width = cols * CELL_SIZE
+    with open(path, 'w') as outfile:
+        outfile.write(CONFIG.format(name=name, mesh=mesh, rows=rows, cols=cols,
+                                    height=height, width=width,
+                                    end_time=steps * TIMESTEP,
+                                    timestep=TIMESTEP,
+                                    sub_row_min=0.2 * height,
+                                    sub_col_min=0.2 * width,
+                                    sub_row_max=0.8 * height,
+                                    sub_col_max=0.8 * width,
+                                    steps=steps,
+                                    dim_rows=dims[0], dim_cols=dims[1]))
+
+
+def parse_output(text):
+    result = {}
+    match = WALLCLOCK_RE.search(text)
+    if match:
+        result['wallclock'] = float(match.group(1))
+    for line in text.splitlines():
+        match = PHASE_RE.match(line)
+        if match and match.group(1) in PHASES:
+            phase = match.group(1)
+            result[phase + '_mean'] = float(match.group(3))
+            result[phase + '_max'] = float(match.group(4))
+            result[phase + '_imbalance'] = float(match.group(5))
+    return result
+
+
+def run_case(args, case, config):
+    command = shlex.split(args.launcher.format(ranks=case['ranks']))
+    command += [args.binary, config]
+    if args.dry_run:
+        print(' '.join(command))
+        return None
+    try:
+        process = subprocess.run(command, stdout=subprocess.PIPE,
+                                 stderr=subprocess.STDOUT,
+                                 universal_newlines=True,
+                                 timeout=args.timeout)
+    except subprocess.TimeoutExpired:
+        print('  timed out', file=sys.stderr)
+        return None
+    result = parse_output(process.stdout)
+    if process.returncode != 0 or 'wallclock' not in result:
+        print('  failed (exit {}):\n{}'.format(process.returncode,
+                                               process.stdout[-2000:]),
+              file=sys.stderr)
+        return None
+    return result
+
+
+def cases(args):
+    modes = ['strong', 'weak'] if args.mode == 'both' else [args.mode]
+    for mode in modes:
+        for size in args.sizes:
+            base_rows, base_cols = parse_size(size)
+            for mesh in args.meshes:
+                for layout in args.layouts:
+                    for ranks in sorted(args.ranks):
+                        dims = layout_dims(layout, ranks)
+                        if mode == 'weak':
+                            rows = base_rows * dims[0]
+                            cols = base_cols * dims[1]
+                        else:
+                            rows, cols = base_rows, base_cols
+                        if dims[0] > rows or dims[1] > cols:
+                            continue
+                        yield {'mode': mode, 'size': size, 'mesh': mesh,
+                               'layout': layout, 'ranks': ranks,
+                               'dims': '{}x{}'.format(*dims),
+                               'rows': rows, 'cols': cols,
+                               'steps': args.steps,
+                               '_dims': dims}
+
+
+def print_tables(results):
+    # Best wallclock per configuration, relative to the smallest rank count
+    best = {}
+    for row in results:
+        key = (row['mode'], row['size'], row['mesh'], row['layout'])
+        series = best.setdefault(key, {})
+        ranks = row['ranks']
+        if ranks not in series or row['wallclock'] < series[ranks]['wallclock']:
+            series[ranks] = row
+    for key in sorted(best):
+        mode, size, mesh, layout = key
+        series = best[key]
+        base_ranks = min(series)
+        base_time = series[base_ranks]['wallclock']
+        print('\n{} scaling, size {}{}, mesh {}, layout {}'.format(
+            mode, size, ' per rank' if mode == 'weak' else '', mesh, layout))
+        print('  {:>6} {:>7} {:>12} {:>9} {:>10} {:>12} {:>10}'.format(
+            'ranks', 'dims', 'wallclock', 'speedup', 'efficiency',
+            'halo_wait', 'imbalance'))
+        for ranks in sorted(series):
+            row = series[ranks]
+            time = row['wallclock']
+            if mode == 'strong':
+                speedup = base_time / time if time > 0 else 0.0
+                efficiency = speedup * base_ranks / ranks
+            else:
+                # Work grows with ranks, so ideal is a constant wallclock
+                speedup = base_time / time * ranks / base_ranks if time > 0 else 0.0
+                efficiency = base_time / time if time > 0 else 0.0
+            print('  {:>6} {:>7} {:>12.4f} {:>9.2f} {:>9.1f}% {:>12.4e} {:>10.3f}'.format(
+                ranks, row['dims'], time, speedup, 100.0 * efficiency,
+                row.get('halo_wait_mean', 0.0),
+                row.get('compute_imbalance', 1.0)))
+
+
+def main():
+    args = process_arguments()
+    ensure_path_exists(args.config_dir)
+    fields = ['mode', 'size', 'mesh', 'layout', 'ranks', 'dims', 'rows',
+              'cols', 'steps', 'repeat', 'wallclock']
+    for phase in PHASES:
+        fields += [phase + '_mean', phase + '_max', phase + '_imbalance']
+    results = []
+    with open(args.csv, 'w') as csvfile:
+        writer = csv.DictWriter(csvfile, fieldnames=fields, extrasaction='ignore')
+        writer.writeheader()
+        for case in cases(args):
+            name = '{mode}_{mesh}_{layout}_{ranks}_{rows}x{cols}'.format(**case)
+            config = os.path.join(args.config_dir, name + '.in')
+            write_config(config, name, case['mesh'], case['rows'],
+                         case['cols'], case['_dims'], case['steps'])
+            for repeat in range(args.repeats):
+                print('{} (repeat {}/{})'.format(name, repeat + 1, args.repeats),
+                      file=sys.stderr)
+                result = run_case(args, case, config)
+                if result is None:
+                    continue
+                row = dict(case)
+                row.update(result)
+                row['repeat'] = repeat
+                writer.writerow(row)
+                csvfile.flush()
+                results.append(row)
+    if results:
+        print_tables(results)
+
+
+if __name__ == '__main__':
+    main()
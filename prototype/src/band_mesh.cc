@@ -0,0 +1,153 @@
+#include "band_mesh.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "config_file.h"
+#include "profiler.h"
+
+namespace {
+  enum Boundary {
+    TOP = 0,
+    BOTTOM = 1,
+    LEFT = 2,
+    RIGHT = 3,
+  };
+}
+
+BandMesh::BandMesh(const ConfigFile& config_) : Mesh(config_),
+                                                _u0(0),
+                                                _u1(0),
+                                                _first_row(0),
+                                                _rows(0),
+                                                _step(0) {
+  _world_rows = static_cast<int>(get_world_core_row_count());
+  _world_cols = static_cast<int>(get_world_core_col_count());
+}
+
+BandMesh::~BandMesh() {
+}
+
+void BandMesh::set_window(double *u0_, double *u1_, int first_row_, int rows_) {
+  _u0 = u0_;
+  _u1 = u1_;
+  _first_row = first_row_;
+  _rows = rows_;
+  _step = 0;
+}
+
+bool BandMesh::at_top() const {
+  return _first_row == 0;
+}
+
+bool BandMesh::at_bottom() const {
+  return _first_row + _rows == _world_rows + 2;
+}
+
+void BandMesh::advance() {
+  {
+    ScopedPhase phase(_profiler, REFLECT);
+    if (at_top()) {
+      reflect_boundary(TOP);
+    }
+    if (at_bottom()) {
+      reflect_boundary(BOTTOM);
+    }
+    reflect_boundary(LEFT);
+    reflect_boundary(RIGHT);
+  }
+  ++_step;
+  std::swap(_u0, _u1);
+}
+
+// Around the rows the last step updated, in u1
+void BandMesh::reflect_boundary(int boundary_) {
+  const int x_span = get_node_augmented_col_count();
+  const int first = get_step_row_offset();
+  const int last = first + get_step_row_count() - 1;
+  switch (boundary_) {
+    case (TOP):
+      std::copy(&_u1[first * x_span + 1], &_u1[first * x_span + 1 + _world_cols],
+                &_u1[(first - 1) * x_span + 1]);
+      break;
+    case (BOTTOM):
+      std::copy(&_u1[last * x_span + 1], &_u1[last * x_span + 1 + _world_cols],
+                &_u1[(last + 1) * x_span + 1]);
+      break;
+    case (LEFT):
+      for (int i = first; i <= last; ++i) {
+        _u1[i * x_span] = _u1[i * x_span + 1];
+      }
+      break;
+    case (RIGHT):
+      for (int i = first; i <= last; ++i) {
+        _u1[i * x_span + _world_cols + 1] = _u1[i * x_span + _world_cols];
+      }
+      break;
+  }
+}
+
+void BandMesh::update_halo(double *field_) {
+  throw std::logic_error("A band mesh has no halo to update");
+}
+
+double * BandMesh::get_u0() { return _u0; }
+double * BandMesh::get_u1() { return _u1; }
+
+double BandMesh::get_x_coord(int j_) const {
+  return (j_ - 1) * get_del_x();
+}
+
+double BandMesh::get_y_coord(int i_) const {
+  return (_first_row + i_ - 1) * get_del_y();
+}
+
+// The window's rows that are rows of the core domain
+int BandMesh::get_node_core_row_count() const {
+  return _rows - (at_top() ? 1 : 0) - (at_bottom() ? 1 : 0);
+}
+
+int BandMesh::get_node_core_col_count() const {
+  return _world_cols;
+}
+
+int BandMesh::get_node_augmented_row_count() const {
+  return _rows;
+}
+
+int BandMesh::get_node_augmented_col_count() const {
+  return _world_cols + 2;
+}
+
+int BandMesh::get_node_core_cell_count() const {
+  return get_node_core_row_count() * get_node_core_col_count();
+}
+
+int BandMesh::get_node_augmented_cell_count() const {
+  return get_node_augmented_row_count() * get_node_augmented_col_count();
+}
+
+int BandMesh::get_current_row_offset() const {
+  return at_top() ? 1 : 0;
+}
+
+int BandMesh::get_current_col_offset() const {
+  return 1;
+}
+
+int BandMesh::get_previous_row_offset() const {
+  return get_current_row_offset();
+}
+
+int BandMesh::get_previous_col_offset() const {
+  return 1;
+}
+
+int BandMesh::get_step_row_offset() const {
+  return at_top() ? 1 : _step + 1;
+}
+
+int BandMesh::get_step_row_count() const {
+  const int end = at_bottom() ? _rows - 1 : _rows - _step - 1;
+  return end - get_step_row_offset();
+}
@@ -0,0 +1,47 @@
+#ifndef BAND_MESH_H
+#define BAND_MESH_H
+#include "mesh.h"
+class ConfigFile;
+// A band of whole rows of a 2D domain on one rank, over buffers that
+// OutOfCoreDriver streams through it. The window holds augmented rows
+// [first_row, first_row + rows) of the domain; each step updates one row
+// fewer at every end that is not a physical edge, so a window deepened by
+// T rows either side yields its middle rows T steps on.
+class BandMesh : public Mesh {
+ public:
+  BandMesh(const ConfigFile& config_);
+  virtual ~BandMesh();
+  // Starts a band: u0_ holds the rows, u1_ is scratch of the same size
+  void set_window(double *u0_, double *u1_, int first_row_, int rows_);
+  void advance();
+  void reflect_boundary(int boundary_);
+  void update_halo(double *field_);
+  double * get_u0();
+  double * get_u1();
+  double get_x_coord(int j_) const;
+  double get_y_coord(int i_) const;
+  int get_node_core_row_count() const;
+  int get_node_core_col_count() const;
+  int get_node_augmented_row_count() const;
+  int get_node_augmented_col_count() const;
+  int get_node_core_cell_count() const;
+  int get_node_augmented_cell_count() const;
+  int get_current_row_offset() const;
+  int get_current_col_offset() const;
+  int get_previous_row_offset() const;
+  int get_previous_col_offset() const;
+  int get_step_row_offset() const;
+  int get_step_row_count() const;
+
+ private:
+  bool at_top() const;
+  bool at_bottom() const;
+  double *_u0;
+  double *_u1;
+  int _first_row;
+  int _rows;
+  int _step; // steps taken since set_window
+  int _world_rows;
+  int _world_cols;
+};
+#endif
@@ -0,0 +1,295 @@
+#include "benchmark.h"
+
+#include <mpi.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "tools-inl.h"
+#include "config_file.h"
+#include "driver.h"
+#include "profiler.h"
+
+namespace {
+  double median(std::vector<double> values_) {
+    std::sort(values_.begin(), values_.end());
+    const std::size_t n = values_.size();
+    return (n % 2) ? values_[n / 2] : 0.5 * (values_[n / 2 - 1] + values_[n / 2]);
+  }
+
+  double mean(const std::vector<double>& values_) {
+    double sum = 0;
+    for (std::size_t v = 0; v < values_.size(); ++v) {
+      sum += values_[v];
+    }
+    return sum / values_.size();
+  }
+
+  double stddev(const std::vector<double>& values_) {
+    const std::size_t n = values_.size();
+    if (n < 2) {
+      return 0.0;
+    }
+    const double m = mean(values_);
+    double squares = 0;
+    for (std::size_t v = 0; v < n; ++v) {
+      squares += (values_[v] - m) * (values_[v] - m);
+    }
+    return std::sqrt(squares / (n - 1));
+  }
+
+  std::string json_string(const std::string& value_) {
+    std::string quoted("\"");
+    for (std::size_t c = 0; c < value_.size(); ++c) {
+      const char ch = value_[c];
+      if (ch == '"' || ch == '\\') {
+        quoted += '\\';
+        quoted += ch;
+      } else if (static_cast<unsigned char>(ch) < 0x20) {
+        quoted += ' ';
+      } else {
+        quoted += ch;
+      }
+    }
+    return quoted + "\"";
+  }
+
+  void write_stats(std::ostream& os_, const std::vector<double>& values_) {
+    os_ << "{\"min\": " << *std::min_element(values_.begin(), values_.end())
+        << ", \"median\": " << median(values_)
+        << ", \"mean\": " << mean(values_)
+        << ", \"max\": " << *std::max_element(values_.begin(), values_.end())
+        << ", \"stddev\": " << stddev(values_) << "}";
+  }
+
+  // The text after "key": in a flat JSON document, empty when it is absent
+  std::string json_field(const std::string& text_, const std::string& key_) {
+    const std::string needle = "\"" + key_ + "\":";
+    std::size_t pos = text_.find(needle);
+    if (pos == std::string::npos) {
+      return std::string();
+    }
+    pos = text_.find_first_not_of(" \t\n", pos + needle.size());
+    if (pos == std::string::npos) {
+      return std::string();
+    }
+    if (text_[pos] == '"') {
+      const std::size_t end = text_.find('"', pos + 1);
+      return end == std::string::npos ? std::string() : text_.substr(pos + 1, end - pos - 1);
+    }
+    const std::size_t end = text_.find_first_of(",}\n", pos);
+    return text_.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+  }
+}
+
+Benchmark::Benchmark(const ConfigFile& config_) : _config(config_) {
+  _warmup = _config.get_or_default("bench_warmup", 1);
+  _repetitions = _config.get_or_default("bench_repetitions", 5);
+  const std::string name = _config.get_or_default("name", std::string("prototype"));
+  const std::string mesh_type = _config.get_or_default("mesh_type", std::string("static"));
+  _output = _config.get_or_default("bench_output", name + "_" + mesh_type + ".bench.json");
+  _baseline = _config.get_or_default("bench_baseline", std::string(""));
+  _threshold = _config.get_or_default("bench_threshold", 0.05);
+  if (_warmup < 0 || _repetitions < 1) {
+    throw std::logic_error("bench_warmup must be at least 0 and bench_repetitions at least 1");
+  }
+  if (_config.get_or_default("ensemble_members", 0) > 0
+      || _config.get_or_default("blocks_per_rank", 0) > 0
+      || _config.get_or_default("out_of_core", false)) {
+    throw std::logic_error("--bench runs the standard driver only, not ensembles, "
+                           "blocks or out of core");
+  }
+  _hash = _config.fingerprint("bench_");
+  MPI_Comm_rank(MPI_COMM_WORLD, &_world_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &_world_size);
+}
+
+Benchmark::~Benchmark() {}
+
+int Benchmark::run() {
+  double cell_updates = 0;
+  for (int rep = 0; rep < _warmup; ++rep) {
+    run_once(cell_updates);
+  }
+  std::vector<Sample> samples;
+  for (int rep = 0; rep < _repetitions; ++rep) {
+    samples.push_back(run_once(cell_updates));
+  }
+  int status = 0;
+  if (_world_rank == 0) {
+    std::vector<double> rates;
+    for (std::size_t s = 0; s < samples.size(); ++s) {
+      rates.push_back(cell_updates / samples[s].wall);
+    }
+    const double rate = median(rates);
+    Comparison comparison;
+    if (!_baseline.empty()) {
+      read_baseline(comparison);
+      comparison.ratio = rate / comparison.baseline_rate;
+      comparison.regressed = comparison.ratio < 1.0 - _threshold;
+      status = comparison.regressed ? 2 : 0;
+    }
+    std::ofstream ofs(_output.c_str());
+    if (!ofs.good()) {
+      std::stringstream msg;
+      msg << "Cannot open benchmark output " << _output;
+      throw std::logic_error(msg.str());
+    }
+    write_json(ofs, samples, cell_updates, _baseline.empty() ? 0 : &comparison);
+    std::cout << "Benchmark: " << 1.0e-6 * rate << " Mcell/s median of " << _repetitions
+              << " runs (best " << 1.0e-6 * *std::max_element(rates.begin(), rates.end())
+              << "), results in " << _output << std::endl;
+    if (!_baseline.empty()) {
+      if (comparison.baseline_hash != _hash || comparison.baseline_ranks != _world_size) {
+        std::cout << "Warning: baseline " << _baseline << " is of config " << comparison.baseline_hash
+                  << " on " << comparison.baseline_ranks << " ranks, this run is of " << _hash
+                  << " on " << _world_size << std::endl;
+      }
+      std::cout << "Baseline: " << 1.0e-6 * comparison.baseline_rate << " Mcell/s, ratio "
+                << comparison.ratio << (comparison.regressed ? ", REGRESSION" : ", ok")
+                << " (threshold " << _threshold << ")" << std::endl;
+    }
+  }
+  MPI_Bcast(&status, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  return status;
+}
+
+Benchmark::Sample Benchmark::run_once(double& cell_updates_) {
+  ConfigFile config(_config);
+  config.set("visualize", "false");
+  config.set("debug", "false");
+  config.set("trace", "false");
+  config.set("performance_report", "false");
+  config.set("run_summary", "false");
+  Driver driver(config);
+  MPI_Barrier(MPI_COMM_WORLD);
+  const double start = monotonic_seconds();
+  driver.run();
+  double elapsed = monotonic_seconds() - start;
+  const Profiler& profiler = driver.get_profiler();
+  Sample sample;
+  MPI_Allreduce(&elapsed, &sample.wall, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  double totals[PHASE_COUNT];
+  for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+    totals[phase] = profiler.get_total(phase);
+  }
+  sample.phase_max.resize(PHASE_COUNT);
+  sample.phase_mean.resize(PHASE_COUNT);
+  MPI_Allreduce(totals, &sample.phase_max[0], PHASE_COUNT, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  MPI_Allreduce(totals, &sample.phase_mean[0], PHASE_COUNT, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+    sample.phase_mean[phase] /= _world_size;
+  }
+  double cells = static_cast<double>(profiler.get_cell_updates());
+  MPI_Allreduce(&cells, &cell_updates_, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  return sample;
+}
+
+void Benchmark::write_json(std::ostream& os_, const std::vector<Sample>& samples_,
+                           double cell_updates_, const Comparison *comparison_) const {
+  std::vector<double> walls;
+  std::vector<double> rates;
+  for (std::size_t s = 0; s < samples_.size(); ++s) {
+    walls.push_back(samples_[s].wall);
+    rates.push_back(cell_updates_ / samples_[s].wall);
+  }
+  char hostname[256] = "unknown";
+  gethostname(hostname, sizeof(hostname) - 1);
+  char library[MPI_MAX_LIBRARY_VERSION_STRING] = "";
+  int length = 0;
+  MPI_Get_library_version(library, &length);
+  std::string mpi(library, length);
+  mpi = mpi.substr(0, mpi.find_first_of(",\n"));
+  int threads = 1;
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+  const std::vector<int> dimensions = _config.get_or_default("logical_dimensions",
+                                                             std::vector<int>());
+  os_.precision(10);
+  os_ << "{\n"
+      << "  \"name\": " << json_string(_config.get_or_default("name", std::string("prototype"))) << ",\n"
+      << "  \"config\": " << json_string(_config.get_filename()) << ",\n"
+      << "  \"config_hash\": \"" << _hash << "\",\n"
+      << "  \"mesh_type\": " << json_string(_config.get_or_default("mesh_type", std::string("static"))) << ",\n"
+      << "  \"scheme\": " << json_string(_config.get_or_default("scheme", std::string("explicit"))) << ",\n"
+      << "  \"logical_dimensions\": [";
+  for (std::size_t d = 0; d < dimensions.size(); ++d) {
+    os_ << (d ? ", " : "") << dimensions[d];
+  }
+  os_ << "],\n"
+      << "  \"ranks\": " << _world_size << ",\n"
+      << "  \"threads\": " << threads << ",\n"
+      << "  \"warmup\": " << _warmup << ",\n"
+      << "  \"repetitions\": " << _repetitions << ",\n"
+      << "  \"cell_updates\": " << cell_updates_ << ",\n"
+      << "  \"host\": {\"hostname\": " << json_string(hostname)
+      << ", \"cpus\": " << sysconf(_SC_NPROCESSORS_ONLN)
+      << ", \"compiler\": " << json_string(__VERSION__)
+      << ", \"mpi\": " << json_string(mpi) << "},\n"
+      << "  \"wall_seconds\": ";
+  write_stats(os_, walls);
+  os_ << ",\n  \"phase_seconds\": {";
+  for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+    std::vector<double> slowest;
+    std::vector<double> means;
+    for (std::size_t s = 0; s < samples_.size(); ++s) {
+      slowest.push_back(samples_[s].phase_max[phase]);
+      means.push_back(samples_[s].phase_mean[phase]);
+    }
+    os_ << (phase ? ",\n" : "\n") << "    \"" << Profiler::phase_name(phase)
+        << "\": {\"max_rank\": " << median(slowest) << ", \"mean_rank\": " << median(means) << "}";
+  }
+  os_ << "\n  },\n"
+      << "  \"samples_cells_per_second\": [";
+  for (std::size_t s = 0; s < rates.size(); ++s) {
+    os_ << (s ? ", " : "") << rates[s];
+  }
+  os_ << "],\n"
+      << "  \"best_cells_per_second\": " << *std::max_element(rates.begin(), rates.end()) << ",\n"
+      << "  \"cells_per_second\": " << median(rates);
+  if (comparison_) {
+    os_ << ",\n  \"baseline\": {\"file\": " << json_string(_baseline)
+        << ", \"config_hash\": " << json_string(comparison_->baseline_hash)
+        << ", \"ranks\": " << comparison_->baseline_ranks
+        << ", \"cells_per_second\": " << comparison_->baseline_rate
+        << ", \"ratio\": " << comparison_->ratio
+        << ", \"threshold\": " << _threshold
+        << ", \"regressed\": " << (comparison_->regressed ? "true" : "false") << "}";
+  }
+  os_ << "\n}\n";
+}
+
+void Benchmark::read_baseline(Comparison& comparison_) const {
+  std::ifstream ifs(_baseline.c_str());
+  if (!ifs.good()) {
+    std::stringstream msg;
+    msg << "Benchmark baseline " << _baseline << " not found";
+    throw std::logic_error(msg.str());
+  }
+  std::stringstream text;
+  text << ifs.rdbuf();
+  // The top level fields come before the nested baseline of a file that was
+  // itself compared, so the first match is the one wanted
+  const std::string rate = json_field(text.str(), "cells_per_second");
+  comparison_.baseline_rate = std::atof(rate.c_str());
+  if (comparison_.baseline_rate <= 0) {
+    std::stringstream msg;
+    msg << "Benchmark baseline " << _baseline << " has no cells_per_second";
+    throw std::logic_error(msg.str());
+  }
+  comparison_.baseline_hash = json_field(text.str(), "config_hash");
+  comparison_.baseline_ranks = std::atoi(json_field(text.str(), "ranks").c_str());
+  comparison_.ratio = 1.0;
+  comparison_.regressed = false;
+}
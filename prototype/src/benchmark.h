@@ -0,0 +1,63 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <mpi.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class ConfigFile;
+// deqn --bench: runs the configured problem bench_warmup times untimed, then
+// bench_repetitions times timed, each from a fresh Driver with output,
+// debug, tracing and the run reports off, and writes the results as JSON.
+//   bench_warmup      - untimed runs first (1)
+//   bench_repetitions - timed runs (5)
+//   bench_output      - JSON results, <name>_<mesh_type>.bench.json
+//   bench_baseline    - an earlier bench_output to hold this run against
+//   bench_threshold   - fraction of the baseline's median cells/s that may
+//                       be lost before the run counts as a regression (0.05)
+// Keys starting bench_ are left out of the config hash, so a baseline taken
+// with other repetitions still matches.
+class Benchmark {
+ public:
+  Benchmark(const ConfigFile& config_);
+  ~Benchmark();
+  // Collective, returns the exit status: 0, or 2 on a regression against
+  // the baseline
+  int run();
+
+ private:
+  // Repetition samples, the slowest rank's wall time for each and per phase
+  // the slowest and the mean rank's time
+  struct Sample {
+    double wall;
+    std::vector<double> phase_max;
+    std::vector<double> phase_mean;
+  };
+  // This run's median cells/s against the baseline's
+  struct Comparison {
+    double baseline_rate;
+    std::string baseline_hash;
+    int baseline_ranks;
+    double ratio;
+    bool regressed;
+  };
+  // One Driver run, cell_updates_ is set to the updates summed over ranks
+  Sample run_once(double& cell_updates_);
+  void write_json(std::ostream& os_, const std::vector<Sample>& samples_,
+                  double cell_updates_, const Comparison *comparison_) const;
+  // Reads the baseline's median cells/s, config hash and ranks; throws when
+  // it cannot be read
+  void read_baseline(Comparison& comparison_) const;
+
+  const ConfigFile& _config;
+  int _warmup;
+  int _repetitions;
+  std::string _output;
+  std::string _baseline;
+  double _threshold;
+  std::string _hash;
+  int _world_rank;
+  int _world_size;
+};
+#endif
@@ -0,0 +1,487 @@
+#include "block_driver.h"
+
+#include <mpi.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "tools-inl.h"
+#include "block_mesh.h"
+#include "calculation.h"
+#include "data_source.h"
+#include "vtk_writer.h"
+#include "compressed_writer.h"
+#include "field_allocator.h"
+
+namespace {
+  enum Boundary {
+    TOP = 0,
+    BOTTOM = 1,
+    LEFT = 2,
+    RIGHT = 3,
+  };
+
+  // First cell, stride and length of a block's core edge on a side, or of
+  // the ghosts beyond it
+  void edge(const Mesh *mesh_, int boundary_, bool ghost_,
+            int& start_, int& stride_, int& count_) {
+    const int x_span = mesh_->get_node_augmented_col_count();
+    const int rows = mesh_->get_node_core_row_count();
+    const int cols = mesh_->get_node_core_col_count();
+    switch (boundary_) {
+      case (TOP):
+        start_ = (ghost_ ? 0 : 1) * x_span + 1;
+        break;
+      case (BOTTOM):
+        start_ = (ghost_ ? rows + 1 : rows) * x_span + 1;
+        break;
+      case (LEFT):
+        start_ = x_span + (ghost_ ? 0 : 1);
+        break;
+      default:
+        start_ = x_span + (ghost_ ? cols + 1 : cols);
+        break;
+    }
+    const bool horizontal = boundary_ == TOP || boundary_ == BOTTOM;
+    stride_ = horizontal ? 1 : x_span;
+    count_ = horizontal ? cols : rows;
+  }
+}
+
+BlockDriver::BlockDriver(const ConfigFile& config_) : _config(config_),
+                                                      _balances(0),
+                                                      _migrations(0) {
+  _debug = _config.get_or_default("debug", false);
+  _visualize = _config.get_or_default("visualize", true);
+  _performance_report = _config.get_or_default("performance_report", false);
+  _name = _config.get_or_default("name", std::string("prototype"));
+  _output_rate = _config.get_or_default("output_rate", 1);
+  _output_format = _config.get_or_default("output_format", std::string("vtk"));
+  _compression_error_bound = _config.get_or_default("compression_error_bound", 0.0);
+  _t_start = _config.get_or_default("start_time", 0.0);
+  _t_end = _config.get_or_default("end_time", 2.0);
+  _del_t = _config.get_or_default("timestep", 0.02);
+  _balance_interval = _config.get_or_default("block_balance_interval", 0);
+  _balance_threshold = _config.get_or_default("block_balance_threshold", 1.1);
+  const int blocks_per_rank = _config.get_or_default("blocks_per_rank", 0);
+  if (_config.get_or_default("scheme", std::string("explicit")) != "explicit"
+      || _config.get_or_default("mesh_type", std::string("static")) != "static"
+      || _config.get_or_default("logical_dimensions", std::vector<int>()).size() > 2
+      || _config.get_or_default("single_buffer", false)
+      || _config.get_or_default("active_tiles", false)
+      || !_config.get_line_or_default("conductivity", "").empty()
+      || !_config.get_line_or_default("conductivity_field", "").empty()
+      || !_config.get_line_or_default("conductivity_subregions", "").empty()) {
+    throw std::logic_error("blocks_per_rank runs the explicit scheme on a 2D static mesh "
+                           "with two buffers, without active_tiles or conductivity");
+  }
+  if (_output_format != "vtk" && _output_format != "compressed") {
+    std::stringstream ss;
+    ss << "Unknown output format: " << _output_format << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  MPI_Comm_dup(MPI_COMM_WORLD, &_comm);
+  MPI_Comm_size(_comm, &_world_size);
+  MPI_Comm_rank(_comm, &_world_rank);
+  _block_count = _world_size * blocks_per_rank;
+  int *tag_ub = 0;
+  int has_tag_ub = 0;
+  MPI_Comm_get_attr(_comm, MPI_TAG_UB, &tag_ub, &has_tag_ub);
+  // The standard guarantees 32767 at least
+  _max_local_blocks = static_cast<int>((static_cast<long>(has_tag_ub ? *tag_ub : 32767) + 1) / 8);
+  if (blocks_per_rank > _max_local_blocks) {
+    std::stringstream ss;
+    ss << "blocks_per_rank " << blocks_per_rank << " is more than the " << _max_local_blocks
+       << " blocks a rank can hold within MPI_TAG_UB" << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  int dims[2] = { 0, 0 };
+  MPI_Dims_create(_block_count, 2, dims);
+  _grid_rows = dims[0];
+  _grid_cols = dims[1];
+  // Each rank starts with an equal run of blocks, in row major order
+  _owners.resize(_block_count);
+  _blocks.assign(_block_count, static_cast<Block*>(0));
+  DataSource ds(_config);
+  for (int id = 0; id < _block_count; ++id) {
+    _owners[id] = static_cast<int>(static_cast<long>(id) * _world_size / _block_count);
+    if (_owners[id] == _world_rank) {
+      create_block(id);
+      ds.populate(_blocks[id]->mesh);
+      _local.push_back(id);
+    }
+  }
+  index_owners();
+}
+
+BlockDriver::~BlockDriver() {
+  for (size_t l = 0; l < _local.size(); ++l) {
+    destroy_block(_local[l]);
+  }
+  MPI_Comm_free(&_comm);
+}
+
+void BlockDriver::create_block(int id_) {
+  Block *block = new Block;
+  const int row = id_ / _grid_cols;
+  const int col = id_ % _grid_cols;
+  block->mesh = new BlockMesh(_config, row, col, _grid_rows, _grid_cols);
+  block->mesh->set_profiler(&_profiler);
+  block->calculation = new Calculation(_config, block->mesh);
+  std::stringstream tag;
+  tag << _name << "_blocks";
+  if (_output_format == "vtk") {
+    block->writer = new VtkWriter(tag.str(), block->mesh, id_, _block_count);
+  } else {
+    block->writer = new CompressedWriter(tag.str(), block->mesh, id_, _block_count,
+                                         _compression_error_bound);
+  }
+  block->neighbours[TOP] = row > 0 ? id_ - _grid_cols : -1;
+  block->neighbours[BOTTOM] = row + 1 < _grid_rows ? id_ + _grid_cols : -1;
+  block->neighbours[LEFT] = col > 0 ? id_ - 1 : -1;
+  block->neighbours[RIGHT] = col + 1 < _grid_cols ? id_ + 1 : -1;
+  block->pending = 0;
+  block->cost = 0;
+  for (int boundary = TOP; boundary <= RIGHT; ++boundary) {
+    int start, stride, count;
+    edge(block->mesh, boundary, false, start, stride, count);
+    for (int parity = 0; parity < 2; ++parity) {
+      if (block->neighbours[boundary] >= 0) {
+        block->send[boundary][parity].resize(count);
+        block->receive[boundary][parity].resize(count);
+      }
+      block->send_request[boundary][parity] = MPI_REQUEST_NULL;
+    }
+  }
+  _blocks[id_] = block;
+}
+
+void BlockDriver::destroy_block(int id_) {
+  Block *block = _blocks[id_];
+  delete block->writer;
+  delete block->calculation;
+  delete block->mesh;
+  delete block;
+  _blocks[id_] = 0;
+}
+
+void BlockDriver::index_owners() {
+  _first.assign(_world_size, _block_count);
+  for (int id = _block_count - 1; id >= 0; --id) {
+    _first[_owners[id]] = id;
+  }
+}
+
+int BlockDriver::tag(int id_, int boundary_, int level_) const {
+  // Messages between two ranks are told apart by the receiving block's
+  // place on its rank and side. Two levels' receives can be outstanding,
+  // so the parity is in the tag too
+  return ((id_ - _first[_owners[id_]]) * 4 + boundary_) * 2 + level_ % 2;
+}
+
+void BlockDriver::step(int step_) {
+  const int next = (step_ + 1) % 2;
+  // Post the receives for the halos this step makes
+  std::vector<int> next_pending(_local.size(), 0);
+  {
+    ScopedPhase phase(&_profiler, HALO_POST);
+    _receives[next].clear();
+    _receive_targets[next].clear();
+    for (size_t l = 0; l < _local.size(); ++l) {
+      Block& block = *_blocks[_local[l]];
+      for (int boundary = TOP; boundary <= RIGHT; ++boundary) {
+        const int neighbour = block.neighbours[boundary];
+        if (neighbour < 0 || _owners[neighbour] == _world_rank) {
+          continue;
+        }
+        std::vector<double>& buffer = block.receive[boundary][next];
+        _receives[next].push_back(MPI_REQUEST_NULL);
+        _receive_targets[next].push_back(_local[l] * 4 + boundary);
+        MPI_Irecv(&buffer[0], static_cast<int>(buffer.size()), MPI_DOUBLE,
+                  _owners[neighbour], tag(_local[l], boundary, step_ + 1), _comm,
+                  &_receives[next].back());
+        ++next_pending[l];
+      }
+    }
+  }
+  // Blocks whose halos are all in go first; the rest as their messages land
+  std::vector<int> ready;
+  for (size_t l = 0; l < _local.size(); ++l) {
+    if (_blocks[_local[l]]->pending == 0) {
+      ready.push_back(_local[l]);
+    }
+  }
+  const int parity = step_ % 2;
+  std::vector<MPI_Request>& waiting = _receives[parity];
+  std::vector<int> indices(waiting.size());
+  size_t computed = 0;
+  while (computed < _local.size()) {
+    int done = 0;
+    if (!waiting.empty()) {
+      if (ready.empty()) {
+        ScopedPhase phase(&_profiler, HALO_WAIT);
+        MPI_Waitsome(static_cast<int>(waiting.size()), &waiting[0], &done, &indices[0],
+                     MPI_STATUSES_IGNORE);
+      } else {
+        MPI_Testsome(static_cast<int>(waiting.size()), &waiting[0], &done, &indices[0],
+                     MPI_STATUSES_IGNORE);
+      }
+    }
+    for (int d = 0; d < done && done != MPI_UNDEFINED; ++d) {
+      const int target = _receive_targets[parity][indices[d]];
+      unpack(target / 4, target % 4, step_);
+      if (--_blocks[target / 4]->pending == 0) {
+        ready.push_back(target / 4);
+      }
+    }
+    if (ready.empty()) {
+      if (done == MPI_UNDEFINED) {
+        throw std::logic_error("Blocks wait on halos that were never posted");
+      }
+      continue;
+    }
+    const int id = ready.back();
+    ready.pop_back();
+    compute(id, step_);
+    ++computed;
+  }
+  for (size_t l = 0; l < _local.size(); ++l) {
+    Block& block = *_blocks[_local[l]];
+    block.pending = next_pending[l];
+    block.mesh->advance();
+  }
+}
+
+void BlockDriver::compute(int id_, int step_) {
+  Block& block = *_blocks[id_];
+  const double start = MPI_Wtime();
+  {
+    ScopedPhase phase(&_profiler, COMPUTE);
+    block.calculation->step(_del_t);
+  }
+  block.cost += MPI_Wtime() - start;
+  _profiler.count_cell_updates(block.mesh->get_node_core_cell_count());
+  const int next = (step_ + 1) % 2;
+  const double *u1 = block.mesh->get_u1();
+  for (int boundary = TOP; boundary <= RIGHT; ++boundary) {
+    const int neighbour = block.neighbours[boundary];
+    if (neighbour < 0) {
+      continue;
+    }
+    int start, stride, count;
+    edge(block.mesh, boundary, false, start, stride, count);
+    if (_owners[neighbour] == _world_rank) {
+      // Straight into the ghosts the neighbour's advance() will swap in
+      BlockMesh *other = _blocks[neighbour]->mesh;
+      double *ghosts = other->get_u1();
+      int ghost_start, ghost_stride, ghost_count;
+      edge(other, boundary ^ 1, true, ghost_start, ghost_stride, ghost_count);
+      for (int c = 0; c < count; ++c) {
+        ghosts[ghost_start + c * ghost_stride] = u1[start + c * stride];
+      }
+      continue;
+    }
+    ScopedPhase phase(&_profiler, HALO_POST);
+    std::vector<double>& buffer = block.send[boundary][next];
+    // Two levels back, received before this block could take this step
+    MPI_Wait(&block.send_request[boundary][next], MPI_STATUS_IGNORE);
+    for (int c = 0; c < count; ++c) {
+      buffer[c] = u1[start + c * stride];
+    }
+    // TOP and BOTTOM, LEFT and RIGHT differ in the lowest bit
+    MPI_Isend(&buffer[0], count, MPI_DOUBLE, _owners[neighbour],
+              tag(neighbour, boundary ^ 1, step_ + 1), _comm,
+              &block.send_request[boundary][next]);
+    _profiler.count_halo_bytes(count * sizeof(double));
+  }
+}
+
+void BlockDriver::unpack(int id_, int boundary_, int level_) {
+  Block& block = *_blocks[id_];
+  const std::vector<double>& buffer = block.receive[boundary_][level_ % 2];
+  double *u0 = block.mesh->get_u0();
+  int start, stride, count;
+  edge(block.mesh, boundary_, true, start, stride, count);
+  for (int c = 0; c < count; ++c) {
+    u0[start + c * stride] = buffer[c];
+  }
+}
+
+void BlockDriver::settle(int level_) {
+  ScopedPhase phase(&_profiler, HALO_WAIT);
+  const int parity = level_ % 2;
+  std::vector<MPI_Request>& waiting = _receives[parity];
+  if (!waiting.empty()) {
+    MPI_Waitall(static_cast<int>(waiting.size()), &waiting[0], MPI_STATUSES_IGNORE);
+  }
+  for (size_t r = 0; r < waiting.size(); ++r) {
+    const int target = _receive_targets[parity][r];
+    unpack(target / 4, target % 4, level_);
+  }
+  waiting.clear();
+  _receive_targets[parity].clear();
+  for (size_t l = 0; l < _local.size(); ++l) {
+    Block& block = *_blocks[_local[l]];
+    block.pending = 0;
+    MPI_Waitall(8, &block.send_request[0][0], MPI_STATUSES_IGNORE);
+  }
+}
+
+void BlockDriver::balance(int level_) {
+  settle(level_);
+  std::vector<double> costs(_block_count, 0.0);
+  for (size_t l = 0; l < _local.size(); ++l) {
+    costs[_local[l]] = _blocks[_local[l]]->cost;
+    _blocks[_local[l]]->cost = 0;
+  }
+  MPI_Allreduce(MPI_IN_PLACE, &costs[0], _block_count, MPI_DOUBLE, MPI_SUM, _comm);
+  std::vector<double> loads(_world_size, 0.0);
+  double total = 0;
+  for (int id = 0; id < _block_count; ++id) {
+    loads[_owners[id]] += costs[id];
+    total += costs[id];
+  }
+  const double mean = total / _world_size;
+  const double imbalance = mean > 0 ? *std::max_element(loads.begin(), loads.end()) / mean : 1;
+  if (imbalance <= _balance_threshold) {
+    return;
+  }
+  // Runs of blocks in order, each as near the mean as whole blocks allow;
+  // block 0 stays on rank 0, whose writer keeps the list of files
+  std::vector<int> owners(_block_count, 0);
+  double before = 0;
+  for (int id = 1; id < _block_count; ++id) {
+    before += costs[id - 1];
+    const int rank = static_cast<int>((before + 0.5 * costs[id]) / mean);
+    owners[id] = std::max(owners[id - 1], std::min(rank, _world_size - 1));
+  }
+  int run = 0;
+  for (int id = 0; id < _block_count; ++id) {
+    run = id > 0 && owners[id] == owners[id - 1] ? run + 1 : 1;
+    if (run > _max_local_blocks) {
+      return;
+    }
+  }
+  std::vector<MPI_Request> requests;
+  std::vector<int> leaving;
+  int moved = 0;
+  for (int id = 0; id < _block_count; ++id) {
+    if (owners[id] == _owners[id]) {
+      continue;
+    }
+    ++moved;
+    if (_owners[id] == _world_rank) {
+      BlockMesh *mesh = _blocks[id]->mesh;
+      requests.push_back(MPI_REQUEST_NULL);
+      // No halo is in flight, and messages between two ranks with the same
+      // tag arrive in order, so one tag serves every block that moves
+      MPI_Isend(mesh->get_u0(), mesh->get_node_augmented_cell_count(), MPI_DOUBLE,
+                owners[id], 0, _comm, &requests.back());
+      leaving.push_back(id);
+    } else if (owners[id] == _world_rank) {
+      create_block(id);
+      BlockMesh *mesh = _blocks[id]->mesh;
+      requests.push_back(MPI_REQUEST_NULL);
+      MPI_Irecv(mesh->get_u0(), mesh->get_node_augmented_cell_count(), MPI_DOUBLE,
+                _owners[id], 0, _comm, &requests.back());
+    }
+  }
+  if (!requests.empty()) {
+    MPI_Waitall(static_cast<int>(requests.size()), &requests[0], MPI_STATUSES_IGNORE);
+  }
+  for (size_t l = 0; l < leaving.size(); ++l) {
+    destroy_block(leaving[l]);
+  }
+  _owners = owners;
+  index_owners();
+  _local.clear();
+  for (int id = 0; id < _block_count; ++id) {
+    if (_owners[id] == _world_rank) {
+      _local.push_back(id);
+    }
+  }
+  ++_balances;
+  _migrations += moved;
+  if (_debug && _world_rank == 0) {
+    std::cout << " Balanced blocks at step " << level_ << ", imbalance " << imbalance
+              << ", moved " << moved << std::endl;
+  }
+}
+
+double BlockDriver::local_temp() const {
+  double total = 0;
+  for (size_t l = 0; l < _local.size(); ++l) {
+    BlockMesh *mesh = _blocks[_local[l]]->mesh;
+    const double *u0 = mesh->get_u0();
+    const int x_span = mesh->get_node_augmented_col_count();
+    for (int i = 1; i < mesh->get_node_core_row_count() + 1; ++i) {
+      for (int j = 1; j < mesh->get_node_core_col_count() + 1; ++j) {
+        total += u0[i * x_span + j];
+      }
+    }
+  }
+  return total;
+}
+
+void BlockDriver::run() {
+  double wall_start, wall_stop;
+  double cpu_start, cpu_stop;
+  if (_debug) {
+    std::cout << " ++ RUN BEGINNING ++ " << std::endl;
+  }
+  timers(wall_start, cpu_start); // start timing
+  int step = 0;
+  double t_now = _t_start;
+  while (t_now < _t_end) { // doublecompare
+    if (step % _output_rate == 0) {
+      if (_visualize) {
+        ScopedPhase phase(&_profiler, OUTPUT);
+        for (size_t l = 0; l < _local.size(); ++l) {
+          _blocks[_local[l]]->writer->write(step, t_now);
+        }
+      }
+      if (_debug) {
+        double temp = local_temp();
+        double global_temp = 0;
+        MPI_Reduce(&temp, &global_temp, 1, MPI_DOUBLE, MPI_SUM, 0, _comm);
+        if (_world_rank == 0) {
+          std::cout << " Outputting vtk file for step " << step << ",\n\ttnow = "
+                    << t_now << ",\n\tvis rate:" << _output_rate
+                    << "\n\ttotal temp:" << global_temp << std::endl;
+        }
+      }
+    }
+    if (_balance_interval > 0 && step > 0 && step % _balance_interval == 0) {
+      balance(step);
+    }
+    this->step(step);
+    ++step;
+    t_now += _del_t;
+  }
+  if (_visualize) {
+    ScopedPhase phase(&_profiler, OUTPUT);
+    for (size_t l = 0; l < _local.size(); ++l) {
+      _blocks[_local[l]]->writer->write(step, t_now);
+    }
+  }
+  settle(step);
+  timers(wall_stop, cpu_stop); // stop timing
+  if (_debug) {
+    std::cout << " ++ RUN FINISHING ++ " << std::endl;
+  }
+  MPI_Barrier(_comm);
+  if (_world_rank == 0) {
+    std::cout << "Timings: wallclock:" << (wall_stop - wall_start) << "s\n"
+                 "         cpu clock:" << (cpu_stop - cpu_start) << std::endl;
+  }
+  _profiler.report(_comm, std::cout);
+  if (_performance_report) {
+    if (_world_rank == 0) {
+      std::cout << "Blocks: " << _block_count << " in a " << _grid_rows << "x" << _grid_cols
+                << " grid, " << _migrations << " moved in " << _balances
+                << " rebalancing(s)" << std::endl;
+    }
+    FieldAllocator::report(_comm, std::cout);
+  }
+}
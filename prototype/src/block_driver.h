@@ -0,0 +1,94 @@
+#ifndef BLOCK_DRIVER_H
+#define BLOCK_DRIVER_H
+
+#include <mpi.h>
+#include <string>
+#include <vector>
+
+#include "config_file.h"
+#include "profiler.h"
+
+class BlockMesh;
+class Calculation;
+class Writer;
+// Runs an explicit 2D simulation over-decomposed into several blocks per
+// rank, in place of Driver when blocks_per_rank is set:
+//   blocks_per_rank          - blocks per rank; the grid of blocks is
+//                              shaped as MPI_Dims_create shapes ranks
+//   block_balance_interval   - steps between load balancing, 0 for never
+//   block_balance_threshold  - the measured imbalance (max/mean) above
+//                              which blocks move (1.1)
+// A block's ghosts come by copy from blocks on the same rank and by message
+// from others. Each step computes first the blocks whose halos are in and
+// takes the rest as their messages arrive, so one block's wait hides
+// behind another's compute. Balancing cuts the blocks, in order, into
+// runs of equal measured compute time and moves those that change rank.
+// Block b is written as rank b of the run. Message tags number a block
+// among its rank's, so they stay below MPI_TAG_UB for at most
+// (MPI_TAG_UB + 1) / 8 blocks on a rank; a balancing that would put more
+// on one rank is not done.
+class BlockDriver {
+ public:
+  BlockDriver(const ConfigFile& config_);
+  ~BlockDriver();
+  void run();
+
+ private:
+  struct Block {
+    BlockMesh *mesh;
+    Calculation *calculation;
+    Writer *writer;
+    int neighbours[4]; // block id on each side, -1 on the domain edge
+    int pending;       // halo messages of this step not yet in
+    double cost;       // compute seconds since the last balancing
+    // Edges to and from other ranks, by side and level parity
+    std::vector<double> send[4][2];
+    std::vector<double> receive[4][2];
+    MPI_Request send_request[4][2];
+  };
+  void create_block(int id_);
+  void destroy_block(int id_);
+  void step(int step_);
+  // Computes a block whose ghosts are current and passes its new edges on
+  void compute(int id_, int step_);
+  void unpack(int id_, int boundary_, int level_);
+  // Completes every message in flight, leaving u0's ghosts current
+  void settle(int level_);
+  void balance(int level_);
+  double local_temp() const;
+  int tag(int id_, int boundary_, int level_) const;
+  // The first block of every rank, as runs of blocks are owned in order
+  void index_owners();
+
+  const ConfigFile& _config;
+  bool _debug;
+  bool _visualize;
+  bool _performance_report;
+  std::string _name;
+  std::string _output_format;
+  double _compression_error_bound;
+  int _output_rate;
+  double _t_start;
+  double _t_end;
+  double _del_t;
+  int _balance_interval;
+  double _balance_threshold;
+  int _grid_rows;
+  int _grid_cols;
+  int _block_count;
+  std::vector<int> _owners;     // rank of every block
+  std::vector<int> _first;      // lowest id on every rank
+  int _max_local_blocks;        // most blocks on a rank the tags can tell apart
+  std::vector<Block*> _blocks;  // by id, null for other ranks' blocks
+  std::vector<int> _local;      // ids of this rank's blocks
+  // Receives of a level's halos, by level parity, and what each is for
+  std::vector<MPI_Request> _receives[2];
+  std::vector<int> _receive_targets[2]; // id * 4 + side
+  int _balances;
+  int _migrations;
+  Profiler _profiler;
+  MPI_Comm _comm;
+  int _world_size;
+  int _world_rank;
+};
+#endif
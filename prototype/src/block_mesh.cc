@@ -0,0 +1,142 @@
+#include "block_mesh.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "tools-inl.h"
+#include "config_file.h"
+#include "profiler.h"
+
+namespace {
+  enum Boundary {
+    TOP = 0,
+    BOTTOM = 1,
+    LEFT = 2,
+    RIGHT = 3,
+  };
+}
+
+BlockMesh::BlockMesh(const ConfigFile& config_, int row_, int col_,
+                     int grid_rows_, int grid_cols_) : Mesh(config_) {
+  if (get_dimension_count() == 3 || is_single_buffer()) {
+    throw std::logic_error("Blocks are 2D with two buffers");
+  }
+  // Spans and origins as StaticMesh gives a rank of a grid this shape
+  _node_core_row_count = calculate_local_span(row_, grid_rows_, get_world_core_row_count());
+  _node_core_col_count = calculate_local_span(col_, grid_cols_, get_world_core_col_count());
+  _core_origin_y = get_del_y() * calculate_local_offset(row_, grid_rows_,
+                                                        get_world_core_row_count());
+  _core_origin_x = get_del_x() * calculate_local_offset(col_, grid_cols_,
+                                                        get_world_core_col_count());
+  _domain_edge[TOP] = row_ == 0;
+  _domain_edge[BOTTOM] = row_ == grid_rows_ - 1;
+  _domain_edge[LEFT] = col_ == 0;
+  _domain_edge[RIGHT] = col_ == grid_cols_ - 1;
+  _u0 = _field_allocator.allocate(get_node_augmented_cell_count());
+  _u1 = _field_allocator.allocate(get_node_augmented_cell_count());
+}
+
+BlockMesh::~BlockMesh() {
+  _field_allocator.release(_u0);
+  _field_allocator.release(_u1);
+}
+
+bool BlockMesh::is_domain_edge(int boundary_) const {
+  return _domain_edge[boundary_];
+}
+
+void BlockMesh::advance() {
+  {
+    ScopedPhase phase(_profiler, REFLECT);
+    for (int boundary = TOP; boundary <= RIGHT; ++boundary) {
+      if (_domain_edge[boundary]) {
+        reflect_field(boundary, _u1);
+      }
+    }
+  }
+  std::swap(_u0, _u1);
+}
+
+void BlockMesh::reflect_boundary(int boundary_) {
+  reflect_field(boundary_, _u1);
+}
+
+void BlockMesh::reflect_field(int boundary_, double *field_) {
+  const int x_span = get_node_augmented_col_count();
+  const int rows = _node_core_row_count;
+  const int cols = _node_core_col_count;
+  switch (boundary_) {
+    case (TOP):
+      std::copy(&field_[x_span + 1], &field_[x_span + 1 + cols], &field_[1]);
+      break;
+    case (BOTTOM):
+      std::copy(&field_[rows * x_span + 1], &field_[rows * x_span + 1 + cols],
+                &field_[(rows + 1) * x_span + 1]);
+      break;
+    case (LEFT):
+      for (int i = 1; i < rows + 1; ++i) {
+        field_[i * x_span] = field_[i * x_span + 1];
+      }
+      break;
+    case (RIGHT):
+      for (int i = 1; i < rows + 1; ++i) {
+        field_[i * x_span + cols + 1] = field_[i * x_span + cols];
+      }
+      break;
+  }
+}
+
+void BlockMesh::update_halo(double *field_) {
+  throw std::logic_error("A block's halo is filled by BlockDriver");
+}
+
+double * BlockMesh::get_u0() { return _u0; }
+double * BlockMesh::get_u1() { return _u1; }
+
+double BlockMesh::get_x_coord(int j_) const {
+  return _core_origin_x + (j_ - 1) * get_del_x();
+}
+
+double BlockMesh::get_y_coord(int i_) const {
+  return _core_origin_y + (i_ - 1) * get_del_y();
+}
+
+int BlockMesh::get_node_core_row_count() const {
+  return _node_core_row_count;
+}
+
+int BlockMesh::get_node_core_col_count() const {
+  return _node_core_col_count;
+}
+
+int BlockMesh::get_node_augmented_row_count() const {
+  return _node_core_row_count + 2;
+}
+
+int BlockMesh::get_node_augmented_col_count() const {
+  return _node_core_col_count + 2;
+}
+
+int BlockMesh::get_node_core_cell_count() const {
+  return get_node_core_row_count() * get_node_core_col_count();
+}
+
+int BlockMesh::get_node_augmented_cell_count() const {
+  return get_node_augmented_row_count() * get_node_augmented_col_count();
+}
+
+int BlockMesh::get_current_row_offset() const {
+  return 1;
+}
+
+int BlockMesh::get_current_col_offset() const {
+  return 1;
+}
+
+int BlockMesh::get_previous_row_offset() const {
+  return 1;
+}
+
+int BlockMesh::get_previous_col_offset() const {
+  return 1;
+}
@@ -0,0 +1,43 @@
+#ifndef BLOCK_MESH_H
+#define BLOCK_MESH_H
+#include "mesh.h"
+class ConfigFile;
+// One block of a grid of blocks over a 2D domain, several of which may
+// live on a rank (see BlockDriver). advance() reflects only the sides on
+// the edge of the domain; the driver fills the others' ghosts, by copy
+// from a block on the same rank or by message from another.
+class BlockMesh : public Mesh {
+ public:
+  BlockMesh(const ConfigFile& config_, int row_, int col_, int grid_rows_, int grid_cols_);
+  virtual ~BlockMesh();
+  void advance();
+  void reflect_boundary(int boundary_);
+  void update_halo(double *field_);
+  // Whether a side (StaticMesh's Boundary numbering) is on the domain edge
+  bool is_domain_edge(int boundary_) const;
+  double * get_u0();
+  double * get_u1();
+  double get_x_coord(int j_) const;
+  double get_y_coord(int i_) const;
+  int get_node_core_row_count() const;
+  int get_node_core_col_count() const;
+  int get_node_augmented_row_count() const;
+  int get_node_augmented_col_count() const;
+  int get_node_core_cell_count() const;
+  int get_node_augmented_cell_count() const;
+  int get_current_row_offset() const;
+  int get_current_col_offset() const;
+  int get_previous_row_offset() const;
+  int get_previous_col_offset() const;
+
+ private:
+  void reflect_field(int boundary_, double *field_);
+  double *_u0;
+  double *_u1;
+  int _node_core_row_count;
+  int _node_core_col_count;
+  double _core_origin_x;
+  double _core_origin_y;
+  bool _domain_edge[4];
+};
+#endif
@@ -1,15 +1,190 @@
 #include "calculation.h"
 
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
 #include "config_file.h"
 #include "mesh.h"
+#include "distributed_mesh.h"
+#include "profiler.h"
+#include "implicit_solver.h"
+#include "multigrid.h"
+#include "pipelined_cg.h"
+#include "data_source.h"
 
 Calculation::Calculation(const ConfigFile& config_, Mesh *mesh_)
-                        : _config(config_), _mesh(mesh_) {}
+                        : _config(config_), _mesh(mesh_), _profiler(0), _solver(0),
+                          _rkl2_coefficient_stages(0), _last_sweeps(0),
+                          _field_allocator(config_), _face_x(0), _face_y(0) {
+  _scheme = _config.get_or_default("scheme", std::string("explicit"));
+  _theta = _config.get_or_default("implicit_theta", 1.0);
+  _diffusivity = _config.get_or_default("diffusivity", 1.0);
+  if (!(_diffusivity > 0)) {
+    throw std::logic_error("diffusivity must be positive");
+  }
+  _rkl2_stages = _config.get_or_default("rkl2_stages", 0);
+  _active_tiles = _config.get_or_default("active_tiles", false);
+  _tile_size = _config.get_or_default("active_tile_size", 32);
+  _active_threshold = _config.get_or_default("active_threshold", 0.0);
+  if (_scheme != "explicit"
+      && _config.get_or_default("mesh_type", std::string("static")) == "dynamic") {
+    std::stringstream ss;
+    ss << "Scheme " << _scheme << " needs a static mesh" << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  if (_scheme != "explicit" && _mesh->get_dimension_count() == 3) {
+    std::stringstream ss;
+    ss << "Scheme " << _scheme << " is not supported on 3D domains" << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  _conductive = !_config.get_line_or_default("conductivity", "").empty()
+      || !_config.get_line_or_default("conductivity_field", "").empty()
+      || !_config.get_line_or_default("conductivity_subregions", "").empty();
+  if (_conductive) {
+    if (_scheme != "explicit" || _mesh->get_dimension_count() == 3
+        || _mesh->is_single_buffer() || _active_tiles
+        || _config.get_or_default("mesh_type", std::string("static")) == "dynamic") {
+      throw std::logic_error("Variable conductivity needs the explicit scheme on a 2D "
+                             "static mesh with two buffers, without active_tiles");
+    }
+    setup_conductivity();
+  }
+  if (_active_tiles) {
+    if (_scheme != "explicit" || _mesh->get_dimension_count() == 3
+        || _mesh->is_single_buffer()
+        || _config.get_or_default("mesh_type", std::string("static")) == "dynamic") {
+      throw std::logic_error("active_tiles needs the explicit scheme on a 2D static mesh "
+                             "with two buffers");
+    }
+    if (_tile_size < 1) {
+      throw std::logic_error("active_tile_size must be positive");
+    }
+    _tile_rows = (_mesh->get_node_core_row_count() + _tile_size - 1) / _tile_size;
+    _tile_cols = (_mesh->get_node_core_col_count() + _tile_size - 1) / _tile_size;
+    // Nothing is known about the initial field, so the first step sweeps it all
+    _tile_change.assign(_tile_rows * _tile_cols, HUGE_VAL);
+    _next_tile_change.assign(_tile_rows * _tile_cols, 0.0);
+  }
+  if (_mesh->is_single_buffer()) {
+    if (_scheme == "rkl2") {
+      // The stages read u0 until the last one lands in u1
+      throw std::logic_error("Scheme rkl2 needs two buffers, not single_buffer");
+    }
+    int saved = _mesh->get_node_augmented_col_count();
+    if (_mesh->get_dimension_count() == 3) {
+      saved *= _mesh->get_node_augmented_row_count();
+    }
+    _saved.resize(2 * saved, 0.0);
+  }
+  if (_scheme == "implicit") {
+    if (_theta < 0.5 || _theta > 1.0) {
+      throw std::logic_error("implicit_theta must be between 0.5 and 1");
+    }
+    std::string solver = _config.get_or_default("implicit_solver", std::string("multigrid"));
+    if (solver == "multigrid") {
+      _solver = new Multigrid(_config, _mesh);
+    } else if (solver == "cg") {
+      _solver = new PipelinedCg(_config, _mesh);
+    } else {
+      std::stringstream ss;
+      ss << "Unknown implicit solver: " << solver << std::endl;
+      throw std::logic_error(ss.str());
+    }
+    _rhs.resize(_mesh->get_node_augmented_cell_count(), 0.0);
+  } else if (_scheme == "rkl2") {
+    if (_rkl2_stages == 1 || _rkl2_stages < 0) {
+      throw std::logic_error("rkl2_stages must be 0 (automatic) or at least 2");
+    }
+    const int cells = _mesh->get_node_augmented_cell_count();
+    _stage_a.resize(cells, 0.0);
+    _stage_b.resize(cells, 0.0);
+    _laplacian_u0.resize(cells, 0.0);
+  } else if (_scheme != "explicit") {
+    std::stringstream ss;
+    ss << "Unknown scheme: " << _scheme << std::endl;
+    throw std::logic_error(ss.str());
+  }
+}
 
-Calculation::~Calculation() {}
+Calculation::~Calculation() {
+  delete _solver;
+  if (_conductive) {
+    _field_allocator.release(_face_x);
+    _field_allocator.release(_face_y);
+  }
+}
+
+void Calculation::setup_conductivity() {
+  // The conductivity is populated as an initial field would be
+  ConfigFile source(_config);
+  source.set("initial_value", _config.get_line_or_default("conductivity", "1"));
+  source.set("initial_field", _config.get_line_or_default("conductivity_field", ""));
+  source.set("subregions", _config.get_line_or_default("conductivity_subregions", ""));
+  source.set("subregion_values", _config.get_line_or_default("conductivity_values", "1"));
+  const int cells = _mesh->get_node_augmented_cell_count();
+  const int x_span = _mesh->get_node_augmented_col_count();
+  double *conductivity = _field_allocator.allocate(cells);
+  DataSource ds(source);
+  ds.populate_field(_mesh, conductivity);
+  // It never changes, so its halo is exchanged here once
+  _mesh->update_halo(conductivity);
+  for (int c = 0; c < cells; ++c) {
+    if (!(conductivity[c] >= 0)) {
+      _field_allocator.release(conductivity);
+      throw std::logic_error("Conductivity must not be negative");
+    }
+  }
+  _face_x = _field_allocator.allocate(cells);
+  _face_y = _field_allocator.allocate(cells);
+  for (int c = 0; c < cells; ++c) {
+    const double k = conductivity[c];
+    const double right = c + 1 < cells ? conductivity[c + 1] : k;
+    const double below = c + x_span < cells ? conductivity[c + x_span] : k;
+    // Harmonic means, so an insulating cell blocks the face
+    _face_x[c] = k + right > 0 ? 2.0 * k * right / (k + right) : 0.0;
+    _face_y[c] = k + below > 0 ? 2.0 * k * below / (k + below) : 0.0;
+  }
+  _field_allocator.release(conductivity);
+}
+
+void Calculation::set_profiler(Profiler *profiler_) {
+  _profiler = profiler_;
+  if (_solver) {
+    _solver->set_profiler(profiler_);
+  }
+}
+
+double Calculation::get_last_sweeps() const {
+  return _last_sweeps;
+}
 
 void Calculation::step(double dt_) {
-  diffuse(dt_);
+  _last_sweeps = 1;
+  // The kernels solve u_t = u_xx + u_yy, a diffusivity rescales time as
+  // an ensemble member's stencil does
+  const double dt = _diffusivity * dt_;
+  if (_solver) {
+    diffuse_implicit(dt);
+  } else if (_scheme == "rkl2") {
+    diffuse_rkl2(dt);
+  } else if (_mesh->get_dimension_count() == 3) {
+    if (_mesh->is_single_buffer()) {
+      diffuse_3d_in_place(dt);
+    } else {
+      diffuse_3d(dt);
+    }
+  } else if (_mesh->is_single_buffer()) {
+    diffuse_in_place(dt);
+  } else if (_active_tiles) {
+    diffuse_active(dt);
+  } else if (_conductive) {
+    diffuse_conductive(dt);
+  } else {
+    diffuse(dt);
+  }
 }
 
 void Calculation::diffuse(double dt_) {
@@ -20,19 +195,335 @@ void Calculation::diffuse(double dt_) {
   const double rx = dt_ / (dx * dx);
   const double ry = dt_ / (dy * dy);
   const int x_span = _mesh->get_node_augmented_col_count();
+  const int step_rows = _mesh->get_step_row_count();
+  const int core_cols = _mesh->get_node_core_col_count();
+  const int i_offset = _mesh->get_step_row_offset();
+  const int j_offset = _mesh->get_current_col_offset();
+  for (int i = i_offset; i < step_rows + i_offset; ++i) {
+    for (int j = j_offset; j < core_cols + j_offset; ++j) {
+      const int center = i * x_span + j;
+      const int top = (i - 1) * x_span + j;
+      const int bottom = (i + 1) * x_span + j;
+      const int left = i * x_span + (j - 1);
+      const int right = i * x_span + (j + 1);
+      u1[center] = (1.0 - 2.0*rx - 2.0*ry) *u0[center] + rx * u0[left]
+                         + rx * u0[right] + ry * u0[top] + ry * u0[bottom];
+    }
+  }
+}
+
+void Calculation::diffuse_conductive(double dt_) {
+  double *u0 = _mesh->get_u0();
+  double *u1 = _mesh->get_u1();
+  const double dx = _mesh->get_del_x();
+  const double dy = _mesh->get_del_y();
+  const double rx = dt_ / (dx * dx);
+  const double ry = dt_ / (dy * dy);
+  const double *face_x = _face_x;
+  const double *face_y = _face_y;
+  const int x_span = _mesh->get_node_augmented_col_count();
   const int core_rows = _mesh->get_node_core_row_count();
   const int core_cols = _mesh->get_node_core_col_count();
   const int i_offset = _mesh->get_current_row_offset();
   const int j_offset = _mesh->get_current_col_offset();
   for (int i = i_offset; i < core_rows + i_offset; ++i) {
+    const int row = i * x_span;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
     for (int j = j_offset; j < core_cols + j_offset; ++j) {
+      const int center = row + j;
+      const double u = u0[center];
+      u1[center] = u + rx * (face_x[center - 1] * (u0[center - 1] - u)
+                             + face_x[center] * (u0[center + 1] - u))
+                     + ry * (face_y[center - x_span] * (u0[center - x_span] - u)
+                             + face_y[center] * (u0[center + x_span] - u));
+    }
+  }
+}
+
+void Calculation::diffuse_active(double dt_) {
+  double *u0 = _mesh->get_u0();
+  double *u1 = _mesh->get_u1();
+  const double dx = _mesh->get_del_x();
+  const double dy = _mesh->get_del_y();
+  const double rx = dt_ / (dx * dx);
+  const double ry = dt_ / (dy * dy);
+  const int x_span = _mesh->get_node_augmented_col_count();
+  const int core_rows = _mesh->get_node_core_row_count();
+  const int core_cols = _mesh->get_node_core_col_count();
+  const double threshold = _active_threshold;
+  const bool halo_top = _mesh->is_halo_changed(TOP);
+  const bool halo_bottom = _mesh->is_halo_changed(BOTTOM);
+  const bool halo_left = _mesh->is_halo_changed(LEFT);
+  const bool halo_right = _mesh->is_halo_changed(RIGHT);
+  long computed = 0;
+  for (int ti = 0; ti < _tile_rows; ++ti) {
+    for (int tj = 0; tj < _tile_cols; ++tj) {
+      const int tile = ti * _tile_cols + tj;
+      // The 5 point stencil reads this tile and the edges of its 4 neighbours
+      const bool active = _tile_change[tile] > threshold
+          || (ti > 0 ? _tile_change[tile - _tile_cols] > threshold : halo_top)
+          || (ti < _tile_rows - 1 ? _tile_change[tile + _tile_cols] > threshold : halo_bottom)
+          || (tj > 0 ? _tile_change[tile - 1] > threshold : halo_left)
+          || (tj < _tile_cols - 1 ? _tile_change[tile + 1] > threshold : halo_right);
+      const int i_begin = 1 + ti * _tile_size;
+      const int i_end = std::min(i_begin + _tile_size, core_rows + 1);
+      const int j_begin = 1 + tj * _tile_size;
+      const int j_end = std::min(j_begin + _tile_size, core_cols + 1);
+      double change = 0;
+      if (active) {
+        for (int i = i_begin; i < i_end; ++i) {
+          for (int j = j_begin; j < j_end; ++j) {
+            const int center = i * x_span + j;
+            const int top = (i - 1) * x_span + j;
+            const int bottom = (i + 1) * x_span + j;
+            const int left = i * x_span + (j - 1);
+            const int right = i * x_span + (j + 1);
+            u1[center] = (1.0 - 2.0*rx - 2.0*ry) *u0[center] + rx * u0[left]
+                               + rx * u0[right] + ry * u0[top] + ry * u0[bottom];
+            change = std::max(change, std::fabs(u1[center] - u0[center]));
+          }
+        }
+        ++computed;
+      } else if (_tile_change[tile] != 0) {
+        // u1 still holds the step before last, freeze the tile at u0
+        for (int i = i_begin; i < i_end; ++i) {
+          std::copy(&u0[i * x_span + j_begin], &u0[i * x_span + j_end], &u1[i * x_span + j_begin]);
+        }
+      }
+      _next_tile_change[tile] = change;
+    }
+  }
+  _tile_change.swap(_next_tile_change);
+  if (_profiler) {
+    _profiler->count_tiles(computed, _tile_rows * _tile_cols);
+  }
+}
+
+void Calculation::diffuse_in_place(double dt_) {
+  double *u = _mesh->get_u0();
+  const double dx = _mesh->get_del_x();
+  const double dy = _mesh->get_del_y();
+  const double rx = dt_ / (dx * dx);
+  const double ry = dt_ / (dy * dy);
+  const int x_span = _mesh->get_node_augmented_col_count();
+  const int core_rows = _mesh->get_node_core_row_count();
+  const int core_cols = _mesh->get_node_core_col_count();
+  // The ghost row above the first is never written, so it needs no copy
+  const double *above = u;
+  double *current = &_saved[0];
+  double *spare = &_saved[x_span];
+  for (int i = 1; i < core_rows + 1; ++i) {
+    double *row = &u[i * x_span];
+    const double *below = &u[(i + 1) * x_span];
+    std::copy(row, row + x_span, current);
+    for (int j = 1; j < core_cols + 1; ++j) {
+      row[j] = (1.0 - 2.0*rx - 2.0*ry) *current[j] + rx * current[j - 1]
+               + rx * current[j + 1] + ry * above[j] + ry * below[j];
+    }
+    above = current;
+    std::swap(current, spare);
+  }
+}
+
+void Calculation::diffuse_3d(double dt_) {
+  double *u0 = _mesh->get_u0();
+  double *u1 = _mesh->get_u1();
+  const double dx = _mesh->get_del_x();
+  const double dy = _mesh->get_del_y();
+  const double dz = _mesh->get_del_z();
+  const double rx = dt_ / (dx * dx);
+  const double ry = dt_ / (dy * dy);
+  const double rz = dt_ / (dz * dz);
+  const int x_span = _mesh->get_node_augmented_col_count();
+  const int plane = _mesh->get_node_augmented_row_count() * x_span;
+  const int core_layers = _mesh->get_node_core_layer_count();
+  const int core_rows = _mesh->get_node_core_row_count();
+  const int core_cols = _mesh->get_node_core_col_count();
+  for (int k = 1; k < core_layers + 1; ++k) {
+    for (int i = 1; i < core_rows + 1; ++i) {
+      for (int j = 1; j < core_cols + 1; ++j) {
+        const int center = k * plane + i * x_span + j;
+        u1[center] = (1.0 - 2.0*rx - 2.0*ry - 2.0*rz) * u0[center]
+                     + rx * (u0[center - 1] + u0[center + 1])
+                     + ry * (u0[center - x_span] + u0[center + x_span])
+                     + rz * (u0[center - plane] + u0[center + plane]);
+      }
+    }
+  }
+}
+
+void Calculation::diffuse_3d_in_place(double dt_) {
+  double *u = _mesh->get_u0();
+  const double dx = _mesh->get_del_x();
+  const double dy = _mesh->get_del_y();
+  const double dz = _mesh->get_del_z();
+  const double rx = dt_ / (dx * dx);
+  const double ry = dt_ / (dy * dy);
+  const double rz = dt_ / (dz * dz);
+  const int x_span = _mesh->get_node_augmented_col_count();
+  const int plane = _mesh->get_node_augmented_row_count() * x_span;
+  const int core_layers = _mesh->get_node_core_layer_count();
+  const int core_rows = _mesh->get_node_core_row_count();
+  const int core_cols = _mesh->get_node_core_col_count();
+  // As diffuse_in_place, with layers in place of rows
+  const double *front = u;
+  double *current = &_saved[0];
+  double *spare = &_saved[plane];
+  for (int k = 1; k < core_layers + 1; ++k) {
+    double *layer = &u[k * plane];
+    const double *back = &u[(k + 1) * plane];
+    std::copy(layer, layer + plane, current);
+    for (int i = 1; i < core_rows + 1; ++i) {
+      for (int j = 1; j < core_cols + 1; ++j) {
+        const int center = i * x_span + j;
+        layer[center] = (1.0 - 2.0*rx - 2.0*ry - 2.0*rz) * current[center]
+                        + rx * (current[center - 1] + current[center + 1])
+                        + ry * (current[center - x_span] + current[center + x_span])
+                        + rz * (front[center] + back[center]);
+      }
+    }
+    front = current;
+    std::swap(current, spare);
+  }
+}
+
+void Calculation::diffuse_implicit(double dt_) {
+  double *u0 = _mesh->get_u0();
+  double *u1 = _mesh->get_u1();
+  const double dx = _mesh->get_del_x();
+  const double dy = _mesh->get_del_y();
+  const double rx = (1.0 - _theta) * dt_ / (dx * dx);
+  const double ry = (1.0 - _theta) * dt_ / (dy * dy);
+  const int x_span = _mesh->get_node_augmented_col_count();
+  const int core_rows = _mesh->get_node_core_row_count();
+  const int core_cols = _mesh->get_node_core_col_count();
+  // The explicit part of the step needs u0's neighbours
+  if (_theta < 1.0) {
+    _mesh->update_halo(u0);
+  }
+  for (int i = 1; i < core_rows + 1; ++i) {
+    for (int j = 1; j < core_cols + 1; ++j) {
       const int center = i * x_span + j;
       const int top = (i - 1) * x_span + j;
       const int bottom = (i + 1) * x_span + j;
       const int left = i * x_span + (j - 1);
       const int right = i * x_span + (j + 1);
-      u1[center] = (1.0 - 2.0*rx - 2.0*ry) *u0[center] + rx * u0[left]
-                         + rx * u0[right] + ry * u0[top] + ry * u0[bottom];
+      _rhs[center] = (1.0 - 2.0*rx - 2.0*ry) *u0[center] + rx * u0[left]
+                     + rx * u0[right] + ry * u0[top] + ry * u0[bottom];
+    }
+  }
+  // Start from the previous solution, already in place with single_buffer
+  if (u1 != u0) {
+    std::copy(u0, u0 + _mesh->get_node_augmented_cell_count(), u1);
+  }
+  _solver->solve(_theta * dt_, &_rhs[0], u1);
+  _last_sweeps = (_theta < 1.0 ? 1.0 : 0.0) + _solver->get_last_sweeps();
+}
+
+int Calculation::rkl2_stage_count(double dt_) const {
+  if (_rkl2_stages > 0) {
+    return _rkl2_stages;
+  }
+  // Stable while dt <= dt_explicit * (s^2 + s - 2) / 4
+  const double dx = _mesh->get_del_x();
+  const double dy = _mesh->get_del_y();
+  const double dt_explicit = 1.0 / (2.0 / (dx * dx) + 2.0 / (dy * dy));
+  const double ratio = dt_ / dt_explicit;
+  int stages = static_cast<int>(std::ceil((-1.0 + std::sqrt(9.0 + 16.0 * ratio)) / 2.0));
+  while (stages * stages + stages - 2 < 4.0 * ratio) {
+    ++stages; // guard the rounding of the square root
+  }
+  return std::max(stages, 2);
+}
+
+void Calculation::laplacian(const double *in_, double dt_, double *out_) const {
+  const double dx = _mesh->get_del_x();
+  const double dy = _mesh->get_del_y();
+  const double rx = dt_ / (dx * dx);
+  const double ry = dt_ / (dy * dy);
+  const int x_span = _mesh->get_node_augmented_col_count();
+  const int core_rows = _mesh->get_node_core_row_count();
+  const int core_cols = _mesh->get_node_core_col_count();
+  for (int i = 1; i < core_rows + 1; ++i) {
+    for (int j = 1; j < core_cols + 1; ++j) {
+      const int center = i * x_span + j;
+      const int top = (i - 1) * x_span + j;
+      const int bottom = (i + 1) * x_span + j;
+      const int left = i * x_span + (j - 1);
+      const int right = i * x_span + (j + 1);
+      out_[center] = (-2.0*rx - 2.0*ry) * in_[center] + rx * in_[left]
+                     + rx * in_[right] + ry * in_[top] + ry * in_[bottom];
+    }
+  }
+}
+
+void Calculation::setup_rkl2_coefficients(int s_) {
+  const double w1 = 4.0 / (s_ * s_ + s_ - 2.0);
+  std::vector<double> b(s_ + 1);
+  for (int j = 0; j <= s_; ++j) {
+    b[j] = j < 2 ? 1.0 / 3.0 : (j * j + j - 2.0) / (2.0 * j * (j + 1.0));
+  }
+  _rkl2_mu.assign(s_ + 1, 0.0);
+  _rkl2_nu.assign(s_ + 1, 0.0);
+  _rkl2_mu_tilde.assign(s_ + 1, 0.0);
+  _rkl2_gamma_tilde.assign(s_ + 1, 0.0);
+  _rkl2_mu_tilde[1] = b[1] * w1;
+  for (int stage = 2; stage <= s_; ++stage) {
+    _rkl2_mu[stage] = (2.0 * stage - 1.0) / stage * b[stage] / b[stage - 1];
+    _rkl2_nu[stage] = -(stage - 1.0) / stage * b[stage] / b[stage - 2];
+    _rkl2_mu_tilde[stage] = _rkl2_mu[stage] * w1;
+    _rkl2_gamma_tilde[stage] = -(1.0 - b[stage - 1]) * _rkl2_mu_tilde[stage];
+  }
+  _rkl2_coefficient_stages = s_;
+}
+
+void Calculation::diffuse_rkl2(double dt_) {
+  // Meyer, Balsara and Aslam (2014): s stages, each one stencil sweep and
+  // one halo update, stable for s^2 + s - 2 >= 4 dt / dt_explicit
+  const int s = rkl2_stage_count(dt_);
+  if (s != _rkl2_coefficient_stages) {
+    setup_rkl2_coefficients(s);
+  }
+  _last_sweeps = s;
+  double *u0 = _mesh->get_u0();
+  double *u1 = _mesh->get_u1();
+  const int x_span = _mesh->get_node_augmented_col_count();
+  const int core_rows = _mesh->get_node_core_row_count();
+  const int core_cols = _mesh->get_node_core_col_count();
+  double *l0 = &_laplacian_u0[0];
+  _mesh->update_halo(u0);
+  laplacian(u0, dt_, l0);
+  // Stage 1, the stages then rotate through three buffers ending in u1
+  double *buffers[3] = {u1, &_stage_a[0], &_stage_b[0]};
+  double *previous2 = u0;
+  double *previous = buffers[(s - 1) % 3];
+  const double mu_tilde1 = _rkl2_mu_tilde[1];
+  for (int i = 1; i < core_rows + 1; ++i) {
+    for (int j = 1; j < core_cols + 1; ++j) {
+      const int center = i * x_span + j;
+      previous[center] = u0[center] + mu_tilde1 * l0[center];
+    }
+  }
+  for (int stage = 2; stage <= s; ++stage) {
+    double *current = buffers[(s - stage) % 3];
+    const double mu = _rkl2_mu[stage];
+    const double nu = _rkl2_nu[stage];
+    const double mu_tilde = _rkl2_mu_tilde[stage];
+    const double gamma_tilde = _rkl2_gamma_tilde[stage];
+    _mesh->update_halo(previous);
+    // current doubles as scratch for dt * L(previous)
+    laplacian(previous, dt_, current);
+    for (int i = 1; i < core_rows + 1; ++i) {
+      for (int j = 1; j < core_cols + 1; ++j) {
+        const int center = i * x_span + j;
+        current[center] = mu * previous[center] + nu * previous2[center]
+                          + (1.0 - mu - nu) * u0[center]
+                          + mu_tilde * current[center] + gamma_tilde * l0[center];
+      }
     }
+    previous2 = previous;
+    previous = current;
   }
 }
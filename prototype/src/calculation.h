@@ -1,15 +1,92 @@
 #ifndef CALCULATION_H
 #define CALCULATION_H
+
+#include <string>
+#include <vector>
+
+#include "field_allocator.h"
+
 class ConfigFile;
 class Mesh;
+class ImplicitSolver;
+class Profiler;
+// Advances the mesh's u0 into u1 by scheme (explicit, implicit or rkl2),
+// for u_t = diffusivity * (u_xx + u_yy), diffusivity 1 unless set.
+// The explicit 2D scheme takes a spatially varying conductivity when any of
+//   conductivity            - the value under any field or boxes (1)
+//   conductivity_field      - raw doubles, as initial_field
+//   conductivity_subregions - boxes, as subregions
+//   conductivity_values     - one per box, the last repeating (1)
+// is set. It needs the explicit scheme on a 2D static mesh with two
+// buffers, and dt small enough for the largest conductivity.
 class Calculation {
  public:
   Calculation(const ConfigFile& config_, Mesh *mesh_);
   ~Calculation();
   void step(double dt_);
+  // Active tile counts go to profiler_ when one is set
+  void set_profiler(Profiler *profiler_);
+  // Stencil sweeps over this rank's core the last step made: 1 for the
+  // explicit scheme, one per stage for rkl2 and, for implicit, the explicit
+  // part plus the solver's fine grid equivalent sweeps. Cell update rates
+  // count cells times these
+  double get_last_sweeps() const;
  private:
   void diffuse(double dt_);
+  // 7-point stencil over the layers of a 3D mesh
+  void diffuse_3d(double dt_);
+  // Single buffer versions: the old values a row (layer) still needs once
+  // it is overwritten are kept in _saved, bitwise the same as diffuse(_3d)
+  void diffuse_in_place(double dt_);
+  void diffuse_3d_in_place(double dt_);
+  // diffuse() by tiles, skipping those whose inputs moved by no more than
+  // _active_threshold last step; with a threshold of 0 this is exact
+  void diffuse_active(double dt_);
+  // diffuse() in flux form through the precomputed face conductivities
+  void diffuse_conductive(double dt_);
+  void setup_conductivity();
+  // theta scheme, theta 1 is backward Euler and 0.5 Crank-Nicolson
+  void diffuse_implicit(double dt_);
+  // Runge-Kutta-Legendre super time step, second order
+  void diffuse_rkl2(double dt_);
+  int rkl2_stage_count(double dt_) const;
+  // The per stage weights of an s_ stage step, kept until s changes
+  void setup_rkl2_coefficients(int s_);
+  // dt_ * (d2u/dx2 + d2u/dy2) of in_ into out_, in_'s halo must be current
+  void laplacian(const double *in_, double dt_, double *out_) const;
   const ConfigFile& _config;
   Mesh * const _mesh;
+  Profiler *_profiler;
+  std::string _scheme;
+  double _theta;
+  double _diffusivity;
+  ImplicitSolver *_solver;
+  std::vector<double> _rhs;
+  int _rkl2_stages; // 0 picks the fewest stable stages each step
+  std::vector<double> _stage_a;
+  std::vector<double> _stage_b;
+  std::vector<double> _laplacian_u0;
+  int _rkl2_coefficient_stages; // s the weights below are for, 0 before any
+  std::vector<double> _rkl2_mu; // by stage, stage 1 only has a mu_tilde
+  std::vector<double> _rkl2_nu;
+  std::vector<double> _rkl2_mu_tilde;
+  std::vector<double> _rkl2_gamma_tilde;
+  double _last_sweeps;
+  std::vector<double> _saved; // two rows, or two layers in 3D
+  bool _active_tiles;
+  int _tile_size;
+  double _active_threshold;
+  int _tile_rows; // tiles down this rank's block
+  int _tile_cols; // tiles across
+  // Largest |u1 - u0| of each tile in the last step, and the one being made
+  std::vector<double> _tile_change;
+  std::vector<double> _next_tile_change;
+  bool _conductive;
+  FieldAllocator _field_allocator;
+  // Harmonic mean conductivity of the face between augmented cell c and
+  // c + 1 (_face_x) or c + augmented columns (_face_y), one array each so
+  // a row of faces is contiguous like the row of u0 it couples
+  double *_face_x;
+  double *_face_y;
 };
 #endif
@@ -0,0 +1,68 @@
+#include "compressed_writer.h"
+
+#include <sstream>
+#include <fstream>
+#include <stdexcept>
+
+#include "mesh.h"
+
+CompressedWriter::CompressedWriter(std::string basename_,
+                                   Mesh* mesh_,
+                                   int world_rank_,
+                                   int world_size_,
+                                   double error_bound_) :
+    _dump_basename(basename_),
+    _mesh(mesh_),
+    _world_rank(world_rank_),
+    _world_size(world_size_),
+    _codec(error_bound_) {
+  if (_mesh->get_dimension_count() == 3) {
+    throw std::logic_error("Compressed output does not support 3D domains");
+  }
+  if (_world_rank == 0) {
+    std::ofstream ofs;
+    std::stringstream fname;
+    fname << _dump_basename << ".dqzlist";
+    std::string file_name = fname.str();
+    ofs.open(file_name.c_str());
+    ofs << "!NBLOCKS " << _world_size << std::endl;
+    ofs.close();
+  }
+}
+
+void CompressedWriter::write(int step, double time) {
+  if (_world_rank == 0) {
+    std::ofstream ofs;
+    std::stringstream fname;
+    fname << _dump_basename << ".dqzlist";
+    std::string file_name = fname.str();
+    ofs.open(file_name.c_str(), std::ofstream::out | std::ofstream::app);
+    for (int rank = 0; rank < _world_size; ++rank) {
+      ofs << _dump_basename << "." << step << "." << rank << ".dqz" << std::endl;
+    }
+    ofs.close();
+  }
+  const int row_offset = _mesh->get_current_row_offset();
+  const int col_offset = _mesh->get_current_col_offset();
+  const int x_span = _mesh->get_node_augmented_col_count();
+  FieldHeader header;
+  header.step = step;
+  header.rank = _world_rank;
+  header.rows = _mesh->get_node_core_row_count();
+  header.cols = _mesh->get_node_core_col_count();
+  header.time = time;
+  header.origin_x = _mesh->get_x_coord(col_offset);
+  header.origin_y = _mesh->get_y_coord(row_offset);
+  header.del_x = _mesh->get_del_x();
+  header.del_y = _mesh->get_del_y();
+  header.error_bound = _codec.get_error_bound();
+  // Every rank encodes and writes its own block, so this runs in parallel
+  _codec.encode(&_mesh->get_u0()[row_offset * x_span + col_offset],
+                header.rows,
+                header.cols,
+                x_span,
+                _payload);
+  std::stringstream fname;
+  fname << _dump_basename << "." << step << "." << _world_rank << ".dqz";
+  FieldCodec::write_file(fname.str(), header, _payload);
+}
@@ -0,0 +1,31 @@
+#ifndef COMPRESSED_WRITER_H
+#define COMPRESSED_WRITER_H
+
+#include <string>
+#include <vector>
+
+#include "writer.h"
+#include "field_codec.h"
+
+class Mesh;
+// Writes each rank's core cells through a FieldCodec to <basename>.<step>.<rank>.dqz
+// Rank 0 keeps <basename>.dqzlist, the analogue of the VisIt .visit index.
+// Use deqn-decode to turn the dumps back into .vtk files.
+class CompressedWriter : public Writer {
+ public:
+  CompressedWriter(std::string basename_,
+                   Mesh* mesh_,
+                   int world_rank_,
+                   int world_size_,
+                   double error_bound_);
+  void write(int step, double time);
+
+ private:
+  std::string _dump_basename;
+  Mesh* _mesh;
+  int _world_rank;
+  int _world_size;
+  FieldCodec _codec;
+  std::vector<unsigned char> _payload;
+};
+#endif
@@ -5,6 +5,7 @@
 #include <sstream>
 #include <stdexcept>
 #include <fstream>
+#include <iomanip>
 
 ConfigFile::ConfigFile(const char *filename_) : _filename(filename_) {
   std::ifstream ifs(filename_);
@@ -57,8 +58,42 @@ ConfigFile::ConfigFile(const char *filename_) : _filename(filename_) {
   }
 }
 
+ConfigFile::ConfigFile() : _filename("<generated>") {}
+
 ConfigFile::~ConfigFile() {}
 
+void ConfigFile::set(const std::string& name, const std::string& value) {
+  _config_mapping[name] = value;
+}
+
+std::string ConfigFile::get_line_or_default(const std::string& name,
+                                            const std::string& dfault) const {
+  config_iterator it = _config_mapping.find(name);
+  if (it == _config_mapping.end()) {
+    return dfault;
+  }
+  return it->second;
+}
+
+std::string ConfigFile::fingerprint(const std::string& skip_prefix_) const {
+  unsigned long long hash = 14695981039346656037ULL;
+  config_iterator it = _config_mapping.begin();
+  config_iterator itEnd = _config_mapping.end();
+  for (; it != itEnd; ++it) {
+    if (!skip_prefix_.empty() && it->first.compare(0, skip_prefix_.size(), skip_prefix_) == 0) {
+      continue;
+    }
+    const std::string entry = it->first + " " + it->second + "\n";
+    for (std::size_t c = 0; c < entry.size(); ++c) {
+      hash ^= static_cast<unsigned char>(entry[c]);
+      hash *= 1099511628211ULL;
+    }
+  }
+  std::ostringstream oss;
+  oss << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return oss.str();
+}
+
 void ConfigFile::print_config() const {
   std::cout << "Run Config:";
   config_iterator it = _config_mapping.begin();
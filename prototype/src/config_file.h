@@ -13,9 +13,19 @@ namespace {
 class ConfigFile {
  public:
    ConfigFile(const char *filename_);
+   // An empty configuration, to be filled in with set()
+   ConfigFile();
    ~ConfigFile();
    void print_config() const;
    const char* get_filename() const;
+   // Adds or replaces a key, value is parsed by the getters as if read from file
+   void set(const std::string& name, const std::string& value);
+   // The whole value of a key, spaces and all, or dfault when it is absent
+   std::string get_line_or_default(const std::string& name,
+                                   const std::string& dfault) const;
+   // 64 bit FNV-1a of every key and value, in key order, as 16 hex digits;
+   // keys starting with skip_prefix_ are left out when it is not empty
+   std::string fingerprint(const std::string& skip_prefix_) const;
 
    // Config getters
    // General Case
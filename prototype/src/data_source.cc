@@ -2,41 +2,327 @@
 
 #include "config_file.h"
 #include "mesh.h"
+#include "distributed_mesh.h"
 
+#include <mpi.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <climits>
+#include <cmath>
 #include <vector>
 #include <algorithm>
+#include <sstream>
 #include <stdexcept>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+  enum Dimension {
+    LAYERS = 0, // z, outermost
+    ROWS = 1,   // y
+    COLS = 2,   // x
+  };
+
+  // Sets count_ values with the threads that will later touch them
+  void parallel_fill(double *field_, long count_, double value_, int threads_) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads_) schedule(static)
+#endif
+    for (long c = 0; c < count_; ++c) {
+      field_[c] = value_;
+    }
+  }
+
+  int clamp(int index_, int count_) {
+    return std::min(std::max(index_, 0), count_ - 1);
+  }
+}
 
 DataSource::DataSource(const ConfigFile& config_) : _config(config_) {
   _debug = config_.get_or_default("debug", false);
   _subregions = config_.get_or_default("subregions", std::vector<double>());
+  _subregion_values = config_.get_or_default("subregion_values", std::vector<double>(1, 10.0));
+  if (_subregion_values.empty()) {
+    throw std::logic_error("subregion_values needs at least one value");
+  }
+  _initial_value = config_.get_or_default("initial_value", 0.0);
+  _initial_field = config_.get_or_default("initial_field", std::string(""));
+  _initial_field_reader = config_.get_or_default("initial_field_reader", std::string("mmap"));
+  if (_initial_field_reader != "mmap" && _initial_field_reader != "mpiio") {
+    std::stringstream ss;
+    ss << "Unknown initial_field_reader: " << _initial_field_reader << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  _threads = config_.get_or_default("initial_threads", 0);
+#ifdef _OPENMP
+  if (_threads <= 0) {
+    _threads = omp_get_max_threads();
+  }
+#else
+  _threads = 1;
+#endif
 }
 DataSource::~DataSource() {}
 
 void DataSource::populate(Mesh * const mesh_){
   double *u0 = mesh_->get_u0();
   double *u1 = mesh_->get_u1();
-  int augmented_cell_count = mesh_->get_node_augmented_cell_count();
   // Zero initialize u1 - not strictly necessary
-  std::fill(&u0[0], &u0[augmented_cell_count], 0);
-  std::fill(&u1[0], &u1[augmented_cell_count], 0);
-  int subregion_count = _subregions.size() / 4; // x, y * 2 dims
+  if (u1 != u0) {
+    parallel_fill(u1, mesh_->get_node_augmented_cell_count(), 0.0, _threads);
+  }
+  populate_field(mesh_, u0);
+}
+
+void DataSource::populate_field(Mesh * const mesh_, double *field_) {
+  if (_initial_field.empty()) {
+    parallel_fill(field_, mesh_->get_node_augmented_cell_count(), _initial_value, _threads);
+  } else {
+    Axis axes[3];
+    for (int axis = LAYERS; axis <= COLS; ++axis) {
+      axes[axis] = make_axis(mesh_, axis);
+    }
+    if (_initial_field_reader == "mpiio") {
+      load_mpiio(mesh_, axes, field_);
+    } else {
+      load_mmap(mesh_, axes, field_);
+    }
+  }
+  paint_subregions(mesh_, field_);
+}
+
+double DataSource::coordinate(Mesh * const mesh_, int axis_, int index_) const {
+  switch (axis_) {
+    case (LAYERS): return mesh_->get_z_coord(index_);
+    case (ROWS): return mesh_->get_y_coord(index_);
+  }
+  return mesh_->get_x_coord(index_);
+}
+
+DataSource::Axis DataSource::make_axis(Mesh * const mesh_, int axis_) const {
+  Axis axis;
+  double del;
+  switch (axis_) {
+    case (LAYERS):
+      axis.augmented = mesh_->get_node_augmented_layer_count();
+      axis.global_count = static_cast<int>(mesh_->get_world_core_layer_count());
+      del = mesh_->get_del_z();
+      break;
+    case (ROWS):
+      axis.augmented = mesh_->get_node_augmented_row_count();
+      axis.global_count = static_cast<int>(mesh_->get_world_core_row_count());
+      del = mesh_->get_del_y();
+      break;
+    default:
+      axis.augmented = mesh_->get_node_augmented_col_count();
+      axis.global_count = static_cast<int>(mesh_->get_world_core_col_count());
+      del = mesh_->get_del_x();
+      break;
+  }
+  // Cell n of the domain starts at n * del; 2D meshes have one flat layer
+  axis.first_global = del > 0
+      ? static_cast<int>(std::floor(coordinate(mesh_, axis_, 0) / del + 0.5))
+      : 0;
+  return axis;
+}
+
+void DataSource::index_range(Mesh * const mesh_, int axis_, double min_, double max_,
+                             int& lo_, int& hi_) const {
+  const int count = make_axis(mesh_, axis_).augmented;
+  // Coordinates are affine in the index; estimate from two of them, then
+  // settle the ends against the mesh's own values, as testing every cell would
+  const double origin = coordinate(mesh_, axis_, 0);
+  const double del = count > 1 ? coordinate(mesh_, axis_, 1) - origin : 0;
+  if (del <= 0) {
+    // A single flat layer
+    const bool inside = min_ <= origin && origin < max_;
+    lo_ = 0;
+    hi_ = inside ? count : 0;
+    return;
+  }
+  lo_ = std::max(0, std::min(count, static_cast<int>(std::ceil((min_ - origin) / del))));
+  hi_ = std::max(0, std::min(count, static_cast<int>(std::ceil((max_ - origin) / del))));
+  while (lo_ > 0 && coordinate(mesh_, axis_, lo_ - 1) >= min_) --lo_;
+  while (lo_ < count && coordinate(mesh_, axis_, lo_) < min_) ++lo_;
+  while (hi_ > 0 && coordinate(mesh_, axis_, hi_ - 1) >= max_) --hi_;
+  while (hi_ < count && coordinate(mesh_, axis_, hi_) < max_) ++hi_;
+  hi_ = std::max(lo_, hi_);
+}
+
+void DataSource::paint_subregions(Mesh * const mesh_, double *field_) {
+  // x, y (and z in 3D) min then max
+  const bool three_d = mesh_->get_dimension_count() == 3;
+  const int values_per_subregion = three_d ? 6 : 4;
+  int subregion_count = _subregions.size() / values_per_subregion;
+  const int x_span = mesh_->get_node_augmented_col_count();
+  const long plane = static_cast<long>(mesh_->get_node_augmented_row_count()) * x_span;
   std::vector<double>::const_iterator it = _subregions.begin();
   for (int s = 0; s < subregion_count; ++s) {
     double x_min = *it++;
     double y_min = *it++;
+    double z_min = three_d ? *it++ : 0;
     double x_max = *it++;
     double y_max = *it++;
-    for (int i = 0; i < mesh_->get_node_augmented_row_count(); ++i) {
-      double x_coord = mesh_->get_y_coord(i);
-      if (x_min <= x_coord && x_coord < x_max) {
-        for (int j = 0; j < mesh_->get_node_augmented_col_count(); ++j) {
-          double y_coord = mesh_->get_x_coord(j); 
-          if (y_min <= y_coord && y_coord < y_max) {
-            u0[i * mesh_->get_node_augmented_col_count() + j] = 10;
-          }
-        }
-      }
+    double z_max = three_d ? *it++ : 0;
+    const double value = _subregion_values[std::min<size_t>(s, _subregion_values.size() - 1)];
+    // n.b. the box's "x" bounds the rows and its "y" the columns
+    int k_lo = 0;
+    int k_hi = mesh_->get_node_augmented_layer_count();
+    if (three_d) {
+      index_range(mesh_, LAYERS, z_min, z_max, k_lo, k_hi);
+    }
+    int i_lo, i_hi, j_lo, j_hi;
+    index_range(mesh_, ROWS, x_min, x_max, i_lo, i_hi);
+    index_range(mesh_, COLS, y_min, y_max, j_lo, j_hi);
+    const int rows = i_hi - i_lo;
+    const int lines = (k_hi - k_lo) * rows;
+    if (rows <= 0 || j_hi <= j_lo) {
+      continue;
+    }
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(_threads) schedule(static)
+#endif
+    for (int line = 0; line < lines; ++line) {
+      const int k = k_lo + line / rows;
+      const int i = i_lo + line % rows;
+      std::fill(&field_[k * plane + i * x_span + j_lo], &field_[k * plane + i * x_span + j_hi], value);
+    }
+  }
+}
+
+void DataSource::load_mmap(Mesh * const mesh_, const Axis axes_[3], double *field_) {
+  const long rows = axes_[ROWS].global_count;
+  const long cols = axes_[COLS].global_count;
+  const long cells = axes_[LAYERS].global_count * rows * cols;
+  int fd = open(_initial_field.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::stringstream ss;
+    ss << "Cannot open initial_field " << _initial_field << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size != static_cast<off_t>(cells * sizeof(double))) {
+    close(fd);
+    std::stringstream ss;
+    ss << "initial_field " << _initial_field << " should hold " << cells
+       << " doubles for the configured logical_dimensions" << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  // Map only the span from this block's first to its last needed cell
+  int lo[3];
+  int hi[3];
+  for (int axis = LAYERS; axis <= COLS; ++axis) {
+    lo[axis] = clamp(axes_[axis].first_global, axes_[axis].global_count);
+    hi[axis] = clamp(axes_[axis].first_global + axes_[axis].augmented - 1,
+                     axes_[axis].global_count);
+  }
+  const long first = (lo[LAYERS] * rows + lo[ROWS]) * cols + lo[COLS];
+  const long last = (hi[LAYERS] * rows + hi[ROWS]) * cols + hi[COLS];
+  const long page = sysconf(_SC_PAGESIZE);
+  const off_t map_offset = first * sizeof(double) / page * page;
+  const size_t map_length = (last + 1) * sizeof(double) - map_offset;
+  void *map = mmap(0, map_length, PROT_READ, MAP_PRIVATE, fd, map_offset);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw std::logic_error("Cannot mmap initial_field");
+  }
+  const double *file = reinterpret_cast<const double *>(
+      static_cast<const char *>(map) - map_offset);
+  const int x_span = axes_[COLS].augmented;
+  const int augmented_rows = axes_[ROWS].augmented;
+  const int lines = axes_[LAYERS].augmented * augmented_rows;
+  // Ghosts past a physical edge take the edge's value, as a reflection would
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(_threads) schedule(static)
+#endif
+  for (int line = 0; line < lines; ++line) {
+    const int k = line / augmented_rows;
+    const int i = line % augmented_rows;
+    const long gk = clamp(axes_[LAYERS].first_global + k, axes_[LAYERS].global_count);
+    const long gi = clamp(axes_[ROWS].first_global + i, axes_[ROWS].global_count);
+    const double *source = &file[(gk * rows + gi) * cols];
+    double *target = &field_[static_cast<long>(line) * x_span];
+    for (int j = 0; j < x_span; ++j) {
+      target[j] = source[clamp(axes_[COLS].first_global + j, axes_[COLS].global_count)];
+    }
+  }
+  munmap(map, map_length);
+}
+
+void DataSource::load_mpiio(Mesh * const mesh_, const Axis axes_[3], double *field_) {
+  DistributedMesh *distributed = dynamic_cast<DistributedMesh *>(mesh_);
+  if (!distributed) {
+    throw std::logic_error("initial_field_reader mpiio needs a distributed mesh");
+  }
+  // This block plus ghosts, cut back to the domain
+  int sizes[3];
+  int subsizes[3];
+  int starts[3];
+  for (int axis = LAYERS; axis <= COLS; ++axis) {
+    const int lo = clamp(axes_[axis].first_global, axes_[axis].global_count);
+    const int hi = clamp(axes_[axis].first_global + axes_[axis].augmented - 1,
+                         axes_[axis].global_count);
+    sizes[axis] = axes_[axis].global_count;
+    subsizes[axis] = hi - lo + 1;
+    starts[axis] = lo;
+  }
+  MPI_Datatype block;
+  MPI_Type_create_subarray(3, sizes, subsizes, starts, MPI_ORDER_C, MPI_DOUBLE, &block);
+  MPI_Type_commit(&block);
+  MPI_File file;
+  if (MPI_File_open(distributed->get_cart_comm(), const_cast<char *>(_initial_field.c_str()),
+                    MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+    MPI_Type_free(&block);
+    std::stringstream ss;
+    ss << "Cannot open initial_field " << _initial_field << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  MPI_Offset file_size = 0;
+  MPI_File_get_size(file, &file_size);
+  const long cells = static_cast<long>(sizes[LAYERS]) * sizes[ROWS] * sizes[COLS];
+  if (file_size != static_cast<MPI_Offset>(cells * sizeof(double))) {
+    MPI_File_close(&file);
+    MPI_Type_free(&block);
+    std::stringstream ss;
+    ss << "initial_field " << _initial_field << " should hold " << cells
+       << " doubles for the configured logical_dimensions" << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  // Read a line of the block at a time, as its cell count may not fit the
+  // int count MPI takes
+  const long block_lines = static_cast<long>(subsizes[LAYERS]) * subsizes[ROWS];
+  if (block_lines > INT_MAX) {
+    MPI_File_close(&file);
+    MPI_Type_free(&block);
+    throw std::logic_error("initial_field block has too many rows for one MPI-IO read");
+  }
+  std::vector<double> buffer(block_lines * subsizes[COLS]);
+  MPI_Datatype line_type;
+  MPI_Type_contiguous(subsizes[COLS], MPI_DOUBLE, &line_type);
+  MPI_Type_commit(&line_type);
+  MPI_File_set_view(file, 0, MPI_DOUBLE, block, const_cast<char *>("native"), MPI_INFO_NULL);
+  MPI_File_read_all(file, &buffer[0], static_cast<int>(block_lines), line_type, MPI_STATUS_IGNORE);
+  MPI_File_close(&file);
+  MPI_Type_free(&line_type);
+  MPI_Type_free(&block);
+  const int x_span = axes_[COLS].augmented;
+  const int augmented_rows = axes_[ROWS].augmented;
+  const int lines = axes_[LAYERS].augmented * augmented_rows;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(_threads) schedule(static)
+#endif
+  for (int line = 0; line < lines; ++line) {
+    const int k = line / augmented_rows;
+    const int i = line % augmented_rows;
+    const long bk = clamp(axes_[LAYERS].first_global + k, sizes[LAYERS]) - starts[LAYERS];
+    const long bi = clamp(axes_[ROWS].first_global + i, sizes[ROWS]) - starts[ROWS];
+    const double *source = &buffer[(bk * subsizes[ROWS] + bi) * subsizes[COLS]];
+    double *target = &field_[static_cast<long>(line) * x_span];
+    for (int j = 0; j < x_span; ++j) {
+      target[j] = source[clamp(axes_[COLS].first_global + j, sizes[COLS]) - starts[COLS]];
     }
   }
 }
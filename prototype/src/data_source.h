@@ -1,21 +1,53 @@
 #ifndef DATA_SOURCE_H
 #define DATA_SOURCE_H
 
+#include <string>
 #include <vector>
 
 class ConfigFile;
 class Mesh;
+// Sets up the initial u0:
+//   initial_field        - raw native-endian doubles of the whole core
+//                          domain, row major (layers outermost in 3D);
+//                          each rank reads only its own block plus ghosts
+//   initial_field_reader - mmap (default) or mpiio
+//   subregions           - boxes painted over that (or over zero), x, y
+//                          (and z) min then max
+//   subregion_values     - one value per box, the last repeating (10)
+//   initial_threads      - OpenMP threads to fill with, 0 for the default
+//   initial_value        - the value under any field or boxes (0)
 class DataSource {
  public:
   DataSource(const ConfigFile& config_);
   ~DataSource();
   void populate(Mesh * const mesh_);
+  // Sets field_, in the mesh's augmented layout, as populate() does u0
+  void populate_field(Mesh * const mesh_, double *field_);
 
  private:
+  // Augmented indices of one axis of the mesh and where they sit globally
+  struct Axis {
+    int augmented;    // local cells, ghosts included
+    int global_count; // core cells of the whole domain
+    int first_global; // global index of local index 0, -1 at a physical edge
+  };
+  Axis make_axis(Mesh * const mesh_, int axis_) const;
+  double coordinate(Mesh * const mesh_, int axis_, int index_) const;
+  // [lo_, hi_) of the local indices whose coordinate is in [min_, max_)
+  void index_range(Mesh * const mesh_, int axis_, double min_, double max_,
+                   int& lo_, int& hi_) const;
+  void paint_subregions(Mesh * const mesh_, double *field_);
+  void load_mmap(Mesh * const mesh_, const Axis axes_[3], double *field_);
+  void load_mpiio(Mesh * const mesh_, const Axis axes_[3], double *field_);
+
   const ConfigFile& _config;
   bool _debug;
-  int _n_dimensions;
   std::vector<double> _subregions;
+  std::vector<double> _subregion_values;
+  double _initial_value;
+  std::string _initial_field;
+  std::string _initial_field_reader;
+  int _threads;
 };
 
 #endif
@@ -8,30 +8,42 @@ DistributedMesh::DistributedMesh(const ConfigFile& config_,
                                                                        _cart_comm(cart_comm_),
                                                                        _dim_nodes(dim_nodes_) {
   MPI_Comm_rank(_cart_comm, &_cart_rank);  
-  _cart_coords.resize(2, 0);
-  MPI_Cart_coords(_cart_comm, _cart_rank, 2, &_cart_coords[0]);
+  // 2D or 3D decomposition, following dim_nodes
+  const int ndims = _dim_nodes.size();
+  _cart_coords.resize(ndims, 0);
+  MPI_Cart_coords(_cart_comm, _cart_rank, ndims, &_cart_coords[0]);
   // Compute ranks of neighbours
-  _neighbour_rank_or_neg.resize(4, -1);
-  int coords[2];
+  _neighbour_rank_or_neg.resize(6, -1);
+  std::vector<int> coords(_cart_coords);
   if (has_top_neighbour()) {
     coords[0] = get_node_row() - 1;
-    coords[1] = get_node_col();
-    MPI_Cart_rank(_cart_comm, coords, &_neighbour_rank_or_neg[TOP]);
+    MPI_Cart_rank(_cart_comm, &coords[0], &_neighbour_rank_or_neg[TOP]);
+    coords[0] = get_node_row();
   }
   if (has_bottom_neighbour()) {
     coords[0] = get_node_row() + 1;
-    coords[1] = get_node_col();
-    MPI_Cart_rank(_cart_comm, coords, &_neighbour_rank_or_neg[BOTTOM]);
+    MPI_Cart_rank(_cart_comm, &coords[0], &_neighbour_rank_or_neg[BOTTOM]);
+    coords[0] = get_node_row();
   }
   if (has_left_neighbour()) {
-    coords[0] = get_node_row();
     coords[1] = get_node_col() - 1;
-    MPI_Cart_rank(_cart_comm, coords, &_neighbour_rank_or_neg[LEFT]);
+    MPI_Cart_rank(_cart_comm, &coords[0], &_neighbour_rank_or_neg[LEFT]);
+    coords[1] = get_node_col();
   }
   if (has_right_neighbour()) {
-    coords[0] = get_node_row();
     coords[1] = get_node_col() + 1;
-    MPI_Cart_rank(_cart_comm, coords, &_neighbour_rank_or_neg[RIGHT]);
+    MPI_Cart_rank(_cart_comm, &coords[0], &_neighbour_rank_or_neg[RIGHT]);
+    coords[1] = get_node_col();
+  }
+  if (has_front_neighbour()) {
+    coords[2] = get_node_layer() - 1;
+    MPI_Cart_rank(_cart_comm, &coords[0], &_neighbour_rank_or_neg[FRONT]);
+    coords[2] = get_node_layer();
+  }
+  if (has_back_neighbour()) {
+    coords[2] = get_node_layer() + 1;
+    MPI_Cart_rank(_cart_comm, &coords[0], &_neighbour_rank_or_neg[BACK]);
+    coords[2] = get_node_layer();
   }
 }
 
@@ -39,6 +51,10 @@ int DistributedMesh::get_neighbour_rank(int neighbour_) const {
   return _neighbour_rank_or_neg.at(neighbour_);
 }
 
+MPI_Comm DistributedMesh::get_cart_comm() const {
+  return _cart_comm;
+}
+
 int DistributedMesh::get_node_row() const {
   return _cart_coords.at(0);
 }
@@ -47,6 +63,10 @@ int DistributedMesh::get_node_col() const {
   return _cart_coords.at(1);
 }
 
+int DistributedMesh::get_node_layer() const {
+  return _cart_coords.size() > 2 ? _cart_coords[2] : 0;
+}
+
 int DistributedMesh::get_vertical_nodes_count() const {
   return _dim_nodes.at(0);
 }
@@ -55,6 +75,10 @@ int DistributedMesh::get_horizontal_nodes_count() const {
   return _dim_nodes.at(1);
 }
 
+int DistributedMesh::get_depth_nodes_count() const {
+  return _dim_nodes.size() > 2 ? _dim_nodes[2] : 1;
+}
+
 bool DistributedMesh::has_top_neighbour() const {
   // We have a top neighbour if we are not on the first row
   return get_node_row() != 0; 
@@ -74,3 +98,13 @@ bool DistributedMesh::has_right_neighbour() const {
   // We have a right neighbour if we are not on the last column
   return get_node_col() != get_horizontal_nodes_count() - 1; 
 }
+
+bool DistributedMesh::has_front_neighbour() const {
+  // We have a front neighbour if we are not on the first layer
+  return get_node_layer() != 0;
+}
+
+bool DistributedMesh::has_back_neighbour() const {
+  // We have a back neighbour if we are not on the last layer
+  return get_node_layer() != get_depth_nodes_count() - 1;
+}
@@ -12,6 +12,8 @@ namespace {
     BOTTOM = 1,
     LEFT = 2,
     RIGHT = 3,
+    FRONT = 4, // towards layer 0, 3D only
+    BACK = 5,
   };
 }
 
@@ -24,14 +26,21 @@ class DistributedMesh : public Mesh {
   virtual ~DistributedMesh() = 0;
   // MPI specific things
   int get_neighbour_rank(int rank_) const;
+  MPI_Comm get_cart_comm() const;
   int get_node_row() const;
   int get_node_col() const;
+  int get_node_layer() const;
   int get_vertical_nodes_count() const;
   int get_horizontal_nodes_count() const;
+  int get_depth_nodes_count() const;
   bool has_top_neighbour() const;
   bool has_bottom_neighbour() const;
   bool has_left_neighbour() const;
   bool has_right_neighbour() const;
+  bool has_front_neighbour() const;
+  bool has_back_neighbour() const;
+  // Fills the ghost cells of u1 from the neighbouring nodes
+  virtual void exchange_boundaries() = 0;
  protected:
   const MPI_Comm _cart_comm;
  private:
@@ -39,7 +48,6 @@ class DistributedMesh : public Mesh {
   const std::vector<int>& _dim_nodes;
   int _cart_rank;
   std::vector<int> _neighbour_rank_or_neg;
-  virtual void exchange_boundaries() = 0;
 };
 
 inline DistributedMesh::~DistributedMesh() {}
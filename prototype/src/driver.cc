@@ -9,41 +9,69 @@
 #include "tools-inl.h"
 #include "config_file.h"
 #include "vtk_writer.h"
+#include "compressed_writer.h"
 #include "data_source.h"
 #include "mesh.h"
 #include "static_mesh.h"
 #include "static_blocking_mesh.h"
+#include "static_mesh_3d.h"
 #include "dynamic_mesh.h"
 #include "calculation.h"
+#include "task_runtime.h"
+#include "tracer.h"
+#include "hardware_counters.h"
+#include "live_metrics.h"
+#include "field_allocator.h"
+#include "distributed_mesh.h"
 
-Driver::Driver(const ConfigFile& config_) : _config(config_) {
+Driver::Driver(const ConfigFile& config_) : _config(config_), _run_report(config_),
+                                            _topology(config_) {
   // Read configuration
   _debug = _config.get_or_default("debug", false);
   _visualize = _config.get_or_default("visualize", true);
+  _performance_report = _config.get_or_default("performance_report", false);
+  _run_summary = _config.get_or_default("run_summary", true);
   _name = _config.get_or_default("name", std::string("prototype"));
   _output_rate = _config.get_or_default("output_rate", 1);
+  _output_format = _config.get_or_default("output_format", std::string("vtk"));
+  _compression_error_bound = _config.get_or_default("compression_error_bound", 0.0);
+  _trace = _config.get_or_default("trace", false);
+  _trace_file = _config.get_or_default("trace_file", std::string(""));
   _t_start = _config.get_or_default("start_time", 0.0);
   _t_end = _config.get_or_default("end_time", 2.0);
   _del_t = _config.get_or_default("timestep", 0.02);
   _mpi_reorder = _config.get_or_default("mpi_reorder", true);
   _dim_nodes = _config.get_or_default("dim_nodes", std::vector<int>());       
   _dim_periods = _config.get_or_default("dim_periods", std::vector<int>());      
-  // Resize to be 2 elements (1 per dimension), 0 pad
-  _dim_nodes.resize(2, 0); 
-  _dim_periods.resize(2, 0);
+  // Counters are inherited only by threads started after they open, so open
+  // them before anything runs an OpenMP region
+  _counters = 0;
+  if (_config.get_or_default("hardware_counters", false)) {
+    _counters = new HardwareCounters(_config);
+    _profiler.set_counters(_counters);
+  }
+  // A third logical dimension (layers) makes the domain 3D
+  const int ndims = _config.get_or_default("logical_dimensions",
+                                           std::vector<int>()).size() > 2 ? 3 : 2;
+  // Resize to be ndims elements (1 per dimension), 0 pad
+  _dim_nodes.resize(ndims, 0); 
+  _dim_periods.resize(ndims, 0);
   // Establish MPI topology
   MPI_Comm_size(MPI_COMM_WORLD, &_world_size);
   MPI_Comm_rank(MPI_COMM_WORLD, &_world_rank);
-  MPI_Dims_create(_world_size, 2/*2D*/, &_dim_nodes[0]); 
-  MPI_Cart_create(MPI_COMM_WORLD,
-                  2, // 2D
-                  &_dim_nodes[0],
-                  &_dim_periods[0],
-                  _mpi_reorder,
-                  &_cart_comm);
+  MPI_Dims_create(_world_size, ndims, &_dim_nodes[0]); 
+  _cart_comm = _topology.create_cart(MPI_COMM_WORLD, _dim_nodes, _dim_periods,
+                                     _mpi_reorder);
   // Initialize Mesh (and calculation)
   _mesh_type = _config.get_or_default("mesh_type", std::string("static"));
-  if (_mesh_type == "static") {
+  if (ndims == 3) {
+    if (_mesh_type != "static") {
+      std::stringstream ss;
+      ss << "3D domains only support the static mesh, not: " << _mesh_type << std::endl;
+      throw std::logic_error(ss.str());
+    }
+    _mesh = new StaticMesh3D(_config, _cart_comm, _dim_nodes);
+  } else if (_mesh_type == "static") {
     _mesh = new StaticMesh(_config, _cart_comm, _dim_nodes);
   } else if (_mesh_type == "static_blocking") {
     _mesh = new StaticBlockingMesh(_config, _cart_comm, _dim_nodes);
@@ -54,35 +82,81 @@ Driver::Driver(const ConfigFile& config_) : _config(config_) {
     ss << "Unknown mesh type: " << _mesh_type << std::endl;
     throw std::logic_error(ss.str());
   }
+  if (_performance_report) {
+    _topology.report(*static_cast<DistributedMesh*>(_mesh), std::cout);
+  }
   std::stringstream ss;
   ss << _name << "_" << _mesh_type;
   _outfile_tag = ss.str();
+  if (_trace_file.empty()) {
+    _trace_file = _outfile_tag + ".trace.json";
+  }
 
+  if (_output_format == "vtk") {
+    _writer = new VtkWriter(_outfile_tag, _mesh, _world_rank, _world_size);
+  } else if (_output_format == "compressed") {
+    _writer = new CompressedWriter(_outfile_tag, _mesh, _world_rank, _world_size,
+                                   _compression_error_bound);
+  } else {
+    std::stringstream ss;
+    ss << "Unknown output format: " << _output_format << std::endl;
+    throw std::logic_error(ss.str());
+  }
+
+  _mesh->set_profiler(&_profiler);
+  _live = 0;
+  if (_config.get_or_default("live_metrics", false)) {
+    _live = new LiveMetrics(_config, _outfile_tag, _world_rank, _world_size);
+  }
+  _tracer = 0;
+  if (_trace) {
+    _tracer = new Tracer(_config.get_or_default("trace_buffer_events", 1 << 16));
+    _profiler.set_tracer(_tracer);
+  }
   _calculation = new Calculation(_config, _mesh);
+  _calculation->set_profiler(&_profiler);
+  _tasks = 0;
+  if (_config.get_or_default("task_runtime", false)) {
+    StaticMesh *static_mesh = dynamic_cast<StaticMesh*>(_mesh);
+    if (!static_mesh || ndims == 3) {
+      throw std::logic_error("task_runtime needs a 2D static mesh");
+    }
+    _tasks = new TaskRuntime(_config, static_mesh);
+    _tasks->set_profiler(&_profiler);
+  }
   // Datasource initialize
   DataSource ds(_config);
   ds.populate(_mesh);
 }
 
 Driver::~Driver(){
+  delete _writer;
   delete _mesh;
+  delete _tasks;
   delete _calculation;
+  delete _tracer;
+  delete _counters;
+  delete _live;
+  MPI_Comm_free(&_cart_comm);
 }
 
 void Driver::run() {
-  VtkWriter writer(_outfile_tag, _mesh, _world_rank, _world_size);
   double wall_start, wall_stop;
   double cpu_start, cpu_stop;
   if (_debug) {
     std::cout << " ++ RUN BEGINNING ++ " << std::endl;
   }
+  if (_tracer) {
+    _tracer->start(MPI_COMM_WORLD);
+  }
   timers(wall_start, cpu_start); // start timing
   int step = 0;
   double t_now = _t_start;
   while (t_now < _t_end) { // doublecompare
     if (step % _output_rate == 0) {
       if (_visualize) {
-        writer.write(step, t_now);
+        ScopedPhase phase(&_profiler, OUTPUT);
+        _writer->write(step, t_now);
       }
       if (_debug) {
         double temp = local_temp();
@@ -95,35 +169,105 @@ void Driver::run() {
         }
       }
     }
-    _calculation->step(_del_t);
+    if (_tasks) {
+      // Every step up to the next output goes to the task graph at once
+      int steps = 0;
+      double t_next = t_now;
+      do {
+        ++steps;
+        t_next += _del_t;
+      } while (t_next < _t_end // doublecompare
+               && (!(_visualize || _debug) || (step + steps) % _output_rate != 0));
+      const double batch_start = monotonic_seconds();
+      {
+        ScopedPhase phase(&_profiler, COMPUTE);
+        _tasks->run(steps, _del_t);
+      }
+      _profiler.count_cell_updates(static_cast<long>(steps) * _mesh->get_node_core_cell_count());
+      step += steps;
+      t_now = t_next;
+      if (_live) {
+        // The graph gives no per step times, so each gets an even share
+        const double each = (monotonic_seconds() - batch_start) / steps;
+        for (int s = 0; s < steps; ++s) {
+          _live->record_step(each, _mesh->get_node_core_cell_count());
+        }
+        _live->publish(step, t_now, _profiler);
+      }
+      continue;
+    }
+    const double step_start = monotonic_seconds();
+    {
+      ScopedPhase phase(&_profiler, COMPUTE);
+      _calculation->step(_del_t);
+    }
+    // rkl2 stages and implicit solver sweeps each update every cell
+    const long updates = static_cast<long>(_calculation->get_last_sweeps()
+                                           * _mesh->get_node_core_cell_count() + 0.5);
+    _profiler.count_cell_updates(updates);
     _mesh->advance();
     ++step;
     t_now += _del_t;
+    if (_live) {
+      _live->record_step(monotonic_seconds() - step_start, updates);
+      _live->publish(step, t_now, _profiler);
+    }
   }
   if (_visualize) {
-    writer.write(step, t_now);
+    ScopedPhase phase(&_profiler, OUTPUT);
+    _writer->write(step, t_now);
   }
   timers(wall_stop, cpu_stop); // stop timing
+  if (_live) {
+    _live->finish(step, t_now, _profiler);
+  }
   if (_debug) {
     std::cout << " ++ RUN FINISHING ++ " << std::endl;
   }
   // Output timing information
   MPI_Barrier(MPI_COMM_WORLD);
-  if (_world_rank == 0) {
-    std::cout << "Timings: wallclock:" << (wall_stop - wall_start) << "s\n"
-                 "         cpu clock:" << (cpu_stop - cpu_start) << std::endl;
+  if (_run_summary) {
+    if (_world_rank == 0) {
+      std::cout << "Timings: wallclock:" << (wall_stop - wall_start) << "s\n"
+                   "         cpu clock:" << (cpu_stop - cpu_start) << std::endl;
+    }
+    _profiler.report(MPI_COMM_WORLD, std::cout);
+    if (_counters) {
+      _counters->report(MPI_COMM_WORLD, std::cout);
+    }
+  }
+  if (_tracer) {
+    _profiler.set_tracer(0);
+    _tracer->write(_trace_file, MPI_COMM_WORLD);
+    if (_world_rank == 0) {
+      std::cout << "Trace written to " << _trace_file << std::endl;
+    }
+  }
+  if (_performance_report) {
+    // After the run, so the probe's arrays stay out of the peak RSS above
+    _run_report.probe_bandwidth(_cart_comm);
+    _run_report.report(_profiler, MPI_COMM_WORLD, std::cout);
+    FieldAllocator::report(MPI_COMM_WORLD, std::cout);
   }
 }
 
+const Profiler& Driver::get_profiler() const {
+  return _profiler;
+}
+
 double Driver::local_temp() const {
   double total = 0;
   double *u0 = _mesh->get_u0();
   const int x_span = _mesh->get_node_augmented_col_count();
+  const int plane = _mesh->get_node_augmented_row_count() * x_span;
   const int i_offset = _mesh->get_current_row_offset();
   const int j_offset = _mesh->get_current_col_offset();
-  for (int i = i_offset; i < _mesh->get_node_core_row_count() + i_offset; ++i) {
-    for (int j = j_offset; j < _mesh->get_node_core_col_count() + j_offset; ++j) {
-      total += u0[i * x_span + j];
+  const int k_offset = _mesh->get_current_layer_offset();
+  for (int k = k_offset; k < _mesh->get_node_core_layer_count() + k_offset; ++k) {
+    for (int i = i_offset; i < _mesh->get_node_core_row_count() + i_offset; ++i) {
+      for (int j = j_offset; j < _mesh->get_node_core_col_count() + j_offset; ++j) {
+        total += u0[k * plane + i * x_span + j];
+      }
     }
   }
   return total;
@@ -5,30 +5,55 @@
 #include <vector>
 #include <string>
 
+#include "profiler.h"
+#include "run_report.h"
+#include "topology_mapper.h"
+
 class ConfigFile;
 class Mesh;
 class Calculation;
+class TaskRuntime;
+class Tracer;
+class HardwareCounters;
+class LiveMetrics;
+class Writer;
 
 class Driver {
  public:
   Driver(const ConfigFile& config_);
   ~Driver();
   void run();
+  // Phase times and work counters of the last run()
+  const Profiler& get_profiler() const;
 
  private:
   double local_temp() const;
   bool _debug;
   bool _visualize; 
+  bool _performance_report;
+  bool _run_summary;
   std::string _name;
   std::string _mesh_type;
   std::string _outfile_tag;
+  std::string _output_format;
+  double _compression_error_bound;
+  bool _trace;
+  std::string _trace_file;
   int _output_rate;
   double _t_start;
   double _t_end;
   double _del_t;
   const ConfigFile& _config;
   Mesh * _mesh;
+  Writer * _writer;
   Calculation * _calculation;
+  TaskRuntime * _tasks; // with task_runtime, steps in place of _calculation
+  Profiler _profiler;
+  Tracer * _tracer;
+  HardwareCounters * _counters;
+  LiveMetrics * _live;
+  RunReport _run_report;
+  TopologyMapper _topology;
   // MPI members
   std::vector<int> _dim_nodes;
   std::vector<int> _dim_periods;
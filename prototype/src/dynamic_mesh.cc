@@ -2,121 +2,173 @@
 
 #include <mpi.h>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
 
 #include "tools-inl.h"
 #include "config_file.h"
+#include "profiler.h"
+#include "tracer.h"
 
 DynamicMesh::DynamicMesh(const ConfigFile& config_,
                          MPI_Comm cart_comm_,
                          const std::vector<int>& dim_nodes_) : DistributedMesh(config_,
                                                                                cart_comm_,
                                                                                dim_nodes_),
-                                                               _prograde(true) {
+                                                               _prograde(true),
+                                                               _phase_step(0) {
+  if (is_single_buffer()) {
+    // Rows move between u0 and u1 every step
+    throw std::logic_error("single_buffer is not supported by the dynamic mesh");
+  }
+  _depth = _config.get_or_default("dynamic_depth", 1);
+  if (_depth < 1) {
+    throw std::logic_error("dynamic_depth must be positive");
+  }
+  const int world_rows = static_cast<int>(get_world_core_row_count());
+  if (get_vertical_nodes_count() > 1
+      && (world_rows + _depth) / get_vertical_nodes_count() < 2 * _depth) {
+    // Every rank must own the 2k rows it sends, in either phase
+    std::stringstream ss;
+    ss << "dynamic_depth " << _depth << " needs at least " << 2 * _depth
+       << " rows per node" << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  // Deep enough for the k rows received above a retrograde phase and the
+  // k below a prograde one, or a ghost row at a physical edge
+  _first_row = has_top_neighbour() ? phase_row_begin(true) - 2 * _depth : -1;
   const int memory_elements = get_node_augmented_cell_count();
-  _u0 = new double[memory_elements];
-  _u1 = new double[memory_elements];
+  _u0 = _field_allocator.allocate(memory_elements);
+  _u1 = _field_allocator.allocate(memory_elements);
   // Create MPI Datatypes
 }
 
 DynamicMesh::~DynamicMesh() {
-  delete[] _u0;
-  delete[] _u1;
+  _field_allocator.release(_u0);
+  _field_allocator.release(_u1);
 }
 
 
 void DynamicMesh::exchange_boundaries() {
-  // Plan: Send padded rows, 2 down on prograde, 2 up on retrograde
-  MPI_Request send_request[4]; // Has to be present but are not consulted
+  // Plan: Send 2k padded rows, down on prograde, up on retrograde
+  MPI_Request send_request[4];
   MPI_Request recv_request[4];
   MPI_Status  recv_status[4];
   int send_count = 0;
   int recv_count = 0;
   // This will have to change when we're dealing in 2d properly
   const int x_span = get_node_augmented_col_count();
-  if (_prograde) {
-    // SEND
-    if (has_bottom_neighbour()) {
-      const int i = get_node_augmented_row_count() - 3; // one for last ghost
-                                                        // and 2 to send 2
-      const int j = 0;
-      MPI_Isend(&_u1[i * x_span + j],
-                2 * x_span,
-                MPI_DOUBLE,
-                get_neighbour_rank(BOTTOM),
-                BOTTOM,
-                _cart_comm,
-                &send_request[send_count++]);
-    }
-    // RECEIVE
-    if (has_top_neighbour()) {
-      const int i = 0;
-      const int j = 0;
-      MPI_Irecv(&_u1[i * x_span + j],
-                2 * x_span,
-                MPI_DOUBLE,
-                get_neighbour_rank(TOP),
-                BOTTOM,
-                _cart_comm,
-                &recv_request[recv_count++]);
-    }
-  } else { /* retrograde */
-    // SEND
-    if (has_top_neighbour()) {
-      const int i = 1; // Start of core rows...
-      const int j = 0;
-      MPI_Isend(&_u1[i * x_span + j],
-                2 * x_span,
-                MPI_DOUBLE,
-                get_neighbour_rank(TOP),
-                TOP,
-                _cart_comm,
-                &send_request[send_count++]);
-    }
-    // RECEIVE
-    if (has_bottom_neighbour()) {
-      const int i = get_node_augmented_row_count() - 2;
-      const int j = 0;
-      MPI_Irecv(&_u1[i * x_span + j],
-                2 * x_span,
-                MPI_DOUBLE,
-                get_neighbour_rank(BOTTOM),
-                TOP,
-                _cart_comm,
-                &recv_request[recv_count++]);
+  const int rows = 2 * _depth;
+  const double bytes = 1.0 * rows * x_span * sizeof(double);
+  {
+    ScopedPhase phase(_profiler, HALO_POST);
+    if (_prograde) {
+      // SEND the last 2k owned rows, the bottom neighbour's next top
+      if (has_bottom_neighbour()) {
+        const int i = phase_row_end(true) - rows - _first_row;
+        const int j = 0;
+        MPI_Isend(&_u1[i * x_span + j],
+                  rows * x_span,
+                  MPI_DOUBLE,
+                  get_neighbour_rank(BOTTOM),
+                  BOTTOM,
+                  _cart_comm,
+                  &send_request[send_count++]);
+        trace_message(SEND_POST, get_neighbour_rank(BOTTOM), bytes);
+      }
+      // RECEIVE above the retrograde rows
+      if (has_top_neighbour()) {
+        const int i = 0;
+        const int j = 0;
+        MPI_Irecv(&_u1[i * x_span + j],
+                  rows * x_span,
+                  MPI_DOUBLE,
+                  get_neighbour_rank(TOP),
+                  BOTTOM,
+                  _cart_comm,
+                  &recv_request[recv_count++]);
+        trace_message(RECV_POST, get_neighbour_rank(TOP), bytes);
+      }
+    } else { /* retrograde */
+      // SEND the first 2k owned rows, the top neighbour's next bottom
+      if (has_top_neighbour()) {
+        const int i = phase_row_begin(false) - _first_row;
+        const int j = 0;
+        MPI_Isend(&_u1[i * x_span + j],
+                  rows * x_span,
+                  MPI_DOUBLE,
+                  get_neighbour_rank(TOP),
+                  TOP,
+                  _cart_comm,
+                  &send_request[send_count++]);
+        trace_message(SEND_POST, get_neighbour_rank(TOP), bytes);
+      }
+      // RECEIVE below the retrograde rows
+      if (has_bottom_neighbour()) {
+        const int i = phase_row_end(false) - _first_row;
+        const int j = 0;
+        MPI_Irecv(&_u1[i * x_span + j],
+                  rows * x_span,
+                  MPI_DOUBLE,
+                  get_neighbour_rank(BOTTOM),
+                  TOP,
+                  _cart_comm,
+                  &recv_request[recv_count++]);
+        trace_message(RECV_POST, get_neighbour_rank(BOTTOM), bytes);
+      }
     }
   }
-  for (int req = 0; req < send_count; ++req) {
-    MPI_Request_free(&send_request[req]);
-  }
+  ScopedPhase phase(_profiler, HALO_WAIT);
   MPI_Waitall(recv_count, recv_request, recv_status);
+  // The sent rows are overwritten two steps on, which is within the phase
+  // once k > 1, and 2k rows can be large enough to go by rendezvous
+  MPI_Waitall(send_count, send_request, MPI_STATUSES_IGNORE);
+  for (int req = 0; req < recv_count; ++req) {
+    trace_message(RECV_COMPLETE, recv_status[req].MPI_SOURCE, bytes);
+  }
+  if (_profiler) {
+    // Every message is 2k augmented rows, sent and received
+    _profiler->count_halo_bytes((send_count + recv_count) * bytes);
+  }
 }
 
 void DynamicMesh::advance() {
-  if (!has_top_neighbour()) {
-    reflect_boundary(TOP);
-  }
-  if (!has_bottom_neighbour()) {
-    reflect_boundary(BOTTOM);
-  }
-  if (!has_left_neighbour()) {
-    reflect_boundary(LEFT);
+  {
+    ScopedPhase phase(_profiler, REFLECT);
+    if (!has_top_neighbour()) {
+      reflect_boundary(TOP);
+    }
+    if (!has_bottom_neighbour()) {
+      reflect_boundary(BOTTOM);
+    }
+    if (!has_left_neighbour()) {
+      reflect_boundary(LEFT);
+    }
+    if (!has_right_neighbour()) {
+      reflect_boundary(RIGHT);
+    }
   }
-  if (!has_right_neighbour()) {
-    reflect_boundary(RIGHT);
+  if (++_phase_step == _depth) {
+    exchange_boundaries();
+    // Toggle phase
+    _prograde = !_prograde;
+    _phase_step = 0;
   }
-
-  exchange_boundaries();
-  // Toggle step
-  _prograde = !_prograde;
   // Now we've finished updating u1, we can swap it to u0
   std::swap(_u0, _u1);
 }
 
+void DynamicMesh::update_halo(double *field_) {
+  // The owned rows move every step, so there is no fixed halo to refresh
+  throw std::logic_error("Dynamic mesh cannot update the halo of an arbitrary field");
+}
+
+// Reflects around the rows the last step updated, before advance() moves on
 void DynamicMesh::reflect_boundary(int boundary_) {
   const int x_span = get_node_augmented_col_count();
-  const int core_rows = get_node_core_row_count();
+  const int core_rows = get_step_row_count();
   const int core_cols = get_node_core_col_count();
-  const int row_offset = get_current_row_offset();
+  const int row_offset = get_step_row_offset();
   const int col_offset = get_current_col_offset();
   switch (boundary_) {
     case (TOP): {
@@ -162,11 +214,7 @@ double * DynamicMesh::get_u0() { return _u0; }
 double * DynamicMesh::get_u1() { return _u1; }
 
 int DynamicMesh::get_current_row_offset() const {
-  if (_prograde && has_top_neighbour()) {
-    return 2;
-  } else {
-    return 1;
-  }
+  return phase_row_begin(_prograde) - _first_row;
 }
 
 int DynamicMesh::get_current_col_offset() const {
@@ -179,11 +227,7 @@ int DynamicMesh::get_current_col_offset() const {
 
 // Previous versions simply negate prograde
 int DynamicMesh::get_previous_row_offset() const {
-  if (!_prograde && has_top_neighbour()) {
-    return 2;
-  } else {
-    return 1;
-  }
+  return phase_row_begin(!_prograde) - _first_row;
 }
 
 int DynamicMesh::get_previous_col_offset() const {
@@ -202,28 +246,23 @@ double DynamicMesh::get_core_origin_x() const {
                                               _prograde);
 }
 double DynamicMesh::get_core_origin_y() const {
-  return get_del_y() * calculate_local_offset(get_node_row(),
-                                              get_vertical_nodes_count(),
-                                              get_world_core_row_count(),
-                                              _prograde);
+  return get_del_y() * phase_row_begin(_prograde);
 }
 
-// Invariant w.r.t. prograde/retrograde - deals with 'outer/padded' notation, i.e. just raw indexes
+// Varies given prograde/retrograde: the core starts at the current column
+// offset, 2 through a prograde phase with a left neighbour
 double DynamicMesh::get_x_coord(int col_) const {
-  return get_core_origin_x() + (col_ - 1) * get_del_x();
+  return get_core_origin_x() + (col_ - get_current_col_offset()) * get_del_x();
 }
 
 // Invariant w.r.t. prograde/retrograde - deals with 'outer/padded' notation, i.e. just raw indexes
 double DynamicMesh::get_y_coord(int row_) const {
-  return get_core_origin_y() + (row_ - 1) * get_del_y();
+  return (_first_row + row_) * get_del_y();
 }
 
 // Varies given prograde/retrograde
 int DynamicMesh::get_node_core_row_count() const {
-  return calculate_local_span(get_node_row(),
-                              get_vertical_nodes_count(),
-                              get_world_core_row_count(),
-                              _prograde);
+  return phase_row_end(_prograde) - phase_row_begin(_prograde);
 }
 // Varies given prograde/retrograde
 int DynamicMesh::get_node_core_col_count() const {
@@ -239,12 +278,11 @@ int DynamicMesh::get_node_core_cell_count() const {
 }
 // constant, invariant w.r.t. prograde/retrograde
 int DynamicMesh::get_node_augmented_row_count() const {
-  const int border_rows = 2;
-  const int unaugmented_rows = calculate_local_span(get_node_row(),
-                                                    get_vertical_nodes_count(),
-                                                    get_world_core_row_count());
-  const int additional_rows = has_top_neighbour() ? 1 : 0;
-  return unaugmented_rows + border_rows + additional_rows;
+  // Through the k rows received below a retrograde phase, or a ghost row
+  const int last_row = has_bottom_neighbour()
+      ? phase_row_end(true) + _depth
+      : static_cast<int>(get_world_core_row_count()) + 1;
+  return last_row - _first_row;
 }
 // constant, invariant w.r.t. prograde/retrograde
 int DynamicMesh::get_node_augmented_col_count() const {
@@ -260,3 +298,48 @@ int DynamicMesh::get_node_augmented_cell_count() const {
   return get_node_augmented_row_count()
        * get_node_augmented_col_count();
 }
+
+// The prograde split is balanced over the world rows plus k, so the rank
+// that owns k rows fewer in one phase is never one over in the other
+int DynamicMesh::phase_row_begin(bool prograde_) const {
+  if (!has_top_neighbour()) {
+    return 0;
+  }
+  const int begin = calculate_local_offset(get_node_row(),
+                                           get_vertical_nodes_count(),
+                                           static_cast<int>(get_world_core_row_count()) + _depth);
+  return prograde_ ? begin : begin - _depth;
+}
+
+int DynamicMesh::phase_row_end(bool prograde_) const {
+  if (!has_bottom_neighbour()) {
+    return static_cast<int>(get_world_core_row_count());
+  }
+  const int end = calculate_local_offset(get_node_row() + 1,
+                                         get_vertical_nodes_count(),
+                                         static_cast<int>(get_world_core_row_count()) + _depth);
+  return prograde_ ? end : end - _depth;
+}
+
+// Step j of a phase (from 0) updates k - 1 - j rows past each end it owns
+int DynamicMesh::step_row_begin() const {
+  if (!has_top_neighbour()) {
+    return 0;
+  }
+  return phase_row_begin(_prograde) - (_depth - 1 - _phase_step);
+}
+
+int DynamicMesh::step_row_end() const {
+  if (!has_bottom_neighbour()) {
+    return static_cast<int>(get_world_core_row_count());
+  }
+  return phase_row_end(_prograde) + (_depth - 1 - _phase_step);
+}
+
+int DynamicMesh::get_step_row_offset() const {
+  return step_row_begin() - _first_row;
+}
+
+int DynamicMesh::get_step_row_count() const {
+  return step_row_end() - step_row_begin();
+}
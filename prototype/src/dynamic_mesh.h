@@ -4,6 +4,14 @@
 #include <mpi.h>
 #include <vector>
 class ConfigFile;
+// Push/pull (time-space shifting) mesh over a vertical decomposition.
+// Steps run in phases of dynamic_depth (k, default 1) steps. Through a
+// prograde phase a rank owns its rows of a balanced split of the world rows
+// plus k (the last rank k fewer); through a retrograde phase every interior
+// boundary sits k rows nearer the origin. Each rank starts a phase holding
+// k rows past both ends of what it owns and updates one row fewer at each
+// end per step. So one message of 2k rows, down after a prograde phase and
+// up after a retrograde one, replaces the halo exchanges of k steps.
 class DynamicMesh : public DistributedMesh {
  public:
   DynamicMesh(const ConfigFile& config_,
@@ -13,6 +21,7 @@ class DynamicMesh : public DistributedMesh {
   virtual ~DynamicMesh();
   void advance();
   void reflect_boundary(int boundary_);
+  void update_halo(double *field_);
   double * get_u0();
   double * get_u1();
   double get_core_origin_x() const;
@@ -21,6 +30,8 @@ class DynamicMesh : public DistributedMesh {
   int get_current_col_offset() const;
   int get_previous_row_offset() const;
   int get_previous_col_offset() const;
+  int get_step_row_offset() const;
+  int get_step_row_count() const;
   double get_y_coord(int row_) const;
   double get_x_coord(int col_) const;
   int get_node_core_row_count() const;
@@ -33,6 +44,9 @@ class DynamicMesh : public DistributedMesh {
  private:
   // TODO rip out any unused members!
   bool _prograde;
+  int _depth;      // steps per phase
+  int _phase_step; // steps taken in this phase
+  int _first_row;  // global row of augmented row 0
   double *_u0;
   double *_u1;
   // core meaning not including boundaries, ghosts
@@ -44,5 +58,11 @@ class DynamicMesh : public DistributedMesh {
   int _node_augmented_row_count;
   int _node_augmented_col_count;
   void exchange_boundaries();
+  // Global rows [begin, end) owned through a prograde or retrograde phase
+  int phase_row_begin(bool prograde_) const;
+  int phase_row_end(bool prograde_) const;
+  // Global rows [begin, end) the next step updates
+  int step_row_begin() const;
+  int step_row_end() const;
 };
 #endif
@@ -0,0 +1,239 @@
+#include "ensemble_driver.h"
+
+#include <mpi.h>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "tools-inl.h"
+#include "ensemble_mesh.h"
+#include "static_mesh.h"
+#include "data_source.h"
+#include "vtk_writer.h"
+#include "compressed_writer.h"
+#include "field_allocator.h"
+
+namespace {
+  // Keys a member may set for itself
+  const char * const kMemberKeys[] = {
+    "timestep", "diffusivity", "subregions", "subregion_values", "initial_field"
+  };
+  const int kMemberKeyCount = sizeof(kMemberKeys) / sizeof(kMemberKeys[0]);
+}
+
+EnsembleDriver::EnsembleDriver(const ConfigFile& config_) : _config(config_),
+                                                            _topology(config_) {
+  _debug = _config.get_or_default("debug", false);
+  _visualize = _config.get_or_default("visualize", true);
+  _performance_report = _config.get_or_default("performance_report", false);
+  _name = _config.get_or_default("name", std::string("prototype"));
+  _output_rate = _config.get_or_default("output_rate", 1);
+  _output_format = _config.get_or_default("output_format", std::string("vtk"));
+  _compression_error_bound = _config.get_or_default("compression_error_bound", 0.0);
+  _t_start = _config.get_or_default("start_time", 0.0);
+  _t_end = _config.get_or_default("end_time", 2.0);
+  const int members = _config.get_or_default("ensemble_members", 0);
+  if (_config.get_or_default("scheme", std::string("explicit")) != "explicit"
+      || _config.get_or_default("mesh_type", std::string("static")) != "static"
+      || _config.get_or_default("logical_dimensions", std::vector<int>()).size() > 2) {
+    throw std::logic_error("Ensembles run the explicit scheme on a 2D static mesh");
+  }
+  if (_output_format != "vtk" && _output_format != "compressed") {
+    std::stringstream ss;
+    ss << "Unknown output format: " << _output_format << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  // Establish MPI topology, as Driver does
+  _dim_nodes = _config.get_or_default("dim_nodes", std::vector<int>());
+  _dim_periods = _config.get_or_default("dim_periods", std::vector<int>());
+  _dim_nodes.resize(2, 0);
+  _dim_periods.resize(2, 0);
+  MPI_Comm_size(MPI_COMM_WORLD, &_world_size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &_world_rank);
+  MPI_Dims_create(_world_size, 2, &_dim_nodes[0]);
+  _cart_comm = _topology.create_cart(MPI_COMM_WORLD, _dim_nodes, _dim_periods,
+                                     _config.get_or_default("mpi_reorder", true));
+  _mesh = new EnsembleMesh(_config, _cart_comm, _dim_nodes, members);
+  _mesh->set_profiler(&_profiler);
+  _scratch = new StaticMesh(_config, _cart_comm, _dim_nodes);
+  if (_performance_report) {
+    _topology.report(*_mesh, std::cout);
+  }
+  const double dx = _mesh->get_del_x();
+  const double dy = _mesh->get_del_y();
+  _members.resize(members);
+  _centre.resize(members);
+  _rx.resize(members);
+  _ry.resize(members);
+  for (int m = 0; m < members; ++m) {
+    Member& member = _members[m];
+    member.config = _config;
+    for (int k = 0; k < kMemberKeyCount; ++k) {
+      std::stringstream key;
+      key << "ensemble." << m << "." << kMemberKeys[k];
+      const std::string value = _config.get_line_or_default(key.str(), "");
+      if (!value.empty()) {
+        member.config.set(kMemberKeys[k], value);
+      }
+    }
+    member.del_t = member.config.get_or_default("timestep", 0.02);
+    member.diffusivity = member.config.get_or_default("diffusivity", 1.0);
+    member.t_now = _t_start;
+    member.step = 0;
+    member.running = member.t_now < _t_end; // doublecompare
+    // As Calculation::diffuse forms them, so a member matches its own run
+    _rx[m] = member.diffusivity * member.del_t / (dx * dx);
+    _ry[m] = member.diffusivity * member.del_t / (dy * dy);
+    _centre[m] = 1.0 - 2.0*_rx[m] - 2.0*_ry[m];
+    DataSource ds(member.config);
+    ds.populate(_scratch);
+    _mesh->load_member(m, _scratch->get_u0());
+    std::stringstream tag;
+    tag << _name << "_ensemble" << m;
+    if (_output_format == "vtk") {
+      member.writer = new VtkWriter(tag.str(), _scratch, _world_rank, _world_size);
+    } else {
+      member.writer = new CompressedWriter(tag.str(), _scratch, _world_rank, _world_size,
+                                           _compression_error_bound);
+    }
+  }
+}
+
+EnsembleDriver::~EnsembleDriver() {
+  for (std::size_t m = 0; m < _members.size(); ++m) {
+    delete _members[m].writer;
+  }
+  delete _scratch;
+  delete _mesh;
+  MPI_Comm_free(&_cart_comm);
+}
+
+void EnsembleDriver::run() {
+  const int members = _members.size();
+  double wall_start, wall_stop;
+  double cpu_start, cpu_stop;
+  if (_debug) {
+    std::cout << " ++ RUN BEGINNING ++ " << std::endl;
+  }
+  timers(wall_start, cpu_start); // start timing
+  int running = 0;
+  for (int m = 0; m < members; ++m) {
+    if (_members[m].running) {
+      ++running;
+    } else {
+      finish(m);
+    }
+  }
+  while (running > 0) {
+    for (int m = 0; m < members; ++m) {
+      if (_members[m].running && _members[m].step % _output_rate == 0) {
+        write(m);
+      }
+    }
+    {
+      ScopedPhase phase(&_profiler, COMPUTE);
+      diffuse();
+    }
+    _profiler.count_cell_updates(1L * _mesh->get_node_core_cell_count() * running);
+    _mesh->advance();
+    for (int m = 0; m < members; ++m) {
+      Member& member = _members[m];
+      if (!member.running) {
+        continue;
+      }
+      ++member.step;
+      member.t_now += member.del_t;
+      if (!(member.t_now < _t_end)) { // doublecompare
+        finish(m);
+        --running;
+      }
+    }
+  }
+  timers(wall_stop, cpu_stop); // stop timing
+  if (_debug) {
+    std::cout << " ++ RUN FINISHING ++ " << std::endl;
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+  if (_world_rank == 0) {
+    std::cout << "Timings: wallclock:" << (wall_stop - wall_start) << "s\n"
+                 "         cpu clock:" << (cpu_stop - cpu_start) << "\n"
+                 "         members:" << members << std::endl;
+  }
+  _profiler.report(MPI_COMM_WORLD, std::cout);
+  if (_performance_report) {
+    FieldAllocator::report(MPI_COMM_WORLD, std::cout);
+  }
+}
+
+void EnsembleDriver::diffuse() {
+  double *u0 = _mesh->get_u0();
+  double *u1 = _mesh->get_u1();
+  const int members = _members.size();
+  const int x_span = _mesh->get_node_augmented_col_count();
+  const int core_rows = _mesh->get_node_core_row_count();
+  const int core_cols = _mesh->get_node_core_col_count();
+  const double *centre = &_centre[0];
+  const double *rx = &_rx[0];
+  const double *ry = &_ry[0];
+  const int row = x_span * members;
+  for (int i = 1; i < core_rows + 1; ++i) {
+    for (int j = 1; j < core_cols + 1; ++j) {
+      const int cell = (i * x_span + j) * members;
+      const double *c = &u0[cell];
+      double *out = &u1[cell];
+      // The same expression, term for term, as Calculation::diffuse
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for (int m = 0; m < members; ++m) {
+        out[m] = centre[m] * c[m] + rx[m] * c[m - members]
+               + rx[m] * c[m + members] + ry[m] * c[m - row] + ry[m] * c[m + row];
+      }
+    }
+  }
+}
+
+// Writes the member's last state and freezes it: with no flux and a unit
+// centre weight the stencil copies it from step to step
+void EnsembleDriver::finish(int member_) {
+  write(member_);
+  _members[member_].running = false;
+  _rx[member_] = 0;
+  _ry[member_] = 0;
+  _centre[member_] = 1;
+}
+
+void EnsembleDriver::write(int member_) {
+  const Member& member = _members[member_];
+  if (!_visualize && !_debug) {
+    return;
+  }
+  ScopedPhase phase(&_profiler, OUTPUT);
+  _mesh->store_member(member_, _scratch->get_u0());
+  if (_visualize) {
+    member.writer->write(member.step, member.t_now);
+  }
+  if (_debug) {
+    double temp = member_temp(member_);
+    double global_temp = 0;
+    MPI_Reduce(&temp, &global_temp, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (_world_rank == 0) {
+      std::cout << " Member " << member_ << " step " << member.step
+                << ",\n\ttnow = " << member.t_now
+                << "\n\ttotal temp:" << global_temp << std::endl;
+    }
+  }
+}
+
+// Of the member last stored into the scratch mesh
+double EnsembleDriver::member_temp(int member_) {
+  double total = 0;
+  const double *u0 = _scratch->get_u0();
+  const int x_span = _scratch->get_node_augmented_col_count();
+  for (int i = 1; i < _scratch->get_node_core_row_count() + 1; ++i) {
+    for (int j = 1; j < _scratch->get_node_core_col_count() + 1; ++j) {
+      total += u0[i * x_span + j];
+    }
+  }
+  return total;
+}
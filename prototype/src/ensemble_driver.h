@@ -0,0 +1,75 @@
+#ifndef ENSEMBLE_DRIVER_H
+#define ENSEMBLE_DRIVER_H
+
+#include <mpi.h>
+#include <string>
+#include <vector>
+
+#include "config_file.h"
+#include "profiler.h"
+#include "topology_mapper.h"
+
+class EnsembleMesh;
+class StaticMesh;
+class Writer;
+// Runs several independent explicit 2D simulations of one domain together,
+// in place of Driver when ensemble_members is set:
+//   ensemble_members     - the number of members
+//   ensemble.<m>.<key>   - member m's value of timestep, diffusivity,
+//                          subregions, subregion_values or initial_field,
+//                          overriding the value shared by all members
+//   diffusivity          - scales the stencil (1), as Calculation does for
+//                          a standalone run
+// Members are stepped in lockstep on one EnsembleMesh; a member with a
+// larger timestep finishes early and is then carried along unchanged.
+// Member m is written as <name>_ensemble<m>.
+class EnsembleDriver {
+ public:
+  EnsembleDriver(const ConfigFile& config_);
+  ~EnsembleDriver();
+  void run();
+
+ private:
+  struct Member {
+    ConfigFile config;
+    double del_t;
+    double diffusivity;
+    double t_now;
+    int step;
+    bool running;
+    Writer *writer;
+  };
+  // One step of every member, finished ones included
+  void diffuse();
+  void finish(int member_);
+  void write(int member_);
+  double member_temp(int member_);
+
+  const ConfigFile& _config;
+  bool _debug;
+  bool _visualize;
+  bool _performance_report;
+  std::string _name;
+  std::string _output_format;
+  double _compression_error_bound;
+  int _output_rate;
+  double _t_start;
+  double _t_end;
+  std::vector<Member> _members;
+  // Stencil coefficients per member, interleaved like the fields
+  std::vector<double> _centre;
+  std::vector<double> _rx;
+  std::vector<double> _ry;
+  EnsembleMesh * _mesh;
+  // Single member mesh of the same decomposition, to populate and write
+  // one member at a time
+  StaticMesh * _scratch;
+  Profiler _profiler;
+  TopologyMapper _topology;
+  std::vector<int> _dim_nodes;
+  std::vector<int> _dim_periods;
+  MPI_Comm _cart_comm;
+  int _world_size;
+  int _world_rank;
+};
+#endif
@@ -0,0 +1,231 @@
+#include "ensemble_mesh.h"
+
+#include <mpi.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include "tools-inl.h"
+#include "config_file.h"
+#include "profiler.h"
+#include "tracer.h"
+
+EnsembleMesh::EnsembleMesh(const ConfigFile& config_,
+                           MPI_Comm cart_comm_,
+                           const std::vector<int>& dim_nodes_,
+                           int members_) : DistributedMesh(config_,
+                                                           cart_comm_,
+                                                           dim_nodes_),
+                                           _members(members_) {
+  if (_members < 1) {
+    throw std::logic_error("An ensemble needs at least one member");
+  }
+  _node_core_row_count = calculate_local_span(get_node_row(),
+                                              get_vertical_nodes_count(),
+                                              get_world_core_row_count());
+  _node_core_col_count = calculate_local_span(get_node_col(),
+                                              get_horizontal_nodes_count(),
+                                              get_world_core_col_count());
+  _core_origin_y = get_del_y() * calculate_local_offset(get_node_row(),
+                                                        get_vertical_nodes_count(),
+                                                        get_world_core_row_count());
+  _core_origin_x = get_del_x() * calculate_local_offset(get_node_col(),
+                                                        get_horizontal_nodes_count(),
+                                                        get_world_core_col_count());
+  _node_augmented_row_count = _node_core_row_count + 2;
+  _node_augmented_col_count = _node_core_col_count + 2;
+  const long elements = 1L * get_node_augmented_cell_count() * _members;
+  _u0 = _field_allocator.allocate(elements);
+  _u1 = _field_allocator.allocate(elements);
+  // A core row of every member is contiguous; a core column is one block
+  // of members per row
+  MPI_Type_contiguous(_node_core_col_count * _members, MPI_DOUBLE, &_row_type);
+  MPI_Type_commit(&_row_type);
+  MPI_Type_vector(_node_core_row_count,
+                  _members,
+                  _node_augmented_col_count * _members,
+                  MPI_DOUBLE,
+                  &_col_type);
+  MPI_Type_commit(&_col_type);
+}
+
+EnsembleMesh::~EnsembleMesh() {
+  MPI_Type_free(&_row_type);
+  MPI_Type_free(&_col_type);
+  _field_allocator.release(_u0);
+  _field_allocator.release(_u1);
+}
+
+void EnsembleMesh::load_member(int member_, const double *field_) {
+  const int cells = get_node_augmented_cell_count();
+  for (int c = 0; c < cells; ++c) {
+    _u0[c * _members + member_] = field_[c];
+  }
+}
+
+void EnsembleMesh::store_member(int member_, double *field_) const {
+  const int cells = get_node_augmented_cell_count();
+  for (int c = 0; c < cells; ++c) {
+    field_[c] = _u0[c * _members + member_];
+  }
+}
+
+void EnsembleMesh::reflect_boundary(int boundary_) {
+  // n.b. use u1 as we're in the current timestep
+  reflect_field(boundary_, _u1);
+}
+
+void EnsembleMesh::reflect_field(int boundary_, double *field_) {
+  const int x_span = get_node_augmented_col_count();
+  // Ghost cells and the core cells they mirror, stepping along the side
+  int ghost, center, stride, count;
+  switch (boundary_) {
+    case (TOP):
+      ghost = 1;
+      center = x_span + 1;
+      stride = 1;
+      count = get_node_core_col_count();
+      break;
+    case (BOTTOM):
+      ghost = (get_node_core_row_count() + 1) * x_span + 1;
+      center = get_node_core_row_count() * x_span + 1;
+      stride = 1;
+      count = get_node_core_col_count();
+      break;
+    case (LEFT):
+      ghost = x_span;
+      center = x_span + 1;
+      stride = x_span;
+      count = get_node_core_row_count();
+      break;
+    default: // RIGHT
+      ghost = x_span + get_node_core_col_count() + 1;
+      center = x_span + get_node_core_col_count();
+      stride = x_span;
+      count = get_node_core_row_count();
+      break;
+  }
+  for (int c = 0; c < count; ++c) {
+    std::copy(&field_[(center + c * stride) * _members],
+              &field_[(center + c * stride + 1) * _members],
+              &field_[(ghost + c * stride) * _members]);
+  }
+}
+
+void EnsembleMesh::advance() {
+  update_halo(_u1);
+  // Now we've finished updating u1, we can swap it to u0
+  std::swap(_u0, _u1);
+}
+
+void EnsembleMesh::update_halo(double *field_) {
+  {
+    ScopedPhase phase(_profiler, REFLECT);
+    if (!has_top_neighbour()) {
+      reflect_field(TOP, field_);
+    }
+    if (!has_bottom_neighbour()) {
+      reflect_field(BOTTOM, field_);
+    }
+    if (!has_left_neighbour()) {
+      reflect_field(LEFT, field_);
+    }
+    if (!has_right_neighbour()) {
+      reflect_field(RIGHT, field_);
+    }
+  }
+  exchange_field(field_);
+}
+
+void EnsembleMesh::exchange_boundaries() {
+  exchange_field(_u1);
+}
+
+void EnsembleMesh::exchange_field(double *field_) {
+  const int x_span = get_node_augmented_col_count();
+  const int rows = get_node_core_row_count();
+  const int cols = get_node_core_col_count();
+  // Per side: the core cell sent from, the ghost cell received into and
+  // the datatype, all members of a side going as one message
+  const int sides[4] = { TOP, LEFT, BOTTOM, RIGHT };
+  const int opposite[4] = { BOTTOM, RIGHT, TOP, LEFT };
+  const int send_cell[4] = { x_span + 1, x_span + 1, rows * x_span + 1, x_span + cols };
+  const int recv_cell[4] = { 1, x_span, (rows + 1) * x_span + 1, x_span + cols + 1 };
+  const MPI_Datatype types[4] = { _row_type, _col_type, _row_type, _col_type };
+  const double bytes[4] = { 1.0 * cols * _members * sizeof(double),
+                            1.0 * rows * _members * sizeof(double),
+                            1.0 * cols * _members * sizeof(double),
+                            1.0 * rows * _members * sizeof(double) };
+  MPI_Request requests[8];
+  int peers[4];
+  double message_bytes[4];
+  int paircount = 0;
+  double halo_bytes = 0;
+  {
+    ScopedPhase phase(_profiler, HALO_POST);
+    for (int s = 0; s < 4; ++s) {
+      const int rank = get_neighbour_rank(sides[s]);
+      if (rank < 0) {
+        continue;
+      }
+      MPI_Irecv(&field_[recv_cell[s] * _members], 1, types[s], rank, opposite[s],
+                _cart_comm, &requests[paircount]);
+      MPI_Isend(&field_[send_cell[s] * _members], 1, types[s], rank, sides[s],
+                _cart_comm, &requests[4 + paircount]);
+      peers[paircount] = rank;
+      message_bytes[paircount] = bytes[s];
+      trace_message(SEND_POST, rank, bytes[s]);
+      trace_message(RECV_POST, rank, bytes[s]);
+      halo_bytes += 2 * bytes[s];
+      ++paircount;
+    }
+  }
+  ScopedPhase phase(_profiler, HALO_WAIT);
+  MPI_Waitall(paircount, requests, MPI_STATUSES_IGNORE);
+  for (int req = 0; req < paircount; ++req) {
+    trace_message(RECV_COMPLETE, peers[req], message_bytes[req]);
+  }
+  // The sends read u1, which the step after next overwrites
+  MPI_Waitall(paircount, &requests[4], MPI_STATUSES_IGNORE);
+  if (_profiler) {
+    _profiler->count_halo_bytes(halo_bytes);
+  }
+}
+
+double * EnsembleMesh::get_u0() { return _u0; }
+double * EnsembleMesh::get_u1() { return _u1; }
+int EnsembleMesh::get_member_count() const { return _members; }
+int EnsembleMesh::get_node_core_row_count() const { return _node_core_row_count; }
+int EnsembleMesh::get_node_core_col_count() const { return _node_core_col_count; }
+int EnsembleMesh::get_node_augmented_row_count() const { return _node_augmented_row_count; }
+int EnsembleMesh::get_node_augmented_col_count() const { return _node_augmented_col_count; }
+int EnsembleMesh::get_node_core_cell_count() const {
+  return get_node_core_row_count() * get_node_core_col_count();
+}
+
+int EnsembleMesh::get_node_augmented_cell_count() const {
+  return get_node_augmented_row_count() * get_node_augmented_col_count();
+}
+
+int EnsembleMesh::get_current_row_offset() const {
+  return 1;
+}
+
+int EnsembleMesh::get_current_col_offset() const {
+  return 1;
+}
+
+int EnsembleMesh::get_previous_row_offset() const {
+  return 1;
+}
+
+int EnsembleMesh::get_previous_col_offset() const {
+  return 1;
+}
+
+double EnsembleMesh::get_y_coord(int row_) const {
+  return _core_origin_y + (row_ - 1) * get_del_y();
+}
+
+double EnsembleMesh::get_x_coord(int col_) const {
+  return _core_origin_x + (col_ - 1) * get_del_x();
+}
@@ -0,0 +1,59 @@
+#ifndef ENSEMBLE_MESH_H
+#define ENSEMBLE_MESH_H
+#include "distributed_mesh.h"
+#include <mpi.h>
+#include <vector>
+class ConfigFile;
+// A static 2D mesh holding the fields of several ensemble members at once,
+// interleaved: member m of augmented cell c is element c * members + m. A
+// kernel sweeping the members of a cell innermost vectorizes across them,
+// and each halo exchange sends all members in one message per neighbour.
+// Cell counts and offsets are those of one member.
+class EnsembleMesh : public DistributedMesh {
+ public:
+  EnsembleMesh(const ConfigFile& config_,
+               MPI_Comm cart_comm_,
+               const std::vector<int>& dim_nodes_,
+               int members_);
+  virtual ~EnsembleMesh();
+
+  void advance();
+  void reflect_boundary(int boundary_);
+  void update_halo(double *field_);
+  double * get_u0();
+  double * get_u1();
+  int get_member_count() const;
+  // Copies one member's augmented field, laid out as a single member mesh
+  // of the same decomposition, into u0, or out of it
+  void load_member(int member_, const double *field_);
+  void store_member(int member_, double *field_) const;
+  int get_node_core_row_count() const;
+  int get_node_core_col_count() const;
+  int get_node_augmented_row_count() const;
+  int get_node_augmented_col_count() const;
+  int get_node_core_cell_count() const;
+  int get_node_augmented_cell_count() const;
+  int get_current_row_offset() const;
+  int get_current_col_offset() const;
+  int get_previous_row_offset() const;
+  int get_previous_col_offset() const;
+  double get_y_coord(int row_) const;
+  double get_x_coord(int col_) const;
+
+ private:
+  int _members;
+  double *_u0;
+  double *_u1;
+  MPI_Datatype _row_type;
+  MPI_Datatype _col_type;
+  int _node_core_row_count;
+  int _node_core_col_count;
+  double _core_origin_x;
+  double _core_origin_y;
+  int _node_augmented_row_count;
+  int _node_augmented_col_count;
+  void exchange_boundaries();
+  void reflect_field(int boundary_, double *field_);
+  void exchange_field(double *field_);
+};
+#endif
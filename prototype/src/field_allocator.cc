@@ -0,0 +1,382 @@
+#include "field_allocator.h"
+
+#include <mpi.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "config_file.h"
+
+namespace {
+  struct Block {
+    double *field;
+    void *base;           // what to free or unmap
+    long count;
+    size_t mapped_bytes;  // 0 for heap blocks
+    long alignment;
+    int huge_pages;       // as requested
+    int numa_policy;
+    bool hugetlb;         // explicit huge pages were obtained
+    bool in_use;
+  };
+
+  // Every field ever allocated, in use or pooled
+  class Pool {
+   public:
+    Pool() : explicit_fallbacks(0), numa_failures(0) {}
+    ~Pool() { drain(); }
+    void drain();
+    std::vector<Block> blocks;
+    long explicit_fallbacks;
+    long numa_failures;
+  };
+
+  Pool pool;
+
+  void free_block(const Block& block_) {
+    if (block_.mapped_bytes) {
+      munmap(block_.base, block_.mapped_bytes);
+    } else {
+      free(block_.base);
+    }
+  }
+
+  void Pool::drain() {
+    std::vector<Block> kept;
+    for (size_t b = 0; b < blocks.size(); ++b) {
+      if (blocks[b].in_use) {
+        kept.push_back(blocks[b]);
+      } else {
+        free_block(blocks[b]);
+      }
+    }
+    blocks.swap(kept);
+  }
+
+  size_t base_page_size() {
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  }
+
+  // The PMD size transparent huge pages come in
+  size_t transparent_page_size() {
+    std::ifstream ifs("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size");
+    size_t bytes = 0;
+    if (!(ifs >> bytes) || bytes == 0) {
+      bytes = 2 << 20;
+    }
+    return bytes;
+  }
+
+  // Default size of the hugetlbfs pool MAP_HUGETLB draws from
+  size_t explicit_page_size() {
+    std::ifstream ifs("/proc/meminfo");
+    std::string line;
+    while (std::getline(ifs, line)) {
+      long kb;
+      if (std::sscanf(line.c_str(), "Hugepagesize: %ld kB", &kb) == 1) {
+        return static_cast<size_t>(kb) << 10;
+      }
+    }
+    return 2 << 20;
+  }
+
+  size_t round_up(size_t bytes_, size_t unit_) {
+    return (bytes_ + unit_ - 1) / unit_ * unit_;
+  }
+
+  // Highest online NUMA node, from /sys (0 without NUMA support)
+  int max_numa_node() {
+    std::ifstream ifs("/sys/devices/system/node/online");
+    std::string ranges;
+    ifs >> ranges;
+    int highest = 0;
+    std::istringstream iss(ranges);
+    std::string range;
+    while (std::getline(iss, range, ',')) {
+      int first = 0;
+      int last = 0;
+      int matched = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+      highest = std::max(highest, matched == 2 ? last : first);
+    }
+    return highest;
+  }
+
+  // mbind through the syscall, saving a link against libnuma
+  bool apply_numa_policy(void *base_, size_t bytes_, int policy_) {
+    if (policy_ == FieldAllocator::NUMA_DEFAULT) {
+      return true;
+    }
+    long result;
+    if (policy_ == FieldAllocator::NUMA_LOCAL) {
+      // MPOL_PREFERRED with an empty mask means the node of the touching CPU
+      result = syscall(SYS_mbind, base_, bytes_, MPOL_PREFERRED, 0, 0, 0);
+    } else {
+      const int nodes = max_numa_node() + 1;
+      const int bits = 8 * sizeof(unsigned long);
+      std::vector<unsigned long> mask((nodes + bits - 1) / bits, 0);
+      for (int node = 0; node < nodes; ++node) {
+        mask[node / bits] |= 1UL << (node % bits);
+      }
+      result = syscall(SYS_mbind, base_, bytes_, MPOL_INTERLEAVE, &mask[0],
+                       static_cast<unsigned long>(nodes + 1), 0);
+    }
+    return result == 0;
+  }
+
+  // Anonymous mapping aligned to its huge page size, so whole huge pages fit
+  void * map_aligned(size_t bytes_, size_t alignment_, size_t& mapped_) {
+    const size_t span = bytes_ + alignment_;
+    char *raw = static_cast<char *>(mmap(0, span, PROT_READ | PROT_WRITE,
+                                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (raw == MAP_FAILED) {
+      return 0;
+    }
+    const size_t head = (alignment_ - reinterpret_cast<size_t>(raw) % alignment_) % alignment_;
+    if (head) {
+      munmap(raw, head);
+    }
+    const size_t tail = span - head - bytes_;
+    if (tail) {
+      munmap(raw + head + bytes_, tail);
+    }
+    mapped_ = bytes_;
+    return raw + head;
+  }
+
+  // Bytes of [begin_, end_) the kernel backs with transparent huge pages,
+  // from the AnonHugePages of the /proc/self/smaps entries overlapping it
+  size_t transparent_huge_bytes(size_t begin_, size_t end_) {
+    std::ifstream ifs("/proc/self/smaps");
+    std::string line;
+    size_t overlap = 0;
+    size_t huge = 0;
+    while (std::getline(ifs, line)) {
+      unsigned long from;
+      unsigned long to;
+      long kb;
+      if (std::sscanf(line.c_str(), "%lx-%lx ", &from, &to) == 2
+          && line.find(':') > line.find(' ')) {
+        const size_t lo = std::max(static_cast<size_t>(from), begin_);
+        const size_t hi = std::min(static_cast<size_t>(to), end_);
+        overlap = lo < hi ? hi - lo : 0;
+      } else if (overlap && std::sscanf(line.c_str(), "AnonHugePages: %ld kB", &kb) == 1) {
+        huge += std::min(overlap, static_cast<size_t>(kb) << 10);
+      }
+    }
+    return huge;
+  }
+
+  const char * huge_pages_name(int huge_pages_) {
+    switch (huge_pages_) {
+      case FieldAllocator::HUGE_TRANSPARENT: return "transparent";
+      case FieldAllocator::HUGE_EXPLICIT: return "explicit";
+      default: return "none";
+    }
+  }
+
+  const char * numa_policy_name(int policy_) {
+    switch (policy_) {
+      case FieldAllocator::NUMA_LOCAL: return "local";
+      case FieldAllocator::NUMA_INTERLEAVE: return "interleave";
+      default: return "default";
+    }
+  }
+}
+
+FieldAllocator::FieldAllocator(const ConfigFile& config_) {
+  _alignment = config_.get_or_default("field_alignment", 64L);
+  if (_alignment < static_cast<long>(sizeof(double)) || _alignment > 4096
+      || (_alignment & (_alignment - 1))) {
+    throw std::logic_error("field_alignment must be a power of two between 8 and 4096");
+  }
+  std::string huge_pages = config_.get_or_default("field_huge_pages",
+                                                  std::string("transparent"));
+  if (huge_pages == "none") {
+    _huge_pages = HUGE_NONE;
+  } else if (huge_pages == "transparent") {
+    _huge_pages = HUGE_TRANSPARENT;
+  } else if (huge_pages == "explicit") {
+    _huge_pages = HUGE_EXPLICIT;
+  } else {
+    std::stringstream ss;
+    ss << "Unknown field_huge_pages: " << huge_pages << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  _huge_page_threshold = config_.get_or_default("field_huge_page_threshold", 2L << 20);
+  std::string numa_policy = config_.get_or_default("field_numa_policy",
+                                                   std::string("default"));
+  if (numa_policy == "default") {
+    _numa_policy = NUMA_DEFAULT;
+  } else if (numa_policy == "local") {
+    _numa_policy = NUMA_LOCAL;
+  } else if (numa_policy == "interleave") {
+    _numa_policy = NUMA_INTERLEAVE;
+  } else {
+    std::stringstream ss;
+    ss << "Unknown field_numa_policy: " << numa_policy << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  _pool = config_.get_or_default("field_pool", true);
+}
+
+FieldAllocator::~FieldAllocator() {}
+
+double * FieldAllocator::allocate(long count_) {
+  const size_t bytes = count_ * sizeof(double);
+  const bool mapped = _huge_pages != HUGE_NONE
+                      && static_cast<long>(bytes) >= _huge_page_threshold;
+  for (size_t b = 0; b < pool.blocks.size(); ++b) {
+    Block& block = pool.blocks[b];
+    if (!block.in_use && block.count == count_ && block.alignment == _alignment
+        && block.huge_pages == (mapped ? _huge_pages : HUGE_NONE)
+        && block.numa_policy == _numa_policy) {
+      block.in_use = true;
+      return block.field;
+    }
+  }
+  Block block;
+  block.count = count_;
+  block.alignment = _alignment;
+  block.huge_pages = mapped ? _huge_pages : HUGE_NONE;
+  block.numa_policy = _numa_policy;
+  block.hugetlb = false;
+  block.in_use = true;
+  block.mapped_bytes = 0;
+  block.base = 0;
+  if (mapped && _huge_pages == HUGE_EXPLICIT) {
+    const size_t length = round_up(bytes, explicit_page_size());
+    void *base = mmap(0, length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (base != MAP_FAILED) {
+      block.base = base;
+      block.mapped_bytes = length;
+      block.hugetlb = true;
+    } else {
+      ++pool.explicit_fallbacks;
+    }
+  }
+  if (mapped && !block.base) {
+    const size_t huge = transparent_page_size();
+    block.base = map_aligned(round_up(bytes, huge), huge, block.mapped_bytes);
+    if (!block.base) {
+      throw std::bad_alloc();
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(block.base, block.mapped_bytes, MADV_HUGEPAGE);
+#endif
+  }
+  if (mapped) {
+    if (!apply_numa_policy(block.base, block.mapped_bytes, _numa_policy)) {
+      ++pool.numa_failures;
+    }
+  } else if (posix_memalign(&block.base, _alignment, bytes ? bytes : sizeof(double))) {
+    throw std::bad_alloc();
+  }
+  block.field = static_cast<double *>(block.base);
+  pool.blocks.push_back(block);
+  return block.field;
+}
+
+void FieldAllocator::release(double *field_) {
+  if (!field_) {
+    return;
+  }
+  for (size_t b = 0; b < pool.blocks.size(); ++b) {
+    Block& block = pool.blocks[b];
+    if (block.field == field_) {
+      block.in_use = false;
+      if (!_pool) {
+        free_block(block);
+        pool.blocks.erase(pool.blocks.begin() + b);
+      }
+      return;
+    }
+  }
+  throw std::logic_error("Releasing a field the FieldAllocator did not allocate");
+}
+
+void FieldAllocator::drain_pool() {
+  pool.drain();
+}
+
+double FieldAllocator::get_bytes_in_use() {
+  double bytes = 0;
+  for (size_t b = 0; b < pool.blocks.size(); ++b) {
+    if (pool.blocks[b].in_use) {
+      bytes += 1.0 * pool.blocks[b].count * sizeof(double);
+    }
+  }
+  return bytes;
+}
+
+void FieldAllocator::report(MPI_Comm comm_, std::ostream& os_) {
+  // bytes in use, on explicit huge pages, on transparent huge pages,
+  // pooled but unused, then the event counters
+  double local[6] = {0, 0, 0, 0, 0, 0};
+  int huge_pages = HUGE_NONE;
+  int numa_policy = NUMA_DEFAULT;
+  long alignment = 0;
+  for (size_t b = 0; b < pool.blocks.size(); ++b) {
+    const Block& block = pool.blocks[b];
+    const double bytes = 1.0 * block.count * sizeof(double);
+    if (!block.in_use) {
+      local[3] += bytes;
+      continue;
+    }
+    local[0] += bytes;
+    huge_pages = std::max(huge_pages, block.huge_pages);
+    numa_policy = std::max(numa_policy, block.numa_policy);
+    alignment = std::max(alignment, block.alignment);
+    if (block.hugetlb) {
+      local[1] += bytes;
+    } else if (block.mapped_bytes) {
+      const size_t begin = reinterpret_cast<size_t>(block.base);
+      local[2] += std::min(bytes, 1.0 * transparent_huge_bytes(begin, begin + block.mapped_bytes));
+    }
+  }
+  local[4] = pool.explicit_fallbacks;
+  local[5] = pool.numa_failures;
+  double global[6];
+  MPI_Reduce(local, global, 6, MPI_DOUBLE, MPI_SUM, 0, comm_);
+  // The least huge-page coverage of any rank points at the slow one
+  double coverage = local[0] > 0 ? (local[1] + local[2]) / local[0] : 0;
+  double min_coverage = 0;
+  MPI_Reduce(&coverage, &min_coverage, 1, MPI_DOUBLE, MPI_MIN, 0, comm_);
+  int rank;
+  MPI_Comm_rank(comm_, &rank);
+  if (rank != 0) {
+    return;
+  }
+  const double mib = 1024.0 * 1024.0;
+  const double base_bytes = global[0] - global[1] - global[2];
+  os_ << "Fields: " << std::fixed << std::setprecision(1) << global[0] / mib
+      << " MiB in use, " << global[3] / mib << " MiB pooled (alignment " << alignment
+      << " B, huge pages " << huge_pages_name(huge_pages) << ", numa "
+      << numa_policy_name(numa_policy) << ")\n";
+  os_ << "  pages: " << global[1] / mib << " MiB on " << (explicit_page_size() >> 10)
+      << " kB explicit, " << global[2] / mib << " MiB on " << (transparent_page_size() >> 10)
+      << " kB transparent, " << base_bytes / mib << " MiB on " << (base_page_size() >> 10)
+      << " kB; least huge coverage of a rank " << std::setprecision(0)
+      << 100.0 * min_coverage << "%\n";
+  if (global[4] > 0) {
+    os_ << "  " << static_cast<long>(global[4])
+        << " explicit huge page allocations fell back to transparent\n";
+  }
+  if (global[5] > 0) {
+    os_ << "  " << static_cast<long>(global[5]) << " NUMA policies could not be applied\n";
+  }
+  os_.unsetf(std::ios::floatfield);
+  os_ << std::setprecision(6) << std::flush;
+}
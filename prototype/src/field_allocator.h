@@ -0,0 +1,54 @@
+#ifndef FIELD_ALLOCATOR_H
+#define FIELD_ALLOCATOR_H
+
+#include <mpi.h>
+#include <ostream>
+#include <string>
+
+class ConfigFile;
+// Allocates the augmented fields of the meshes, configured by
+//   field_alignment             - bytes, a power of two up to 4096 (64)
+//   field_huge_pages            - none, transparent (mmap + MADV_HUGEPAGE)
+//                                 or explicit (MAP_HUGETLB, falling back to
+//                                 transparent when the pool is empty)
+//   field_huge_page_threshold   - smaller fields stay on the aligned heap
+//   field_numa_policy           - default, local or interleave (mapped
+//                                 fields only)
+//   field_pool                  - keep released fields for reuse
+// Released fields go to a process-wide pool and are handed to the next
+// allocation of the same size and policy, so meshes that are rebuilt
+// (multigrid levels, repeated runs) do not go back to the kernel.
+class FieldAllocator {
+ public:
+  enum HugePages {
+    HUGE_NONE = 0,
+    HUGE_TRANSPARENT = 1,
+    HUGE_EXPLICIT = 2,
+  };
+  enum NumaPolicy {
+    NUMA_DEFAULT = 0,
+    NUMA_LOCAL = 1,
+    NUMA_INTERLEAVE = 2,
+  };
+
+  FieldAllocator(const ConfigFile& config_);
+  ~FieldAllocator();
+  // count_ doubles, uninitialised
+  double * allocate(long count_);
+  void release(double *field_);
+  // Collective over comm_: rank 0 prints the field memory in use and the
+  // page sizes actually backing it. Call once the fields have been touched.
+  static void report(MPI_Comm comm_, std::ostream& os_);
+  // Bytes of the fields this process has in use
+  static double get_bytes_in_use();
+  // Unmaps every pooled field that is not in use
+  static void drain_pool();
+
+ private:
+  long _alignment;
+  int _huge_pages;
+  long _huge_page_threshold;
+  int _numa_policy;
+  bool _pool;
+};
+#endif
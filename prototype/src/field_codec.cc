@@ -0,0 +1,292 @@
+#include "field_codec.h"
+
+#include <stdint.h>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+  const char kMagic[4] = {'D', 'Q', 'Z', '1'};
+  const int kPlanes = 8; // bytes per 64 bit residual
+  // Largest quantized magnitude we allow, leaves headroom for prediction
+  const double kQuantLimit = 2.0e18;
+
+  inline uint64_t zigzag(int64_t v_) {
+    return (static_cast<uint64_t>(v_) << 1) ^ static_cast<uint64_t>(v_ >> 63);
+  }
+
+  inline int64_t unzigzag(uint64_t v_) {
+    return static_cast<int64_t>(v_ >> 1) ^ -static_cast<int64_t>(v_ & 1);
+  }
+
+  inline uint64_t bits_of(double v_) {
+    uint64_t bits;
+    std::memcpy(&bits, &v_, sizeof(bits));
+    return bits;
+  }
+
+  inline double double_of(uint64_t bits_) {
+    double v;
+    std::memcpy(&v, &bits_, sizeof(v));
+    return v;
+  }
+
+  // PackBits style: control c < 128 is followed by c + 1 literal bytes,
+  // c >= 128 is followed by one byte repeated c - 126 times (2..129)
+  void run_length_encode(const unsigned char *in_,
+                         std::size_t n_,
+                         std::vector<unsigned char>& out_) {
+    std::size_t i = 0;
+    while (i < n_) {
+      std::size_t run = 1;
+      while (i + run < n_ && run < 129 && in_[i + run] == in_[i]) {
+        ++run;
+      }
+      if (run >= 2) {
+        out_.push_back(static_cast<unsigned char>(126 + run));
+        out_.push_back(in_[i]);
+        i += run;
+        continue;
+      }
+      std::size_t start = i;
+      while (i < n_ && i - start < 128
+             && !(i + 1 < n_ && in_[i + 1] == in_[i])) {
+        ++i;
+      }
+      out_.push_back(static_cast<unsigned char>(i - start - 1));
+      out_.insert(out_.end(), in_ + start, in_ + i);
+    }
+  }
+
+  std::size_t run_length_decode(const unsigned char *in_,
+                                std::size_t len_,
+                                unsigned char *out_,
+                                std::size_t n_) {
+    std::size_t pos = 0;
+    std::size_t written = 0;
+    while (pos < len_ && written < n_) {
+      const unsigned char control = in_[pos++];
+      if (control < 128) {
+        std::size_t count = control + 1;
+        if (pos + count > len_ || written + count > n_) {
+          throw std::logic_error("Corrupt compressed field: literal overrun");
+        }
+        std::memcpy(out_ + written, in_ + pos, count);
+        pos += count;
+        written += count;
+      } else {
+        std::size_t count = control - 126;
+        if (pos >= len_ || written + count > n_) {
+          throw std::logic_error("Corrupt compressed field: run overrun");
+        }
+        std::memset(out_ + written, in_[pos++], count);
+        written += count;
+      }
+    }
+    return written;
+  }
+
+  template <typename T>
+  void put(std::ofstream& ofs_, const T& value_) {
+    ofs_.write(reinterpret_cast<const char *>(&value_), sizeof(T));
+  }
+
+  template <typename T>
+  void get(std::ifstream& ifs_, T& value_) {
+    ifs_.read(reinterpret_cast<char *>(&value_), sizeof(T));
+  }
+}
+
+FieldCodec::FieldCodec(double error_bound_) : _error_bound(error_bound_) {
+  if (_error_bound < 0) {
+    throw std::logic_error("Compression error bound must be non-negative");
+  }
+}
+
+FieldCodec::~FieldCodec() {}
+
+double FieldCodec::get_error_bound() const {
+  return _error_bound;
+}
+
+void FieldCodec::encode(const double *field_,
+                        int rows_,
+                        int cols_,
+                        int x_span_,
+                        std::vector<unsigned char>& out_) const {
+  const std::size_t cells = static_cast<std::size_t>(rows_) * cols_;
+  std::vector<uint64_t> residuals(cells);
+  if (_error_bound > 0) {
+    const double inverse_quantum = 1.0 / (2.0 * _error_bound);
+    std::vector<int64_t> quantized(cells);
+    for (int i = 0; i < rows_; ++i) {
+      for (int j = 0; j < cols_; ++j) {
+        const double scaled = field_[i * x_span_ + j] * inverse_quantum;
+        if (!(std::fabs(scaled) < kQuantLimit)) {
+          std::stringstream msg;
+          msg << "Value " << field_[i * x_span_ + j]
+              << " cannot be quantized with error bound " << _error_bound;
+          throw std::logic_error(msg.str());
+        }
+        const int64_t q = static_cast<int64_t>(std::floor(scaled + 0.5));
+        const std::size_t center = static_cast<std::size_t>(i) * cols_ + j;
+        const int64_t up = i > 0 ? quantized[center - cols_] : 0;
+        const int64_t left = j > 0 ? quantized[center - 1] : 0;
+        const int64_t upleft = (i > 0 && j > 0) ? quantized[center - cols_ - 1] : 0;
+        quantized[center] = q;
+        residuals[center] = zigzag(q - (up + left - upleft));
+      }
+    }
+  } else {
+    for (int i = 0; i < rows_; ++i) {
+      uint64_t previous = 0;
+      for (int j = 0; j < cols_; ++j) {
+        const uint64_t bits = bits_of(field_[i * x_span_ + j]);
+        residuals[static_cast<std::size_t>(i) * cols_ + j] = bits ^ previous;
+        previous = bits;
+      }
+    }
+  }
+  // Shuffle and pack one byte plane at a time, each prefixed by its length
+  std::vector<unsigned char> plane(cells);
+  std::vector<unsigned char> packed;
+  out_.clear();
+  for (int b = 0; b < kPlanes; ++b) {
+    const int shift = 8 * b;
+    for (std::size_t c = 0; c < cells; ++c) {
+      plane[c] = static_cast<unsigned char>(residuals[c] >> shift);
+    }
+    packed.clear();
+    run_length_encode(plane.empty() ? 0 : &plane[0], cells, packed);
+    const uint64_t length = packed.size();
+    const unsigned char *length_bytes = reinterpret_cast<const unsigned char *>(&length);
+    out_.insert(out_.end(), length_bytes, length_bytes + sizeof(length));
+    out_.insert(out_.end(), packed.begin(), packed.end());
+  }
+}
+
+void FieldCodec::decode(const std::vector<unsigned char>& in_,
+                        int rows_,
+                        int cols_,
+                        std::vector<double>& out_) const {
+  const std::size_t cells = static_cast<std::size_t>(rows_) * cols_;
+  std::vector<uint64_t> residuals(cells, 0);
+  std::vector<unsigned char> plane(cells);
+  std::size_t pos = 0;
+  for (int b = 0; b < kPlanes; ++b) {
+    uint64_t length;
+    if (pos + sizeof(length) > in_.size()) {
+      throw std::logic_error("Corrupt compressed field: truncated payload");
+    }
+    std::memcpy(&length, &in_[pos], sizeof(length));
+    pos += sizeof(length);
+    if (pos + length > in_.size()) {
+      throw std::logic_error("Corrupt compressed field: truncated plane");
+    }
+    std::size_t written = run_length_decode(in_.empty() ? 0 : &in_[pos], length,
+                                            plane.empty() ? 0 : &plane[0], cells);
+    if (written != cells) {
+      throw std::logic_error("Corrupt compressed field: short plane");
+    }
+    pos += length;
+    const int shift = 8 * b;
+    for (std::size_t c = 0; c < cells; ++c) {
+      residuals[c] |= static_cast<uint64_t>(plane[c]) << shift;
+    }
+  }
+  out_.resize(cells);
+  if (_error_bound > 0) {
+    const double quantum = 2.0 * _error_bound;
+    std::vector<int64_t> quantized(cells);
+    for (int i = 0; i < rows_; ++i) {
+      for (int j = 0; j < cols_; ++j) {
+        const std::size_t center = static_cast<std::size_t>(i) * cols_ + j;
+        const int64_t up = i > 0 ? quantized[center - cols_] : 0;
+        const int64_t left = j > 0 ? quantized[center - 1] : 0;
+        const int64_t upleft = (i > 0 && j > 0) ? quantized[center - cols_ - 1] : 0;
+        quantized[center] = unzigzag(residuals[center]) + (up + left - upleft);
+        out_[center] = quantized[center] * quantum;
+      }
+    }
+  } else {
+    for (int i = 0; i < rows_; ++i) {
+      uint64_t previous = 0;
+      for (int j = 0; j < cols_; ++j) {
+        const std::size_t center = static_cast<std::size_t>(i) * cols_ + j;
+        previous ^= residuals[center];
+        out_[center] = double_of(previous);
+      }
+    }
+  }
+}
+
+void FieldCodec::write_file(const std::string& filename_,
+                            const FieldHeader& header_,
+                            const std::vector<unsigned char>& payload_) {
+  std::ofstream ofs(filename_.c_str(), std::ofstream::out | std::ofstream::binary);
+  if (!ofs.good()) {
+    std::stringstream msg;
+    msg << "Cannot open " << filename_ << " for writing";
+    throw std::logic_error(msg.str());
+  }
+  ofs.write(kMagic, sizeof(kMagic));
+  put(ofs, header_.step);
+  put(ofs, header_.rank);
+  put(ofs, header_.rows);
+  put(ofs, header_.cols);
+  put(ofs, header_.time);
+  put(ofs, header_.origin_x);
+  put(ofs, header_.origin_y);
+  put(ofs, header_.del_x);
+  put(ofs, header_.del_y);
+  put(ofs, header_.error_bound);
+  const uint64_t length = payload_.size();
+  put(ofs, length);
+  if (!payload_.empty()) {
+    ofs.write(reinterpret_cast<const char *>(&payload_[0]), payload_.size());
+  }
+  ofs.close();
+}
+
+void FieldCodec::read_file(const std::string& filename_,
+                           FieldHeader& header_,
+                           std::vector<unsigned char>& payload_) {
+  std::ifstream ifs(filename_.c_str(), std::ifstream::in | std::ifstream::binary);
+  if (!ifs.good()) {
+    std::stringstream msg;
+    msg << "Compressed field " << filename_ << " not found";
+    throw std::logic_error(msg.str());
+  }
+  char magic[sizeof(kMagic)];
+  ifs.read(magic, sizeof(magic));
+  if (!ifs.good() || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+    std::stringstream msg;
+    msg << filename_ << " is not a compressed field file";
+    throw std::logic_error(msg.str());
+  }
+  get(ifs, header_.step);
+  get(ifs, header_.rank);
+  get(ifs, header_.rows);
+  get(ifs, header_.cols);
+  get(ifs, header_.time);
+  get(ifs, header_.origin_x);
+  get(ifs, header_.origin_y);
+  get(ifs, header_.del_x);
+  get(ifs, header_.del_y);
+  get(ifs, header_.error_bound);
+  uint64_t length = 0;
+  get(ifs, length);
+  payload_.resize(length);
+  if (length > 0) {
+    ifs.read(reinterpret_cast<char *>(&payload_[0]), length);
+  }
+  if (!ifs.good()) {
+    std::stringstream msg;
+    msg << "Compressed field " << filename_ << " is truncated";
+    throw std::logic_error(msg.str());
+  }
+}
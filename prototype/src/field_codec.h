@@ -0,0 +1,57 @@
+#ifndef FIELD_CODEC_H
+#define FIELD_CODEC_H
+
+#include <string>
+#include <vector>
+
+// Describes one rank's block of one output step in a .dqz file
+struct FieldHeader {
+  int step;
+  int rank;
+  int rows;
+  int cols;
+  double time;
+  double origin_x;
+  double origin_y;
+  double del_x;
+  double del_y;
+  double error_bound;
+};
+
+// Error-bounded field compression:
+// 1) values are quantized to multiples of 2 * error_bound (absolute bound),
+// 2) each quantized value is replaced by its residual against a 2D Lorenzo
+//    predictor (up + left - upleft), zigzag encoded to keep small residuals
+//    small,
+// 3) the 64 bit residuals are byte-shuffled into 8 planes and each plane is
+//    run-length encoded - smooth fields leave the upper planes all zero.
+// An error bound of 0 skips quantization and XORs the raw bit patterns
+// against the left neighbour instead, which makes the codec lossless.
+class FieldCodec {
+ public:
+  FieldCodec(double error_bound_);
+  ~FieldCodec();
+  double get_error_bound() const;
+  // Compresses rows_ x cols_ values starting at field_, rows x_span_ apart
+  void encode(const double *field_,
+              int rows_,
+              int cols_,
+              int x_span_,
+              std::vector<unsigned char>& out_) const;
+  // Reconstructs rows_ x cols_ contiguous values from an encoded payload
+  void decode(const std::vector<unsigned char>& in_,
+              int rows_,
+              int cols_,
+              std::vector<double>& out_) const;
+
+  static void write_file(const std::string& filename_,
+                         const FieldHeader& header_,
+                         const std::vector<unsigned char>& payload_);
+  static void read_file(const std::string& filename_,
+                        FieldHeader& header_,
+                        std::vector<unsigned char>& payload_);
+
+ private:
+  double _error_bound;
+};
+#endif
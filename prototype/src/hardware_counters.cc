@@ -0,0 +1,236 @@
+#include "hardware_counters.h"
+
+#include <mpi.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include "config_file.h"
+
+namespace {
+  // FP_ARITH_INST_RETIRED umask 0x3c, the 128 and 256 bit packed single and
+  // double instructions, Skylake onwards
+  const char * const kIntelFpVectorEvent = "3cc7";
+
+  bool is_intel() {
+    std::ifstream ifs("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(ifs, line)) {
+      if (line.compare(0, 9, "vendor_id") == 0) {
+        return line.find("GenuineIntel") != std::string::npos;
+      }
+    }
+    return false;
+  }
+}
+
+HardwareCounters::HardwareCounters(const ConfigFile& config_) {
+  for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+    _fd[counter] = -1;
+    _error[counter] = ENOSYS;
+  }
+  for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+    for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+      _start[phase][counter] = 0;
+      _total[phase][counter] = 0;
+    }
+  }
+#ifdef __linux__
+  open(CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  open(INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  open(LLC_MISSES, PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL
+                                       | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                       | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  open(DTLB_MISSES, PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+                                        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  const std::string fp_event = config_.get_or_default("hardware_counters_fp_event",
+                                                      std::string(is_intel() ? kIntelFpVectorEvent : ""));
+  if (!fp_event.empty()) {
+    unsigned long long raw = 0;
+    std::istringstream iss(fp_event);
+    iss >> std::hex >> raw;
+    open(FP_VECTOR, PERF_TYPE_RAW, raw);
+  } else {
+    _error[FP_VECTOR] = 0;
+  }
+#endif
+}
+
+HardwareCounters::~HardwareCounters() {
+  for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+    if (_fd[counter] >= 0) {
+      close(_fd[counter]);
+    }
+  }
+}
+
+void HardwareCounters::open(int counter_, unsigned int type_, unsigned long long config_) {
+#ifdef __linux__
+  struct perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type_;
+  attr.config = config_;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.inherit = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  const long fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  if (fd < 0) {
+    _error[counter_] = errno;
+    return;
+  }
+  _fd[counter_] = static_cast<int>(fd);
+  _error[counter_] = 0;
+#endif
+}
+
+bool HardwareCounters::is_available() const {
+  for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+    if (_fd[counter] >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void HardwareCounters::read_all(double counts_[COUNTER_COUNT]) const {
+  for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+    counts_[counter] = 0;
+    if (_fd[counter] < 0) {
+      continue;
+    }
+    // value, time enabled, time running
+    unsigned long long values[3];
+    if (read(_fd[counter], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values))) {
+      continue;
+    }
+    // Scale up when the PMU was shared out between more events than it has
+    // counters
+    counts_[counter] = values[2] > 0 ? values[0] * (static_cast<double>(values[1]) / values[2])
+                                     : 0.0;
+  }
+}
+
+void HardwareCounters::begin(int phase_) {
+  read_all(_start[phase_]);
+}
+
+void HardwareCounters::end(int phase_) {
+  double now[COUNTER_COUNT];
+  read_all(now);
+  for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+    _total[phase_][counter] += now[counter] - _start[phase_][counter];
+  }
+}
+
+double HardwareCounters::get_total(int phase_, int counter_) const {
+  return _total[phase_][counter_];
+}
+
+const char* HardwareCounters::counter_name(int counter_) {
+  switch (counter_) {
+    case (CYCLES): return "cycles";
+    case (INSTRUCTIONS): return "instructions";
+    case (LLC_MISSES): return "llc_misses";
+    case (DTLB_MISSES): return "dtlb_misses";
+    case (FP_VECTOR): return "fp_vector";
+  }
+  return "unknown";
+}
+
+void HardwareCounters::report(MPI_Comm comm_, std::ostream& os_) const {
+  int rank, size;
+  MPI_Comm_rank(comm_, &rank);
+  MPI_Comm_size(comm_, &size);
+  double sum[PHASE_COUNT][COUNTER_COUNT];
+  MPI_Reduce(const_cast<double *>(&_total[0][0]), &sum[0][0], PHASE_COUNT * COUNTER_COUNT,
+             MPI_DOUBLE, MPI_SUM, 0, comm_);
+  int available[COUNTER_COUNT];
+  int available_sum[COUNTER_COUNT];
+  for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+    available[counter] = _fd[counter] >= 0 ? 1 : 0;
+  }
+  MPI_Reduce(available, available_sum, COUNTER_COUNT, MPI_INT, MPI_SUM, 0, comm_);
+  if (rank != 0) {
+    return;
+  }
+  std::ios::fmtflags flags = os_.flags();
+  std::streamsize precision = os_.precision();
+  bool any = false;
+  for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+    any = any || available_sum[counter] > 0;
+  }
+  if (!any) {
+    os_ << "Hardware counters: unavailable (" << std::strerror(_error[CYCLES])
+        << "), check perf_event_paranoid and that the PMU is exposed\n";
+    os_.flush();
+    return;
+  }
+  os_ << "Hardware counters summed over " << size << " ranks:\n"
+      << "  " << std::left << std::setw(10) << "phase" << std::right;
+  for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+    os_ << std::setw(14) << counter_name(counter);
+  }
+  os_ << std::setw(8) << "ipc" << std::setw(12) << "llc/kinst" << std::setw(12) << "dtlb/kinst" << "\n";
+  os_.setf(std::ios::scientific, std::ios::floatfield);
+  os_.precision(4);
+  for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+    os_ << "  " << std::left << std::setw(10) << Profiler::phase_name(phase) << std::right;
+    for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+      if (available_sum[counter] > 0) {
+        os_ << std::setw(14) << sum[phase][counter];
+      } else {
+        os_ << std::setw(14) << "n/a";
+      }
+    }
+    os_.setf(std::ios::fixed, std::ios::floatfield);
+    os_.precision(2);
+    const double cycles = sum[phase][CYCLES];
+    const double kinst = sum[phase][INSTRUCTIONS] / 1000.0;
+    const bool have_inst = available_sum[INSTRUCTIONS] > 0 && kinst > 0;
+    if (available_sum[CYCLES] > 0 && have_inst && cycles > 0) {
+      os_ << std::setw(8) << 1000.0 * kinst / cycles;
+    } else {
+      os_ << std::setw(8) << "n/a";
+    }
+    if (available_sum[LLC_MISSES] > 0 && have_inst) {
+      os_ << std::setw(12) << sum[phase][LLC_MISSES] / kinst;
+    } else {
+      os_ << std::setw(12) << "n/a";
+    }
+    if (available_sum[DTLB_MISSES] > 0 && have_inst) {
+      os_ << std::setw(12) << sum[phase][DTLB_MISSES] / kinst;
+    } else {
+      os_ << std::setw(12) << "n/a";
+    }
+    os_ << "\n";
+    os_.setf(std::ios::scientific, std::ios::floatfield);
+    os_.precision(4);
+  }
+  for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+    if (available_sum[counter] < size) {
+      os_ << "  " << counter_name(counter) << " unavailable on " << size - available_sum[counter]
+          << " of " << size << " ranks";
+      if (_error[counter]) {
+        os_ << " (rank 0: " << std::strerror(_error[counter]) << ")";
+      } else if (_fd[counter] < 0) {
+        os_ << " (rank 0: no hardware_counters_fp_event for this CPU)";
+      }
+      os_ << "\n";
+    }
+  }
+  os_.flush();
+  os_.flags(flags);
+  os_.precision(precision);
+}
@@ -0,0 +1,54 @@
+#ifndef HARDWARE_COUNTERS_H
+#define HARDWARE_COUNTERS_H
+
+#include <mpi.h>
+#include <ostream>
+#include <string>
+
+#include "profiler.h"
+
+class ConfigFile;
+// Per phase hardware event counts of this process and its threads, through
+// Linux perf_event_open, user space only:
+//   hardware_counters          - collect them (false)
+//   hardware_counters_fp_event - raw PMU event for FP vector operations, as
+//                                hex umask and event (3cc7, the 128 and 256
+//                                bit packed FP_ARITH_INST_RETIRED, on Intel
+//                                only; elsewhere it has to be given)
+// Each counter is opened on its own, so one the PMU, kernel or
+// perf_event_paranoid refuses is reported unavailable and the rest still
+// count. Counts are scaled for multiplexing. Open before any OpenMP thread
+// starts, as only threads created afterwards are inherited.
+class HardwareCounters {
+ public:
+  enum Counter {
+    CYCLES = 0,
+    INSTRUCTIONS = 1,
+    LLC_MISSES = 2,
+    DTLB_MISSES = 3,
+    FP_VECTOR = 4,
+    COUNTER_COUNT = 5,
+  };
+
+  HardwareCounters(const ConfigFile& config_);
+  ~HardwareCounters();
+  // Whether any counter opened
+  bool is_available() const;
+  void begin(int phase_);
+  void end(int phase_);
+  double get_total(int phase_, int counter_) const;
+  // Collective over comm_: per phase sums over ranks, with instructions per
+  // cycle and misses per thousand instructions, printed by rank 0
+  void report(MPI_Comm comm_, std::ostream& os_) const;
+  static const char* counter_name(int counter_);
+
+ private:
+  void open(int counter_, unsigned int type_, unsigned long long config_);
+  void read_all(double counts_[COUNTER_COUNT]) const;
+
+  int _fd[COUNTER_COUNT];
+  int _error[COUNTER_COUNT]; // errno of a failed open, 0 when counting
+  double _start[PHASE_COUNT][COUNTER_COUNT];
+  double _total[PHASE_COUNT][COUNTER_COUNT];
+};
+#endif
@@ -0,0 +1,26 @@
+#ifndef IMPLICIT_SOLVER_H
+#define IMPLICIT_SOLVER_H
+
+class Profiler;
+// Base class for solvers of the implicit diffusion operator
+//   A u = u - coefficient * (d2u/dx2 + d2u/dy2)
+// with the reflecting boundaries of the meshes
+class ImplicitSolver {
+ public:
+  virtual ~ImplicitSolver() = 0;
+  // Solves A x = rhs, starting from the guess in x_. Both fields use the
+  // mesh's augmented layout. Returns the number of iterations taken.
+  virtual int solve(double coefficient_, const double *rhs_, double *x_) = 0;
+  // |b - A x| / |b| at the end of the last solve
+  virtual double get_last_residual() const = 0;
+  // Work of the last solve in stencil sweeps over this rank's block, the
+  // sweeps of coarser grids or preconditioners weighted by their cells
+  virtual double get_last_sweeps() const = 0;
+  // Halo exchanges on meshes of the solver's own are timed into profiler_
+  virtual void set_profiler(Profiler *profiler_);
+};
+
+inline ImplicitSolver::~ImplicitSolver() {}
+
+inline void ImplicitSolver::set_profiler(Profiler *) {}
+#endif
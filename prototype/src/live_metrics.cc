@@ -0,0 +1,144 @@
+#include "live_metrics.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "config_file.h"
+#include "profiler.h"
+
+namespace {
+  double epoch_seconds() {
+    struct timeval t;
+    gettimeofday(&t, 0);
+    return t.tv_sec + t.tv_usec * 1.0e-6;
+  }
+
+  // Nearest rank percentile of sorted_, fraction_ in (0, 1]
+  double percentile(const std::vector<double>& sorted_, double fraction_) {
+    std::size_t index = static_cast<std::size_t>(fraction_ * sorted_.size() + 0.5);
+    index = std::max(index, static_cast<std::size_t>(1));
+    return sorted_[std::min(index, sorted_.size()) - 1];
+  }
+}
+
+const char LiveMetrics::kMagic[8] = {'D', 'E', 'Q', 'N', 'L', 'I', 'V', '1'};
+
+LiveMetrics::LiveMetrics(const ConfigFile& config_, const std::string& tag_, int rank_,
+                         int ranks_) : _record(0), _window_next(0), _window_used(0) {
+  _interval = std::max(1, config_.get_or_default("live_metrics_interval", 1));
+  const int window = std::max(1, config_.get_or_default("live_metrics_window", 64));
+  _window.resize(window, 0.0);
+  _window_cells.resize(window, 0);
+  std::ostringstream filename;
+  filename << config_.get_or_default("live_metrics_dir", std::string("/dev/shm"))
+           << "/" << tag_ << "." << rank_ << ".live";
+  _filename = filename.str();
+  // A fresh file each run, so a reader that still has the last one mapped
+  // keeps seeing that run as it ended
+  unlink(_filename.c_str());
+  const int fd = ::open(_filename.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0 || ftruncate(fd, sizeof(MetricsRecord)) != 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    std::stringstream msg;
+    msg << "Cannot create live metrics file " << _filename;
+    throw std::logic_error(msg.str());
+  }
+  void *map = mmap(0, sizeof(MetricsRecord), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    std::stringstream msg;
+    msg << "Cannot mmap live metrics file " << _filename;
+    throw std::logic_error(msg.str());
+  }
+  _record = static_cast<MetricsRecord *>(map);
+  std::memset(_record, 0, sizeof(MetricsRecord));
+  _record->rank = rank_;
+  _record->ranks = ranks_;
+  _record->pid = getpid();
+  _record->started = epoch_seconds();
+  _record->updated = _record->started;
+  // The magic goes last, a reader takes the file for a record from then on
+  __sync_synchronize();
+  std::memcpy(_record->magic, kMagic, sizeof(kMagic));
+}
+
+LiveMetrics::~LiveMetrics() {
+  if (_record) {
+    munmap(_record, sizeof(MetricsRecord));
+  }
+}
+
+void LiveMetrics::record_step(double seconds_, long cells_) {
+  _window[_window_next] = seconds_;
+  _window_cells[_window_next] = cells_;
+  _window_next = (_window_next + 1) % _window.size();
+  _window_used = std::min(_window_used + 1, _window.size());
+}
+
+void LiveMetrics::publish(long step_, double sim_time_, const Profiler& profiler_) {
+  if (step_ % _interval == 0) {
+    write(step_, sim_time_, profiler_, 0);
+  }
+}
+
+void LiveMetrics::finish(long step_, double sim_time_, const Profiler& profiler_) {
+  write(step_, sim_time_, profiler_, 1);
+}
+
+void LiveMetrics::write(long step_, double sim_time_, const Profiler& profiler_, int state_) {
+  // Everything is worked out before the record goes odd, so readers retry
+  // for as short a time as possible
+  std::vector<double> sorted(_window.begin(), _window.begin() + _window_used);
+  std::sort(sorted.begin(), sorted.end());
+  double seconds = 0;
+  double cells = 0;
+  for (std::size_t s = 0; s < _window_used; ++s) {
+    seconds += _window[s];
+    cells += _window_cells[s];
+  }
+  const double updated = epoch_seconds();
+  const unsigned long long sequence = _record->sequence;
+  _record->sequence = sequence + 1;
+  __sync_synchronize();
+  _record->state = state_;
+  _record->step = step_;
+  _record->updated = updated;
+  _record->sim_time = sim_time_;
+  _record->step_p50 = sorted.empty() ? 0.0 : percentile(sorted, 0.50);
+  _record->step_p90 = sorted.empty() ? 0.0 : percentile(sorted, 0.90);
+  _record->step_p99 = sorted.empty() ? 0.0 : percentile(sorted, 0.99);
+  _record->step_max = sorted.empty() ? 0.0 : sorted.back();
+  _record->cells_per_second = seconds > 0 ? cells / seconds : 0.0;
+  _record->halo_bytes = profiler_.get_halo_bytes();
+  _record->halo_wait = profiler_.get_total(HALO_WAIT);
+  _record->compute = profiler_.get_total(COMPUTE);
+  __sync_synchronize();
+  _record->sequence = sequence + 2;
+}
+
+bool LiveMetrics::read(const MetricsRecord *shared_, MetricsRecord& record_) {
+  const volatile unsigned long long *sequence = &shared_->sequence;
+  for (int attempt = 0; attempt < 10000; ++attempt) {
+    const unsigned long long before = *sequence;
+    __sync_synchronize();
+    if (before & 1) {
+      continue;
+    }
+    std::memcpy(&record_, shared_, sizeof(MetricsRecord));
+    __sync_synchronize();
+    if (*sequence == before) {
+      return true;
+    }
+  }
+  return false;
+}
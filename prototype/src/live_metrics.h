@@ -0,0 +1,70 @@
+#ifndef LIVE_METRICS_H
+#define LIVE_METRICS_H
+
+#include <string>
+#include <vector>
+
+class ConfigFile;
+class Profiler;
+
+// One rank's live state, the whole content of its .live file. Written only
+// by that rank under a seqlock: sequence is odd while an update is under
+// way and is bumped again once it is done, so a reader that sees the same
+// even value before and after copying has a consistent record.
+struct MetricsRecord {
+  char magic[8];             // "DEQNLIV1", the last character the version
+  unsigned long long sequence;
+  int rank;
+  int ranks;
+  int pid;
+  int state;                 // 0 running, 1 finished
+  long long step;
+  double started;            // wall clock (epoch seconds) at startup
+  double updated;            // wall clock of the last publish
+  double sim_time;
+  // Wall time of the recent steps, in seconds
+  double step_p50;
+  double step_p90;
+  double step_p99;
+  double step_max;
+  double cells_per_second;   // over the recent steps
+  double halo_bytes;         // since the start, as the Profiler counts them
+  double halo_wait;          // seconds in halo_wait since the start
+  double compute;            // seconds in compute since the start
+};
+
+// Publishes this rank's MetricsRecord into an mmapped file for deqn-top or
+// any other reader to follow while the run goes on:
+//   live_metrics          - publish (false)
+//   live_metrics_dir      - where the files go, one per rank named
+//                           <name>_<mesh_type>.<rank>.live (/dev/shm)
+//   live_metrics_interval - steps between publishes (1)
+//   live_metrics_window   - recent steps the percentiles cover (64)
+// Publishing never waits on a reader. Files are left behind at the end
+// with the state set to finished.
+class LiveMetrics {
+ public:
+  LiveMetrics(const ConfigFile& config_, const std::string& tag_, int rank_, int ranks_);
+  ~LiveMetrics();
+  // Adds a step that took seconds_ of wall time to update cells_ cells
+  void record_step(double seconds_, long cells_);
+  // Publishes when step_ is on the interval
+  void publish(long step_, double sim_time_, const Profiler& profiler_);
+  void finish(long step_, double sim_time_, const Profiler& profiler_);
+  // Seqlock read of a record another process is publishing into, false if
+  // no consistent copy came after many tries
+  static bool read(const MetricsRecord *shared_, MetricsRecord& record_);
+  static const char kMagic[8];
+
+ private:
+  void write(long step_, double sim_time_, const Profiler& profiler_, int state_);
+
+  int _interval;
+  std::string _filename;
+  MetricsRecord *_record;
+  std::vector<double> _window; // ring of recent step times
+  std::vector<long> _window_cells;
+  std::size_t _window_next;
+  std::size_t _window_used;
+};
+#endif
@@ -5,21 +5,44 @@
 
 #include "config_file.h"
 #include "driver.h"
+#include "ensemble_driver.h"
+#include "block_driver.h"
+#include "out_of_core_driver.h"
+#include "benchmark.h"
 
 int main(int argc, char *argv[]) {
-  MPI_Init(&argc, &argv);
-  if (argc != 2) {
-    std::cerr << "Usage: deqn <filename>" << std::endl;
+  // OpenMP threads compute, but only the thread that called this talks MPI
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+  const bool bench = argc == 3 && std::string(argv[1]) == "--bench";
+  if (argc != 2 && !bench) {
+    std::cerr << "Usage: deqn [--bench] <filename>\n"
+                 "  --bench exits 2 when slower than its bench_baseline" << std::endl;
     MPI_Abort(MPI_COMM_WORLD, 1);
   }
+  int status = 0;
   try {
-    ConfigFile config(argv[1]);
-    Driver driver(config);
-    driver.run();
+    ConfigFile config(argv[argc - 1]);
+    if (bench) {
+      Benchmark benchmark(config);
+      status = benchmark.run();
+    } else if (config.get_or_default("ensemble_members", 0) > 0) {
+      EnsembleDriver ensemble(config);
+      ensemble.run();
+    } else if (config.get_or_default("blocks_per_rank", 0) > 0) {
+      BlockDriver blocks(config);
+      blocks.run();
+    } else if (config.get_or_default("out_of_core", false)) {
+      OutOfCoreDriver out_of_core(config);
+      out_of_core.run();
+    } else {
+      Driver driver(config);
+      driver.run();
+    }
   } catch (std::logic_error& ex) {
     std::cerr << "Exception thrown: " << ex.what() << std::endl;
     MPI_Abort(MPI_COMM_WORLD, 1);
   }
   MPI_Finalize();
-  return 0;
+  return status;
 }
@@ -2,8 +2,11 @@
 
 #include <vector>
 #include "config_file.h"
+#include "profiler.h"
 
-Mesh::Mesh(const ConfigFile& config_) : _config(config_) {
+Mesh::Mesh(const ConfigFile& config_) : _config(config_),
+                                        _profiler(0),
+                                        _field_allocator(config_) {
   // Calculate our simulation domain
   // core space excludes ghost cells and boundary padding
   std::vector<int> core_dimensions = _config.get_or_default("logical_dimensions",
@@ -14,6 +17,63 @@ Mesh::Mesh(const ConfigFile& config_) : _config(config_) {
                                                              std::vector<double>());
   _world_height = physical_dimensions.at(0);
   _world_width = physical_dimensions.at(1);
+  _dimension_count = core_dimensions.size() > 2 ? 3 : 2;
+  _single_buffer = _config.get_or_default("single_buffer", false);
+  if (_dimension_count == 3) {
+    _world_core_layer_count = core_dimensions.at(2);
+    _world_depth = physical_dimensions.at(2);
+  } else {
+    _world_core_layer_count = 1;
+    _world_depth = 0;
+  }
+}
+
+int Mesh::get_step_row_offset() const {
+  return get_current_row_offset();
+}
+
+int Mesh::get_step_row_count() const {
+  return get_node_core_row_count();
+}
+
+int Mesh::get_node_core_layer_count() const {
+  return 1;
+}
+
+int Mesh::get_node_augmented_layer_count() const {
+  return 1;
+}
+
+int Mesh::get_current_layer_offset() const {
+  return 0;
+}
+
+double Mesh::get_z_coord(int k_) const {
+  return 0;
+}
+
+int Mesh::get_dimension_count() const {
+  return _dimension_count;
+}
+
+bool Mesh::is_single_buffer() const {
+  return _single_buffer;
+}
+
+bool Mesh::is_halo_changed(int boundary_) const {
+  return true;
+}
+
+double Mesh::get_world_core_layer_count() const {
+ return _world_core_layer_count;
+}
+
+double Mesh::get_world_depth() const {
+ return _world_depth;
+}
+
+double Mesh::get_del_z() const {
+  return _world_depth / _world_core_layer_count;
 }
 
 double Mesh::get_world_core_row_count() const {
@@ -34,3 +94,13 @@ double Mesh::get_del_y() const {
 double Mesh::get_del_x() const { 
   return _world_width / _world_core_col_count; 
 }
+
+void Mesh::set_profiler(Profiler *profiler_) {
+  _profiler = profiler_;
+}
+
+void Mesh::trace_message(int kind_, int peer_, double bytes_) const {
+  if (_profiler) {
+    _profiler->trace_message(kind_, peer_, bytes_);
+  }
+}
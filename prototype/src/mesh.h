@@ -1,12 +1,17 @@
 #ifndef MESH_H
 #define MESH_H
+#include "field_allocator.h"
 class ConfigFile;
+class Profiler;
 class Mesh {
  public:
   Mesh(const ConfigFile& config_);
   virtual ~Mesh() = 0;
   virtual void advance() = 0;
   virtual void reflect_boundary(int boundary_) = 0;
+  // Reflects the physical boundaries of field_ (augmented layout) and fills
+  // its ghost cells from the neighbouring nodes, as advance() does for u1
+  virtual void update_halo(double *field_) = 0;
   virtual double * get_u0() = 0;
   virtual double * get_u1() = 0;
   // These get the coordinates of a row, column in our matrix
@@ -23,20 +28,53 @@ class Mesh {
   virtual int get_current_col_offset() const = 0;
   virtual int get_previous_row_offset() const = 0;
   virtual int get_previous_col_offset() const = 0;
+  // Rows the next explicit step updates. Meshes that recompute some of
+  // their neighbours' rows, to exchange less often, update more than their
+  // core; the defaults are the core rows.
+  virtual int get_step_row_offset() const;
+  virtual int get_step_row_count() const;
+  // 3D domains add a layer (z) dimension: cell (k, i, j) lives at
+  // (k * augmented_rows + i) * augmented_cols + j. 2D meshes keep the
+  // defaults, a single layer without ghost layers.
+  virtual int get_node_core_layer_count() const;
+  virtual int get_node_augmented_layer_count() const;
+  virtual int get_current_layer_offset() const;
+  virtual double get_z_coord(int k_) const;
+  // 2, or 3 when logical_dimensions has a third (layers) entry
+  int get_dimension_count() const;
+  // single_buffer: u0 and u1 are the same array, updated in place
+  bool is_single_buffer() const;
+  // Whether the last halo exchange changed the ghost cells on a side
+  // (DistributedMesh's Boundary); meshes that do not track it say true
+  virtual bool is_halo_changed(int boundary_) const;
+  double get_world_core_layer_count() const;
+  double get_world_depth() const;
+  double get_del_z() const;
   double get_world_core_row_count() const;
   double get_world_core_col_count() const;
   double get_world_height() const;
   double get_world_width() const;
   double get_del_x() const;
   double get_del_y() const;
+  // Phases of advance() are timed into profiler_ when one is set
+  void set_profiler(Profiler *profiler_);
  protected:
+  // Records a halo message post or completion when tracing
+  void trace_message(int kind_, int peer_, double bytes_) const;
   const ConfigFile& _config;
+  Profiler *_profiler;
+  // Fields come from here rather than new[], see FieldAllocator
+  FieldAllocator _field_allocator;
  private:
   // TODO Probably actually better stored in vectors.
   int _world_core_row_count;
   int _world_core_col_count;
+  int _world_core_layer_count;
+  int _dimension_count;
+  bool _single_buffer;
   double _world_height; // Corresponds to rows                                     
   double _world_width;  // Corresponds to cols  
+  double _world_depth;  // Corresponds to layers
 };
 
 inline Mesh::~Mesh() {}
@@ -0,0 +1,469 @@
+#include "multigrid.h"
+
+#include <mpi.h>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "config_file.h"
+#include "mesh.h"
+#include "distributed_mesh.h"
+#include "static_mesh.h"
+#include "profiler.h"
+
+Multigrid::Multigrid(const ConfigFile& config_, Mesh *mesh_) : _config(config_),
+                                                               _last_residual(0),
+                                                               _last_sweeps(0),
+                                                               _profiler(0),
+                                                               _distributed_count(0),
+                                                               _agglomerated(false),
+                                                               _self_comm(MPI_COMM_NULL),
+                                                               _shadow_rows(0),
+                                                               _shadow_cols(0) {
+  DistributedMesh *distributed = dynamic_cast<DistributedMesh *>(mesh_);
+  if (!distributed) {
+    throw std::logic_error("Multigrid needs a distributed mesh");
+  }
+  _comm = distributed->get_cart_comm();
+  MPI_Comm_rank(_comm, &_rank);
+  MPI_Comm_size(_comm, &_size);
+  _tolerance = _config.get_or_default("multigrid_tolerance", 1.0e-8);
+  _max_cycles = _config.get_or_default("multigrid_max_cycles", 50);
+  _sweeps = _config.get_or_default("multigrid_smoothing_sweeps", 2);
+  _coarse_sweeps = _config.get_or_default("multigrid_coarse_sweeps", 50);
+  _agglomerate_span = _config.get_or_default("multigrid_agglomerate_span", 8);
+
+  Level *fine = new Level;
+  fine->config = _config;
+  fine->dim_nodes.push_back(distributed->get_vertical_nodes_count());
+  fine->dim_nodes.push_back(distributed->get_horizontal_nodes_count());
+  fine->mesh = mesh_;
+  fine->owns_mesh = false;
+  init_geometry(*fine);
+  fine->u = 0; // supplied by solve()
+  fine->rhs = 0;
+  fine->res_storage.assign(mesh_->get_node_augmented_cell_count(), 0.0);
+  fine->res = &fine->res_storage[0];
+  _levels.push_back(fine);
+
+  // Coarsen on the full decomposition while every block halves exactly.
+  // Blocks are spread as evenly as possible, so all of them being even
+  // means they are all the same size and the coarse blocks line up.
+  const int min_span = _size > 1 ? _agglomerate_span : 2;
+  while (true) {
+    const Level& level = *_levels.back();
+    int local[2];
+    local[0] = (level.rows % 2 == 0) && (level.cols % 2 == 0);
+    local[1] = (level.rows / 2 >= min_span) && (level.cols / 2 >= min_span);
+    int global[2];
+    MPI_Allreduce(local, global, 2, MPI_INT, MPI_LAND, _comm);
+    if (!global[0]) {
+      break;
+    }
+    if (!global[1]) {
+      _agglomerated = _size > 1;
+      break;
+    }
+    _levels.push_back(make_level(level, _comm, level.dim_nodes));
+  }
+  _distributed_count = _levels.size();
+  if (!_agglomerated) {
+    return;
+  }
+  // Gather the next level onto rank 0 and keep coarsening there
+  const Level& last = *_levels.back();
+  _shadow_rows = last.rows / 2;
+  _shadow_cols = last.cols / 2;
+  _shadow.assign((_shadow_rows + 2) * (_shadow_cols + 2), 0.0);
+  int block[4] = {_shadow_rows, _shadow_cols, last.row_offset / 2, last.col_offset / 2};
+  std::vector<int> blocks(4 * _size, 0);
+  MPI_Gather(block, 4, MPI_INT, &blocks[0], 4, MPI_INT, 0, _comm);
+  if (_rank != 0) {
+    return;
+  }
+  for (int r = 0; r < _size; ++r) {
+    _block_rows.push_back(blocks[4 * r]);
+    _block_cols.push_back(blocks[4 * r + 1]);
+    _block_row_offsets.push_back(blocks[4 * r + 2]);
+    _block_col_offsets.push_back(blocks[4 * r + 3]);
+  }
+  int dims[2] = {1, 1};
+  int periods[2] = {0, 0};
+  MPI_Cart_create(MPI_COMM_SELF, 2, dims, periods, 0, &_self_comm);
+  std::vector<int> single(2, 1);
+  _levels.push_back(make_level(last, _self_comm, single));
+  while (true) {
+    const Level& level = *_levels.back();
+    if (level.rows % 2 != 0 || level.cols % 2 != 0
+        || level.rows / 2 < 2 || level.cols / 2 < 2) {
+      break;
+    }
+    _levels.push_back(make_level(level, _self_comm, single));
+  }
+}
+
+Multigrid::~Multigrid() {
+  for (std::size_t l = 0; l < _levels.size(); ++l) {
+    if (_levels[l]->owns_mesh) {
+      delete _levels[l]->mesh;
+    }
+    delete _levels[l];
+  }
+  if (_self_comm != MPI_COMM_NULL) {
+    MPI_Comm_free(&_self_comm);
+  }
+}
+
+Multigrid::Level *Multigrid::make_level(const Level& finer_,
+                                        MPI_Comm comm_,
+                                        const std::vector<int>& dim_nodes_) {
+  Level *level = new Level;
+  level->config = finer_.config;
+  std::stringstream dimensions;
+  dimensions << static_cast<int>(finer_.mesh->get_world_core_row_count()) / 2 << " "
+             << static_cast<int>(finer_.mesh->get_world_core_col_count()) / 2;
+  level->config.set("logical_dimensions", dimensions.str());
+  // u and res below are the mesh's two fields, they must not alias
+  level->config.set("single_buffer", "false");
+  level->dim_nodes = dim_nodes_;
+  level->mesh = new StaticMesh(level->config, comm_, level->dim_nodes);
+  level->owns_mesh = true;
+  init_geometry(*level);
+  // The coarse mesh's own fields serve as correction and residual
+  level->u = level->mesh->get_u0();
+  level->res = level->mesh->get_u1();
+  level->rhs_storage.assign(level->mesh->get_node_augmented_cell_count(), 0.0);
+  level->rhs = &level->rhs_storage[0];
+  return level;
+}
+
+void Multigrid::init_geometry(Level& level_) {
+  Mesh *mesh = level_.mesh;
+  level_.rows = mesh->get_node_core_row_count();
+  level_.cols = mesh->get_node_core_col_count();
+  level_.x_span = mesh->get_node_augmented_col_count();
+  level_.row_offset = static_cast<int>(std::floor(mesh->get_y_coord(1) / mesh->get_del_y() + 0.5));
+  level_.col_offset = static_cast<int>(std::floor(mesh->get_x_coord(1) / mesh->get_del_x() + 0.5));
+  level_.cx = 0;
+  level_.cy = 0;
+}
+
+double Multigrid::get_last_residual() const {
+  return _last_residual;
+}
+
+double Multigrid::get_last_sweeps() const {
+  return _last_sweeps;
+}
+
+void Multigrid::set_profiler(Profiler *profiler_) {
+  _profiler = profiler_;
+  for (std::size_t l = 0; l < _levels.size(); ++l) {
+    if (_levels[l]->owns_mesh) {
+      _levels[l]->mesh->set_profiler(profiler_);
+    }
+  }
+}
+
+int Multigrid::get_level_count() const {
+  return _levels.size();
+}
+
+void Multigrid::set_coefficient(double coefficient_) {
+  for (std::size_t l = 0; l < _levels.size(); ++l) {
+    Level& level = *_levels[l];
+    const double dx = level.mesh->get_del_x();
+    const double dy = level.mesh->get_del_y();
+    level.cx = coefficient_ / (dx * dx);
+    level.cy = coefficient_ / (dy * dy);
+  }
+}
+
+double Multigrid::cell_fraction(const Level& level_) const {
+  const Level& fine = *_levels[0];
+  return static_cast<double>(level_.rows) * level_.cols / (static_cast<double>(fine.rows) * fine.cols);
+}
+
+void Multigrid::smooth(Level& level_, int sweeps_) {
+  double * const u = level_.u;
+  const double * const rhs = level_.rhs;
+  const int x_span = level_.x_span;
+  const double cx = level_.cx;
+  const double cy = level_.cy;
+  const double inverse_diagonal = 1.0 / (1.0 + 2.0 * cx + 2.0 * cy);
+  _last_sweeps += sweeps_ * cell_fraction(level_);
+  for (int sweep = 0; sweep < sweeps_; ++sweep) {
+    for (int colour = 0; colour < 2; ++colour) {
+      level_.mesh->update_halo(u);
+      for (int i = 1; i < level_.rows + 1; ++i) {
+        const int j_start = 1 + ((colour + level_.row_offset + level_.col_offset + i - 1) & 1);
+        for (int j = j_start; j < level_.cols + 1; j += 2) {
+          const int center = i * x_span + j;
+          u[center] = (rhs[center] + cx * (u[center - 1] + u[center + 1])
+                                   + cy * (u[center - x_span] + u[center + x_span]))
+                      * inverse_diagonal;
+        }
+      }
+    }
+  }
+}
+
+void Multigrid::residual(Level& level_) {
+  double * const u = level_.u;
+  const double * const rhs = level_.rhs;
+  double * const res = level_.res;
+  const int x_span = level_.x_span;
+  const double cx = level_.cx;
+  const double cy = level_.cy;
+  const double diagonal = 1.0 + 2.0 * cx + 2.0 * cy;
+  _last_sweeps += cell_fraction(level_);
+  level_.mesh->update_halo(u);
+  for (int i = 1; i < level_.rows + 1; ++i) {
+    for (int j = 1; j < level_.cols + 1; ++j) {
+      const int center = i * x_span + j;
+      res[center] = rhs[center] - (diagonal * u[center]
+                                   - cx * (u[center - 1] + u[center + 1])
+                                   - cy * (u[center - x_span] + u[center + x_span]));
+    }
+  }
+}
+
+double Multigrid::residual_norm(Level& level_) {
+  residual(level_);
+  double local = 0;
+  for (int i = 1; i < level_.rows + 1; ++i) {
+    for (int j = 1; j < level_.cols + 1; ++j) {
+      const double r = level_.res[i * level_.x_span + j];
+      local += r * r;
+    }
+  }
+  double global = 0;
+  MPI_Allreduce(&local, &global, 1, MPI_DOUBLE, MPI_SUM, _comm);
+  return std::sqrt(global);
+}
+
+void Multigrid::restrict_residual(const Level& fine_, double *coarse_, int coarse_span_) {
+  const double * const res = fine_.res;
+  const int x_span = fine_.x_span;
+  for (int i = 0; i < fine_.rows / 2; ++i) {
+    for (int j = 0; j < fine_.cols / 2; ++j) {
+      const int child = (2 * i + 1) * x_span + (2 * j + 1);
+      coarse_[(i + 1) * coarse_span_ + (j + 1)] =
+          0.25 * (res[child] + res[child + 1] + res[child + x_span] + res[child + x_span + 1]);
+    }
+  }
+}
+
+void Multigrid::exchange_corners(Level& level_) {
+  DistributedMesh *mesh = dynamic_cast<DistributedMesh *>(level_.mesh);
+  MPI_Comm cart = mesh->get_cart_comm();
+  double * const u = level_.u;
+  const int x_span = level_.x_span;
+  MPI_Request requests[8];
+  int count = 0;
+  {
+    ScopedPhase phase(_profiler, HALO_POST);
+    for (int di = -1; di <= 1; di += 2) {
+      for (int dj = -1; dj <= 1; dj += 2) {
+        int coords[2] = {mesh->get_node_row() + di, mesh->get_node_col() + dj};
+        if (coords[0] < 0 || coords[0] >= mesh->get_vertical_nodes_count()
+            || coords[1] < 0 || coords[1] >= mesh->get_horizontal_nodes_count()) {
+          continue;
+        }
+        int peer;
+        MPI_Cart_rank(cart, coords, &peer);
+        const int i = di < 0 ? 1 : level_.rows;
+        const int j = dj < 0 ? 1 : level_.cols;
+        // Tagged by the direction of travel, past the four of update_halo
+        const int send_tag = 4 + 2 * (di > 0) + (dj > 0);
+        const int recv_tag = 4 + 2 * (di < 0) + (dj < 0);
+        MPI_Isend(&u[i * x_span + j], 1, MPI_DOUBLE, peer, send_tag, cart, &requests[count++]);
+        MPI_Irecv(&u[(i + di) * x_span + (j + dj)], 1, MPI_DOUBLE, peer, recv_tag, cart,
+                  &requests[count++]);
+      }
+    }
+  }
+  ScopedPhase phase(_profiler, HALO_WAIT);
+  MPI_Waitall(count, requests, MPI_STATUSES_IGNORE);
+  if (_profiler) {
+    _profiler->count_halo_bytes(count * sizeof(double));
+  }
+}
+
+void Multigrid::prolong_add(double *coarse_, int coarse_span_, Level& fine_) {
+  const int rows = fine_.rows / 2;
+  const int cols = fine_.cols / 2;
+  const int s = coarse_span_;
+  // A corner ghost on the domain's boundary is the reflection of a cell
+  // next to it, which extrapolating from its neighbours gives exactly
+  const bool top = fine_.row_offset == 0;
+  const bool bottom = fine_.row_offset + fine_.rows
+                      == static_cast<int>(fine_.mesh->get_world_core_row_count());
+  const bool left = fine_.col_offset == 0;
+  const bool right = fine_.col_offset + fine_.cols
+                     == static_cast<int>(fine_.mesh->get_world_core_col_count());
+  if (top || left) {
+    coarse_[0] = coarse_[1] + coarse_[s] - coarse_[s + 1];
+  }
+  if (top || right) {
+    coarse_[cols + 1] = coarse_[cols] + coarse_[s + cols + 1] - coarse_[s + cols];
+  }
+  if (bottom || left) {
+    coarse_[(rows + 1) * s] = coarse_[(rows + 1) * s + 1] + coarse_[rows * s] - coarse_[rows * s + 1];
+  }
+  if (bottom || right) {
+    coarse_[(rows + 1) * s + cols + 1] = coarse_[(rows + 1) * s + cols]
+                                         + coarse_[rows * s + cols + 1] - coarse_[rows * s + cols];
+  }
+  double * const u = fine_.u;
+  const int x_span = fine_.x_span;
+  for (int i = 1; i < fine_.rows + 1; ++i) {
+    const int ci = (i - 1) / 2 + 1;
+    const int di = ((i - 1) & 1) ? s : -s;
+    for (int j = 1; j < fine_.cols + 1; ++j) {
+      const int cj = (j - 1) / 2 + 1;
+      const int dj = ((j - 1) & 1) ? 1 : -1;
+      const int c = ci * s + cj;
+      u[i * x_span + j] += 0.5625 * coarse_[c]
+                           + 0.1875 * (coarse_[c + di] + coarse_[c + dj])
+                           + 0.0625 * coarse_[c + di + dj];
+    }
+  }
+}
+
+void Multigrid::agglomerate_rhs(const Level& fine_) {
+  restrict_residual(fine_, &_shadow[0], _shadow_cols + 2);
+  const int count = _shadow_rows * _shadow_cols;
+  std::vector<double> send(count);
+  for (int i = 0; i < _shadow_rows; ++i) {
+    for (int j = 0; j < _shadow_cols; ++j) {
+      send[i * _shadow_cols + j] = _shadow[(i + 1) * (_shadow_cols + 2) + (j + 1)];
+    }
+  }
+  std::vector<int> counts;
+  std::vector<int> displs;
+  if (_rank == 0) {
+    int total = 0;
+    for (int r = 0; r < _size; ++r) {
+      counts.push_back(_block_rows[r] * _block_cols[r]);
+      displs.push_back(total);
+      total += counts[r];
+    }
+    _pack.resize(total);
+  }
+  MPI_Gatherv(count ? &send[0] : 0, count, MPI_DOUBLE,
+              _rank == 0 ? &_pack[0] : 0,
+              _rank == 0 ? &counts[0] : 0,
+              _rank == 0 ? &displs[0] : 0,
+              MPI_DOUBLE, 0, _comm);
+  if (_rank != 0) {
+    return;
+  }
+  Level& coarse = *_levels[_distributed_count];
+  for (int r = 0; r < _size; ++r) {
+    const double *block = &_pack[displs[r]];
+    for (int i = 0; i < _block_rows[r]; ++i) {
+      for (int j = 0; j < _block_cols[r]; ++j) {
+        const int row = _block_row_offsets[r] + i + 1;
+        const int col = _block_col_offsets[r] + j + 1;
+        coarse.rhs_storage[row * coarse.x_span + col] = block[i * _block_cols[r] + j];
+      }
+    }
+  }
+}
+
+void Multigrid::distribute_correction() {
+  // Every rank gets its block of the gathered correction with a ghost ring
+  std::vector<int> counts;
+  std::vector<int> displs;
+  if (_rank == 0) {
+    const Level& coarse = *_levels[_distributed_count];
+    int total = 0;
+    for (int r = 0; r < _size; ++r) {
+      counts.push_back((_block_rows[r] + 2) * (_block_cols[r] + 2));
+      displs.push_back(total);
+      total += counts[r];
+    }
+    _pack.resize(total);
+    for (int r = 0; r < _size; ++r) {
+      double *block = &_pack[displs[r]];
+      for (int i = 0; i < _block_rows[r] + 2; ++i) {
+        for (int j = 0; j < _block_cols[r] + 2; ++j) {
+          const int row = _block_row_offsets[r] + i;
+          const int col = _block_col_offsets[r] + j;
+          block[i * (_block_cols[r] + 2) + j] = coarse.u[row * coarse.x_span + col];
+        }
+      }
+    }
+  }
+  MPI_Scatterv(_rank == 0 ? &_pack[0] : 0,
+               _rank == 0 ? &counts[0] : 0,
+               _rank == 0 ? &displs[0] : 0,
+               MPI_DOUBLE,
+               &_shadow[0], _shadow.size(), MPI_DOUBLE, 0, _comm);
+}
+
+void Multigrid::vcycle(int level_) {
+  Level& level = *_levels[level_];
+  const bool gather = _agglomerated && level_ == _distributed_count - 1;
+  if (!gather && level_ == static_cast<int>(_levels.size()) - 1) {
+    smooth(level, _coarse_sweeps);
+    return;
+  }
+  smooth(level, _sweeps);
+  residual(level);
+  if (gather) {
+    agglomerate_rhs(level);
+    if (_rank == 0) {
+      Level& coarse = *_levels[level_ + 1];
+      std::fill(coarse.u, coarse.u + coarse.mesh->get_node_augmented_cell_count(), 0.0);
+      vcycle(level_ + 1);
+      coarse.mesh->update_halo(coarse.u);
+    }
+    distribute_correction();
+    prolong_add(&_shadow[0], _shadow_cols + 2, level);
+  } else {
+    Level& coarse = *_levels[level_ + 1];
+    restrict_residual(level, &coarse.rhs_storage[0], coarse.x_span);
+    std::fill(coarse.u, coarse.u + coarse.mesh->get_node_augmented_cell_count(), 0.0);
+    vcycle(level_ + 1);
+    coarse.mesh->update_halo(coarse.u);
+    exchange_corners(coarse);
+    prolong_add(coarse.u, coarse.x_span, level);
+  }
+  smooth(level, _sweeps);
+}
+
+int Multigrid::solve(double coefficient_, const double *rhs_, double *x_) {
+  set_coefficient(coefficient_);
+  _last_sweeps = 0;
+  Level& fine = *_levels[0];
+  fine.u = x_;
+  fine.rhs = rhs_;
+  double local = 0;
+  for (int i = 1; i < fine.rows + 1; ++i) {
+    for (int j = 1; j < fine.cols + 1; ++j) {
+      local += rhs_[i * fine.x_span + j] * rhs_[i * fine.x_span + j];
+    }
+  }
+  double rhs_norm = 0;
+  MPI_Allreduce(&local, &rhs_norm, 1, MPI_DOUBLE, MPI_SUM, _comm);
+  rhs_norm = std::sqrt(rhs_norm);
+  double norm = residual_norm(fine);
+  int cycles = 0;
+  while (norm > _tolerance * rhs_norm && norm > 0) {
+    if (cycles == _max_cycles) {
+      std::stringstream msg;
+      msg << "Multigrid did not converge in " << _max_cycles
+          << " cycles, relative residual " << norm / rhs_norm;
+      throw std::logic_error(msg.str());
+    }
+    vcycle(0);
+    ++cycles;
+    norm = residual_norm(fine);
+  }
+  _last_residual = rhs_norm > 0 ? norm / rhs_norm : norm;
+  return cycles;
+}
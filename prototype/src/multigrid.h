@@ -0,0 +1,103 @@
+#ifndef MULTIGRID_H
+#define MULTIGRID_H
+
+#include <mpi.h>
+#include <vector>
+
+#include "config_file.h"
+#include "implicit_solver.h"
+
+class Mesh;
+
+// Geometric multigrid for the implicit diffusion operator.
+// Levels halve the cell counts of the level above on the same cartesian
+// decomposition while every rank's block stays even. Once the blocks get
+// smaller than multigrid_agglomerate_span, the remaining levels are gathered
+// onto rank 0 of the decomposition and coarsened there. Coarsening stops
+// for good at the first level with an odd block on any rank, so a
+// decomposition whose blocks go odd before the global grid does gets fewer
+// levels, and converges more slowly, than one rank would.
+// V-cycles use red-black Gauss-Seidel smoothing (colours by global cell
+// index), cell averaging restriction and bilinear prolongation, with the
+// coarse corner ghosts taken from the diagonal neighbours. For the same
+// levels, the iterates do not depend on the decomposition; only the
+// rounding of the residual norm's reduction does.
+class Multigrid : public ImplicitSolver {
+ public:
+  Multigrid(const ConfigFile& config_, Mesh *mesh_);
+  ~Multigrid();
+  // Iterates V-cycles until |b - A x| <= multigrid_tolerance * |b|
+  int solve(double coefficient_, const double *rhs_, double *x_);
+  double get_last_residual() const;
+  double get_last_sweeps() const;
+  void set_profiler(Profiler *profiler_);
+  int get_level_count() const;
+
+ private:
+  struct Level {
+    ConfigFile config;
+    std::vector<int> dim_nodes;
+    Mesh *mesh;
+    bool owns_mesh;
+    int rows;       // core cells of this rank's block
+    int cols;
+    int x_span;
+    int row_offset; // global index of the first core cell
+    int col_offset;
+    double cx;      // coefficient / dx^2 for the current solve
+    double cy;
+    double *u;
+    double *res;
+    const double *rhs;
+    std::vector<double> rhs_storage;
+    std::vector<double> res_storage;
+  };
+  Level *make_level(const Level& finer_,
+                    MPI_Comm comm_,
+                    const std::vector<int>& dim_nodes_);
+  void init_geometry(Level& level_);
+  void set_coefficient(double coefficient_);
+  // level_'s cells over the fine level's, on this rank
+  double cell_fraction(const Level& level_) const;
+  void smooth(Level& level_, int sweeps_);
+  void residual(Level& level_);
+  double residual_norm(Level& level_);
+  void restrict_residual(const Level& fine_, double *coarse_, int coarse_span_);
+  // Corner ghosts of a distributed level from the diagonal neighbours,
+  // which update_halo does not exchange
+  void exchange_corners(Level& level_);
+  // coarse_'s ghost ring must be current, bar the corners on the boundary
+  void prolong_add(double *coarse_, int coarse_span_, Level& fine_);
+  void agglomerate_rhs(const Level& fine_);
+  void distribute_correction();
+  void vcycle(int level_);
+
+  const ConfigFile& _config;
+  MPI_Comm _comm;
+  int _rank;
+  int _size;
+  double _tolerance;
+  int _max_cycles;
+  int _sweeps;
+  int _coarse_sweeps;
+  int _agglomerate_span;
+  double _last_residual;
+  double _last_sweeps;
+  Profiler *_profiler;
+  std::vector<Level *> _levels;
+  // Levels [0, _distributed_count) span every rank; the rest live on rank 0
+  int _distributed_count;
+  bool _agglomerated;
+  MPI_Comm _self_comm;
+  // Agglomeration: this rank's coarse block, with a ghost ring, and where
+  // every rank's block sits in the gathered level (rank 0 only)
+  int _shadow_rows;
+  int _shadow_cols;
+  std::vector<double> _shadow;
+  std::vector<int> _block_rows;
+  std::vector<int> _block_cols;
+  std::vector<int> _block_row_offsets;
+  std::vector<int> _block_col_offsets;
+  std::vector<double> _pack;
+};
+#endif
@@ -0,0 +1,325 @@
+#include "out_of_core_driver.h"
+
+#include <mpi.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "tools-inl.h"
+#include "band_mesh.h"
+#include "calculation.h"
+#include "data_source.h"
+
+namespace {
+  // Moves bytes_ between buffer_ and fd_ at offset_, retrying short transfers
+  void transfer(int fd_, char *buffer_, long bytes_, off_t offset_, bool write_) {
+    while (bytes_ > 0) {
+      const ssize_t done = write_ ? pwrite(fd_, buffer_, bytes_, offset_)
+                                  : pread(fd_, buffer_, bytes_, offset_);
+      if (done < 0 && errno == EINTR) {
+        continue;
+      }
+      if (done <= 0) {
+        std::stringstream ss;
+        ss << "Out of core " << (write_ ? "write" : "read") << " failed: "
+           << (done < 0 ? std::strerror(errno) : "unexpected end of file") << std::endl;
+        throw std::logic_error(ss.str());
+      }
+      buffer_ += done;
+      bytes_ -= done;
+      offset_ += done;
+    }
+  }
+}
+
+OutOfCoreDriver::OutOfCoreDriver(const ConfigFile& config_) : _config(config_),
+                                                              _field_allocator(config_) {
+  _debug = _config.get_or_default("debug", false);
+  _performance_report = _config.get_or_default("performance_report", false);
+  _name = _config.get_or_default("name", std::string("prototype"));
+  _t_start = _config.get_or_default("start_time", 0.0);
+  _t_end = _config.get_or_default("end_time", 2.0);
+  _del_t = _config.get_or_default("timestep", 0.02);
+  _band_rows = _config.get_or_default("out_of_core_band_rows", 256);
+  _steps = _config.get_or_default("out_of_core_steps", 8);
+  _dir = _config.get_or_default("out_of_core_dir", std::string("."));
+  _output = _config.get_or_default("out_of_core_output", std::string(""));
+  int world_size;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &_world_rank);
+  if (world_size != 1) {
+    throw std::logic_error("out_of_core runs on a single rank");
+  }
+  if (_config.get_or_default("scheme", std::string("explicit")) != "explicit"
+      || _config.get_or_default("mesh_type", std::string("static")) != "static"
+      || _config.get_or_default("logical_dimensions", std::vector<int>()).size() > 2
+      || _config.get_or_default("single_buffer", false)
+      || _config.get_or_default("active_tiles", false)
+      || !_config.get_line_or_default("conductivity", "").empty()
+      || !_config.get_line_or_default("conductivity_field", "").empty()
+      || !_config.get_line_or_default("conductivity_subregions", "").empty()) {
+    throw std::logic_error("out_of_core runs the explicit scheme on a 2D static mesh "
+                           "with two buffers, without active_tiles or conductivity");
+  }
+  if (_config.get_or_default("initial_field_reader", std::string("mmap")) != "mmap") {
+    throw std::logic_error("out_of_core reads initial_field with the mmap reader");
+  }
+  if (_band_rows < 1 || _steps < 1) {
+    throw std::logic_error("out_of_core_band_rows and out_of_core_steps must be positive");
+  }
+  _mesh = new BandMesh(_config);
+  _mesh->set_profiler(&_profiler);
+  _calculation = new Calculation(_config, _mesh);
+  _calculation->set_profiler(&_profiler);
+  const long core_rows = static_cast<long>(_mesh->get_world_core_row_count());
+  _rows = core_rows + 2;
+  _row_span = _mesh->get_node_augmented_col_count();
+  _bands = static_cast<int>((core_rows + _band_rows - 1) / _band_rows);
+  const long window = (_band_rows + 2L * _steps) * _row_span;
+  for (int s = 0; s < 3; ++s) {
+    _slots[s].window[0] = _field_allocator.allocate(window);
+    _slots[s].window[1] = _field_allocator.allocate(window);
+    _slots[s].reading = false;
+    _slots[s].writing = false;
+  }
+  for (int f = 0; f < 2; ++f) {
+    std::stringstream ss;
+    ss << _dir << "/" << _name << "_out_of_core." << _world_rank << "." << f;
+    _paths[f] = ss.str();
+    _fds[f] = open(_paths[f].c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (_fds[f] < 0) {
+      std::stringstream es;
+      es << "Cannot create out of core field file " << _paths[f] << ": "
+         << std::strerror(errno) << std::endl;
+      throw std::logic_error(es.str());
+    }
+  }
+  _current = 0;
+  if (_performance_report) {
+    std::cout << "Out of core: " << _bands << " band(s) of " << _band_rows << " rows, "
+              << _steps << " steps per pass, windows "
+              << 6.0 * window * sizeof(double) / (1 << 20) << " MB, field files "
+              << 2.0 * _rows * _row_span * sizeof(double) / (1 << 20) << " MB" << std::endl;
+  }
+  populate();
+}
+
+OutOfCoreDriver::~OutOfCoreDriver() {
+  for (int f = 0; f < 2; ++f) {
+    close(_fds[f]);
+    unlink(_paths[f].c_str());
+  }
+  for (int s = 0; s < 3; ++s) {
+    _field_allocator.release(_slots[s].window[0]);
+    _field_allocator.release(_slots[s].window[1]);
+  }
+  delete _calculation;
+  delete _mesh;
+}
+
+void OutOfCoreDriver::band_rows(int band_, long& first_, long& end_) const {
+  first_ = 1 + static_cast<long>(band_) * _band_rows;
+  end_ = std::min(first_ + _band_rows, _rows - 1);
+  if (first_ == 1) {
+    first_ = 0;
+  }
+  if (end_ == _rows - 1) {
+    end_ = _rows;
+  }
+}
+
+void OutOfCoreDriver::window_rows(int band_, int steps_, long& first_, long& end_) const {
+  band_rows(band_, first_, end_);
+  first_ = std::max(first_ - steps_, 0L);
+  end_ = std::min(end_ + steps_, _rows);
+}
+
+void OutOfCoreDriver::populate() {
+  DataSource ds(_config);
+  Slot& slot = _slots[0];
+  for (int b = 0; b < _bands; ++b) {
+    long first, end;
+    band_rows(b, first, end);
+    _mesh->set_window(slot.window[0], slot.window[1], first, end - first);
+    ds.populate_field(_mesh, slot.window[0]);
+    transfer(_fds[_current], reinterpret_cast<char *>(slot.window[0]),
+             (end - first) * _row_span * sizeof(double),
+             first * _row_span * sizeof(double), true);
+  }
+}
+
+void OutOfCoreDriver::start_io(struct aiocb& cb_, int fd_, double *buffer_,
+                               long first_row_, long rows_, bool write_) {
+  std::memset(&cb_, 0, sizeof(cb_));
+  cb_.aio_fildes = fd_;
+  cb_.aio_buf = buffer_;
+  cb_.aio_nbytes = rows_ * _row_span * sizeof(double);
+  cb_.aio_offset = first_row_ * _row_span * sizeof(double);
+  if ((write_ ? aio_write(&cb_) : aio_read(&cb_)) != 0) {
+    // Out of AIO resources: do it now instead
+    transfer(fd_, reinterpret_cast<char *>(buffer_), cb_.aio_nbytes, cb_.aio_offset, write_);
+    cb_.aio_nbytes = 0;
+  }
+}
+
+void OutOfCoreDriver::finish_io(struct aiocb& cb_, bool write_) {
+  if (cb_.aio_nbytes == 0) {
+    return;
+  }
+  const struct aiocb *list[1] = { &cb_ };
+  int error;
+  while ((error = aio_error(&cb_)) == EINPROGRESS) {
+    aio_suspend(list, 1, 0);
+  }
+  const ssize_t done = aio_return(&cb_);
+  if (error != 0 || done < 0) {
+    std::stringstream ss;
+    ss << "Out of core " << (write_ ? "write" : "read") << " failed: "
+       << std::strerror(error) << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  // Finish any short transfer synchronously
+  transfer(cb_.aio_fildes, (char *)cb_.aio_buf + done, cb_.aio_nbytes - done,
+           cb_.aio_offset + done, write_);
+}
+
+double OutOfCoreDriver::pass(int steps_) {
+  const int next = 1 - _current;
+  const int cols = _mesh->get_node_core_col_count();
+  double total = 0;
+  long first, end;
+  window_rows(0, steps_, first, end);
+  start_io(_slots[0].read, _fds[_current], _slots[0].window[0], first, end - first, false);
+  _slots[0].reading = true;
+  for (int b = 0; b < _bands; ++b) {
+    Slot& slot = _slots[b % 3];
+    // The slot a band ahead last held band b - 2, whose write must land
+    // before its windows are read into
+    if (b + 1 < _bands) {
+      Slot& ahead = _slots[(b + 1) % 3];
+      long ahead_first, ahead_end;
+      window_rows(b + 1, steps_, ahead_first, ahead_end);
+      {
+        ScopedPhase phase(&_profiler, OUTPUT);
+        if (ahead.writing) {
+          finish_io(ahead.write, true);
+          ahead.writing = false;
+        }
+      }
+      start_io(ahead.read, _fds[_current], ahead.window[0], ahead_first,
+               ahead_end - ahead_first, false);
+      ahead.reading = true;
+    }
+    {
+      ScopedPhase phase(&_profiler, OUTPUT);
+      finish_io(slot.read, false);
+      slot.reading = false;
+    }
+    window_rows(b, steps_, first, end);
+    _mesh->set_window(slot.window[0], slot.window[1], first, end - first);
+    long own_first, own_end;
+    band_rows(b, own_first, own_end);
+    const long own_core = std::min(own_end, _rows - 1) - std::max(own_first, 1L);
+    for (int s = 0; s < steps_; ++s) {
+      {
+        ScopedPhase phase(&_profiler, COMPUTE);
+        _calculation->step(_del_t);
+      }
+      _profiler.count_cell_updates(own_core * cols);
+      _mesh->advance();
+    }
+    double *result = _mesh->get_u0() + (own_first - first) * _row_span;
+    if (_debug) {
+      for (long i = std::max(own_first, 1L); i < std::min(own_end, _rows - 1); ++i) {
+        for (int j = 1; j <= cols; ++j) {
+          total += result[(i - own_first) * _row_span + j];
+        }
+      }
+    }
+    start_io(slot.write, _fds[next], result, own_first, own_end - own_first, true);
+    slot.writing = true;
+  }
+  {
+    ScopedPhase phase(&_profiler, OUTPUT);
+    for (int s = 0; s < 3; ++s) {
+      if (_slots[s].writing) {
+        finish_io(_slots[s].write, true);
+        _slots[s].writing = false;
+      }
+    }
+  }
+  _current = next;
+  return total;
+}
+
+void OutOfCoreDriver::write_output() {
+  int fd = open(_output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::stringstream ss;
+    ss << "Cannot create out_of_core_output " << _output << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  const int cols = _mesh->get_node_core_col_count();
+  double *window = _slots[0].window[0];
+  for (int b = 0; b < _bands; ++b) {
+    long first, end;
+    band_rows(b, first, end);
+    transfer(_fds[_current], reinterpret_cast<char *>(window),
+             (end - first) * _row_span * sizeof(double),
+             first * _row_span * sizeof(double), false);
+    for (long i = std::max(first, 1L); i < std::min(end, _rows - 1); ++i) {
+      transfer(fd, reinterpret_cast<char *>(&window[(i - first) * _row_span + 1]),
+               cols * sizeof(double), (i - 1) * cols * sizeof(double), true);
+    }
+  }
+  close(fd);
+}
+
+void OutOfCoreDriver::run() {
+  double wall_start, wall_stop;
+  double cpu_start, cpu_stop;
+  // The steps Driver would take
+  int steps = 0;
+  double t_now = _t_start;
+  while (t_now < _t_end) { // doublecompare
+    ++steps;
+    t_now += _del_t;
+  }
+  if (_debug) {
+    std::cout << " ++ RUN BEGINNING ++ " << std::endl;
+  }
+  timers(wall_start, cpu_start); // start timing
+  int step = 0;
+  t_now = _t_start;
+  while (step < steps) {
+    const int pass_steps = std::min(_steps, steps - step);
+    const double temp = pass(pass_steps);
+    for (int s = 0; s < pass_steps; ++s) {
+      t_now += _del_t;
+    }
+    step += pass_steps;
+    if (_debug) {
+      std::cout << " Pass ending at step " << step << ",\n\ttnow = " << t_now
+                << "\n\ttotal temp:" << temp << std::endl;
+    }
+  }
+  timers(wall_stop, cpu_stop); // stop timing
+  if (!_output.empty()) {
+    write_output();
+  }
+  if (_debug) {
+    std::cout << " ++ RUN FINISHING ++ " << std::endl;
+  }
+  std::cout << "Timings: wallclock:" << (wall_stop - wall_start) << "s\n"
+               "         cpu clock:" << (cpu_stop - cpu_start) << std::endl;
+  _profiler.report(MPI_COMM_WORLD, std::cout);
+  if (_performance_report) {
+    FieldAllocator::report(MPI_COMM_WORLD, std::cout);
+  }
+}
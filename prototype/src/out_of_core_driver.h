@@ -0,0 +1,76 @@
+#ifndef OUT_OF_CORE_DRIVER_H
+#define OUT_OF_CORE_DRIVER_H
+
+#include <aio.h>
+#include <string>
+
+#include "config_file.h"
+#include "field_allocator.h"
+#include "profiler.h"
+
+class BandMesh;
+class Calculation;
+// Runs an explicit 2D simulation whose field lives in files rather than
+// memory, in place of Driver when out_of_core is set:
+//   out_of_core_dir        - where the two field files go (.)
+//   out_of_core_band_rows  - core rows per band streamed through memory (256)
+//   out_of_core_steps      - steps taken per pass over the files (8)
+//   out_of_core_output     - if set, the final core field is written there
+//                            raw, as initial_field reads it
+// Each pass reads every band, deepened by a ghost row per step at each end,
+// from one file, takes the steps on it, and writes the band's own rows to
+// the other file. Reads run one band ahead and writes drain behind the
+// compute through POSIX AIO, so a rank needs three windows of
+// (band_rows + 2 * steps) rows in memory, whatever the domain size.
+class OutOfCoreDriver {
+ public:
+  OutOfCoreDriver(const ConfigFile& config_);
+  ~OutOfCoreDriver();
+  void run();
+
+ private:
+  // A band in flight: its read, its compute buffers and its write
+  struct Slot {
+    double *window[2];
+    struct aiocb read;
+    struct aiocb write;
+    bool reading;
+    bool writing;
+  };
+  // Augmented rows a band owns: [first_, end_), ghosts included at the edges
+  void band_rows(int band_, long& first_, long& end_) const;
+  // Augmented rows a band reads for steps_ steps: its own, deepened by steps_
+  void window_rows(int band_, int steps_, long& first_, long& end_) const;
+  void populate();
+  // steps_ steps from file _current to the other; returns the total temp
+  double pass(int steps_);
+  void start_io(struct aiocb& cb_, int fd_, double *buffer_, long first_row_,
+                long rows_, bool write_);
+  void finish_io(struct aiocb& cb_, bool write_);
+  void write_output();
+
+  const ConfigFile& _config;
+  bool _debug;
+  bool _performance_report;
+  std::string _name;
+  double _t_start;
+  double _t_end;
+  double _del_t;
+  int _band_rows;
+  int _steps;
+  int _bands;
+  long _rows;      // augmented rows of the domain
+  long _row_span;  // augmented columns
+  std::string _dir;
+  std::string _output;
+  std::string _paths[2];
+  int _fds[2];
+  int _current;    // file holding the field now
+  Slot _slots[3];
+  BandMesh * _mesh;
+  Calculation * _calculation;
+  Profiler _profiler;
+  FieldAllocator _field_allocator;
+  int _world_rank;
+};
+#endif
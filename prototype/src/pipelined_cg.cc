@@ -0,0 +1,234 @@
+#include "pipelined_cg.h"
+
+#include <mpi.h>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "config_file.h"
+#include "mesh.h"
+#include "distributed_mesh.h"
+
+PipelinedCg::PipelinedCg(const ConfigFile& config_, Mesh *mesh_) : _config(config_),
+                                                                   _mesh(mesh_),
+                                                                   _last_residual(0),
+                                                                   _last_sweeps(0),
+                                                                   _cx(-1),
+                                                                   _cy(-1) {
+  DistributedMesh *distributed = dynamic_cast<DistributedMesh *>(mesh_);
+  if (!distributed) {
+    throw std::logic_error("Pipelined CG needs a distributed mesh");
+  }
+  _comm = distributed->get_cart_comm();
+  _top_boundary = !distributed->has_top_neighbour();
+  _bottom_boundary = !distributed->has_bottom_neighbour();
+  _left_boundary = !distributed->has_left_neighbour();
+  _right_boundary = !distributed->has_right_neighbour();
+  _tolerance = _config.get_or_default("cg_tolerance", 1.0e-8);
+  _max_iterations = _config.get_or_default("cg_max_iterations", 1000);
+  _replace_interval = _config.get_or_default("cg_replace_interval", 50);
+  std::string preconditioner = _config.get_or_default("cg_preconditioner",
+                                                      std::string("block_sgs"));
+  if (preconditioner == "block_sgs") {
+    _block_sgs = true;
+  } else if (preconditioner == "jacobi") {
+    _block_sgs = false;
+  } else {
+    std::stringstream ss;
+    ss << "Unknown CG preconditioner: " << preconditioner << std::endl;
+    throw std::logic_error(ss.str());
+  }
+  _rows = _mesh->get_node_core_row_count();
+  _cols = _mesh->get_node_core_col_count();
+  _x_span = _mesh->get_node_augmented_col_count();
+  const int cells = _mesh->get_node_augmented_cell_count();
+  _diagonal.assign(cells, 0.0);
+  _r.assign(cells, 0.0);
+  _u.assign(cells, 0.0);
+  _w.assign(cells, 0.0);
+  _m.assign(cells, 0.0);
+  _n.assign(cells, 0.0);
+  _z.assign(cells, 0.0);
+  _q.assign(cells, 0.0);
+  _s.assign(cells, 0.0);
+  _p.assign(cells, 0.0);
+}
+
+PipelinedCg::~PipelinedCg() {}
+
+double PipelinedCg::get_last_residual() const {
+  return _last_residual;
+}
+
+double PipelinedCg::get_last_sweeps() const {
+  return _last_sweeps;
+}
+
+void PipelinedCg::set_coefficient(double coefficient_) {
+  const double dx = _mesh->get_del_x();
+  const double dy = _mesh->get_del_y();
+  const double cx = coefficient_ / (dx * dx);
+  const double cy = coefficient_ / (dy * dy);
+  if (cx == _cx && cy == _cy) {
+    return;
+  }
+  _cx = cx;
+  _cy = cy;
+  // A reflected ghost cell equals its neighbour, folding it into the diagonal
+  for (int i = 1; i < _rows + 1; ++i) {
+    for (int j = 1; j < _cols + 1; ++j) {
+      double diagonal = 1.0 + 2.0 * cx + 2.0 * cy;
+      if (i == 1 && _top_boundary) diagonal -= cy;
+      if (i == _rows && _bottom_boundary) diagonal -= cy;
+      if (j == 1 && _left_boundary) diagonal -= cx;
+      if (j == _cols && _right_boundary) diagonal -= cx;
+      _diagonal[i * _x_span + j] = diagonal;
+    }
+  }
+}
+
+void PipelinedCg::apply_operator(double *in_, double *out_) {
+  _last_sweeps += 1;
+  _mesh->update_halo(in_);
+  const double diagonal = 1.0 + 2.0 * _cx + 2.0 * _cy;
+  for (int i = 1; i < _rows + 1; ++i) {
+    for (int j = 1; j < _cols + 1; ++j) {
+      const int center = i * _x_span + j;
+      out_[center] = diagonal * in_[center]
+                     - _cx * (in_[center - 1] + in_[center + 1])
+                     - _cy * (in_[center - _x_span] + in_[center + _x_span]);
+    }
+  }
+}
+
+void PipelinedCg::apply_preconditioner(const double *in_, double *out_) {
+  if (!_block_sgs) {
+    for (int i = 1; i < _rows + 1; ++i) {
+      for (int j = 1; j < _cols + 1; ++j) {
+        const int center = i * _x_span + j;
+        out_[center] = in_[center] / _diagonal[center];
+      }
+    }
+    return;
+  }
+  _last_sweeps += 2;
+  // M = (D + L) D^-1 (D + U) over this rank's block: a forward sweep
+  // solves (D + L) y = in, a backward sweep (D + U) out = D y
+  for (int i = 1; i < _rows + 1; ++i) {
+    for (int j = 1; j < _cols + 1; ++j) {
+      const int center = i * _x_span + j;
+      double sum = in_[center];
+      if (j > 1) sum += _cx * out_[center - 1];
+      if (i > 1) sum += _cy * out_[center - _x_span];
+      out_[center] = sum / _diagonal[center];
+    }
+  }
+  for (int i = _rows; i > 0; --i) {
+    for (int j = _cols; j > 0; --j) {
+      const int center = i * _x_span + j;
+      double sum = 0;
+      if (j < _cols) sum += _cx * out_[center + 1];
+      if (i < _rows) sum += _cy * out_[center + _x_span];
+      out_[center] += sum / _diagonal[center];
+    }
+  }
+}
+
+void PipelinedCg::replace_residual(const double *rhs_, double *x_) {
+  // Recompute the recurrence vectors from their definitions:
+  // r = b - A x, u = M^-1 r, w = A u, s = A p, q = M^-1 s, z = A q
+  apply_operator(x_, &_r[0]);
+  for (int i = 1; i < _rows + 1; ++i) {
+    for (int j = 1; j < _cols + 1; ++j) {
+      const int center = i * _x_span + j;
+      _r[center] = rhs_[center] - _r[center];
+    }
+  }
+  apply_preconditioner(&_r[0], &_u[0]);
+  apply_operator(&_u[0], &_w[0]);
+  apply_operator(&_p[0], &_s[0]);
+  apply_preconditioner(&_s[0], &_q[0]);
+  apply_operator(&_q[0], &_z[0]);
+}
+
+int PipelinedCg::solve(double coefficient_, const double *rhs_, double *x_) {
+  set_coefficient(coefficient_);
+  _last_sweeps = 0;
+  double local[3] = {0, 0, 0};
+  for (int i = 1; i < _rows + 1; ++i) {
+    for (int j = 1; j < _cols + 1; ++j) {
+      const int center = i * _x_span + j;
+      local[0] += rhs_[center] * rhs_[center];
+      _p[center] = 0;
+    }
+  }
+  double rhs_norm = 0;
+  MPI_Allreduce(local, &rhs_norm, 1, MPI_DOUBLE, MPI_SUM, _comm);
+  rhs_norm = std::sqrt(rhs_norm);
+  replace_residual(rhs_, x_);
+  double gamma_old = 0;
+  double alpha_old = 0;
+  int iteration = 0;
+  while (true) {
+    local[0] = 0;
+    local[1] = 0;
+    local[2] = 0;
+    for (int i = 1; i < _rows + 1; ++i) {
+      for (int j = 1; j < _cols + 1; ++j) {
+        const int center = i * _x_span + j;
+        local[0] += _r[center] * _u[center];
+        local[1] += _w[center] * _u[center];
+        local[2] += _r[center] * _r[center];
+      }
+    }
+    double global[3];
+    MPI_Request request;
+    MPI_Iallreduce(local, global, 3, MPI_DOUBLE, MPI_SUM, _comm, &request);
+    apply_preconditioner(&_w[0], &_m[0]);
+    apply_operator(&_m[0], &_n[0]);
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+    const double gamma = global[0];
+    const double delta = global[1];
+    const double residual = std::sqrt(global[2]);
+    if (residual <= _tolerance * rhs_norm || residual == 0) {
+      _last_residual = rhs_norm > 0 ? residual / rhs_norm : residual;
+      return iteration;
+    }
+    if (iteration == _max_iterations) {
+      std::stringstream msg;
+      msg << "CG did not converge in " << _max_iterations
+          << " iterations, relative residual " << residual / rhs_norm;
+      throw std::logic_error(msg.str());
+    }
+    double alpha;
+    double beta;
+    if (iteration == 0) {
+      beta = 0;
+      alpha = gamma / delta;
+    } else {
+      beta = gamma / gamma_old;
+      alpha = gamma / (delta - beta * gamma / alpha_old);
+    }
+    for (int i = 1; i < _rows + 1; ++i) {
+      for (int j = 1; j < _cols + 1; ++j) {
+        const int c = i * _x_span + j;
+        _z[c] = _n[c] + beta * _z[c];
+        _q[c] = _m[c] + beta * _q[c];
+        _s[c] = _w[c] + beta * _s[c];
+        _p[c] = _u[c] + beta * _p[c];
+        x_[c] += alpha * _p[c];
+        _r[c] -= alpha * _s[c];
+        _u[c] -= alpha * _q[c];
+        _w[c] -= alpha * _z[c];
+      }
+    }
+    gamma_old = gamma;
+    alpha_old = alpha;
+    ++iteration;
+    if (_replace_interval > 0 && iteration % _replace_interval == 0) {
+      replace_residual(rhs_, x_);
+    }
+  }
+}
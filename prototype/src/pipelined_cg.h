@@ -0,0 +1,69 @@
+#ifndef PIPELINED_CG_H
+#define PIPELINED_CG_H
+
+#include <mpi.h>
+#include <vector>
+
+#include "implicit_solver.h"
+
+class ConfigFile;
+class Mesh;
+class DistributedMesh;
+
+// Matrix-free preconditioned conjugate gradients in the pipelined form of
+// Ghysels and Vanroose: the three dot products of an iteration go into a
+// single MPI_Iallreduce, which is in flight while the preconditioner and
+// the stencil (with its halo exchange) are applied to the next direction.
+// Preconditioners need no communication:
+//   jacobi    - the operator's diagonal,
+//   block_sgs - one symmetric Gauss-Seidel sweep over this rank's block,
+//               ignoring the couplings to other ranks (default).
+// The recurrences drift from the true residual over many iterations, so
+// it is recomputed every cg_replace_interval iterations.
+class PipelinedCg : public ImplicitSolver {
+ public:
+  PipelinedCg(const ConfigFile& config_, Mesh *mesh_);
+  ~PipelinedCg();
+  // Iterates until |b - A x| <= cg_tolerance * |b|
+  int solve(double coefficient_, const double *rhs_, double *x_);
+  double get_last_residual() const;
+  double get_last_sweeps() const;
+
+ private:
+  void set_coefficient(double coefficient_);
+  void apply_operator(double *in_, double *out_);
+  void apply_preconditioner(const double *in_, double *out_);
+  void replace_residual(const double *rhs_, double *x_);
+
+  const ConfigFile& _config;
+  Mesh * const _mesh;
+  MPI_Comm _comm;
+  double _tolerance;
+  int _max_iterations;
+  int _replace_interval;
+  bool _block_sgs;
+  double _last_residual;
+  double _last_sweeps;
+  int _rows;
+  int _cols;
+  int _x_span;
+  double _cx;
+  double _cy;
+  // Diagonal of the operator, lowered next to reflecting boundaries
+  std::vector<double> _diagonal;
+  bool _top_boundary;
+  bool _bottom_boundary;
+  bool _left_boundary;
+  bool _right_boundary;
+  // Recurrence vectors, names as in the paper
+  std::vector<double> _r;
+  std::vector<double> _u;
+  std::vector<double> _w;
+  std::vector<double> _m;
+  std::vector<double> _n;
+  std::vector<double> _z;
+  std::vector<double> _q;
+  std::vector<double> _s;
+  std::vector<double> _p;
+};
+#endif
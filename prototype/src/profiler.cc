@@ -0,0 +1,195 @@
+#include "profiler.h"
+
+#include <mpi.h>
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+#include <sys/resource.h>
+
+#include "tools-inl.h"
+#include "tracer.h"
+#include "hardware_counters.h"
+
+Profiler::Profiler() : _tracer(0), _counters(0) {
+  reset();
+}
+
+Profiler::~Profiler() {}
+
+void Profiler::begin(int phase_) {
+  const double now = monotonic_seconds();
+  if (_depth > 0) {
+    const int outer = _open[_depth - 1];
+    if (_counters) {
+      _counters->end(outer);
+    }
+    _total[outer] += now - _resumed[outer];
+  }
+  if (_depth < PHASE_COUNT) {
+    _open[_depth++] = phase_;
+  }
+  if (_counters) {
+    _counters->begin(phase_);
+  }
+  _start[phase_] = now;
+  _resumed[phase_] = now;
+}
+
+void Profiler::end(int phase_) {
+  const double now = monotonic_seconds();
+  if (_counters) {
+    _counters->end(phase_);
+  }
+  _total[phase_] += now - _resumed[phase_];
+  ++_count[phase_];
+  if (_depth > 0) {
+    --_depth;
+  }
+  if (_depth > 0) {
+    const int outer = _open[_depth - 1];
+    _resumed[outer] = now;
+    if (_counters) {
+      _counters->begin(outer);
+    }
+  }
+  if (_tracer) {
+    _tracer->record_phase(phase_, _start[phase_], now);
+  }
+}
+
+void Profiler::reset() {
+  for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+    _start[phase] = 0;
+    _resumed[phase] = 0;
+    _total[phase] = 0;
+    _count[phase] = 0;
+  }
+  _depth = 0;
+  _cell_updates = 0;
+  _halo_bytes = 0;
+  _tiles_computed = 0;
+  _tiles_considered = 0;
+  _halo_messages = 0;
+  _halo_unchanged = 0;
+}
+
+double Profiler::get_total(int phase_) const {
+  return _total[phase_];
+}
+
+long Profiler::get_count(int phase_) const {
+  return _count[phase_];
+}
+
+void Profiler::count_cell_updates(long cells_) {
+  _cell_updates += cells_;
+}
+
+void Profiler::count_halo_bytes(double bytes_) {
+  _halo_bytes += bytes_;
+}
+
+void Profiler::count_tiles(long computed_, long considered_) {
+  _tiles_computed += computed_;
+  _tiles_considered += considered_;
+}
+
+void Profiler::count_halo_messages(long posted_, long unchanged_) {
+  _halo_messages += posted_;
+  _halo_unchanged += unchanged_;
+}
+
+long Profiler::get_cell_updates() const {
+  return _cell_updates;
+}
+
+double Profiler::get_halo_bytes() const {
+  return _halo_bytes;
+}
+
+void Profiler::set_tracer(Tracer *tracer_) {
+  _tracer = tracer_;
+}
+
+void Profiler::set_counters(HardwareCounters *counters_) {
+  _counters = counters_;
+}
+
+void Profiler::trace_message(int kind_, int peer_, double bytes_) {
+  if (_tracer) {
+    _tracer->record_message(kind_, peer_, bytes_, monotonic_seconds());
+  }
+}
+
+const char* Profiler::phase_name(int phase_) {
+  switch (phase_) {
+    case (COMPUTE): return "compute";
+    case (REFLECT): return "reflect";
+    case (HALO_POST): return "halo_post";
+    case (HALO_WAIT): return "halo_wait";
+    case (OUTPUT): return "output";
+  }
+  return "unknown";
+}
+
+void Profiler::report(MPI_Comm comm_, std::ostream& os_) const {
+  int rank, size;
+  MPI_Comm_rank(comm_, &rank);
+  MPI_Comm_size(comm_, &size);
+  double min[PHASE_COUNT];
+  double max[PHASE_COUNT];
+  double sum[PHASE_COUNT];
+  MPI_Reduce(const_cast<double *>(_total), min, PHASE_COUNT, MPI_DOUBLE, MPI_MIN, 0, comm_);
+  MPI_Reduce(const_cast<double *>(_total), max, PHASE_COUNT, MPI_DOUBLE, MPI_MAX, 0, comm_);
+  MPI_Reduce(const_cast<double *>(_total), sum, PHASE_COUNT, MPI_DOUBLE, MPI_SUM, 0, comm_);
+  // ru_maxrss is in kilobytes on Linux
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  double peak_rss = usage.ru_maxrss / 1024.0;
+  std::vector<double> peak_rss_by_rank(size, 0.0);
+  MPI_Gather(&peak_rss, 1, MPI_DOUBLE, &peak_rss_by_rank[0], 1, MPI_DOUBLE, 0, comm_);
+  long activity[4] = {_tiles_computed, _tiles_considered, _halo_messages, _halo_unchanged};
+  long activity_sum[4];
+  MPI_Reduce(activity, activity_sum, 4, MPI_LONG, MPI_SUM, 0, comm_);
+  if (rank != 0) {
+    return;
+  }
+  std::ios::fmtflags flags = os_.flags();
+  std::streamsize precision = os_.precision();
+  os_.setf(std::ios::scientific, std::ios::floatfield);
+  os_.precision(4);
+  os_ << "Phase timings (s) across " << size << " ranks:\n";
+  for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+    const double mean = sum[phase] / size;
+    const double imbalance = mean > 0 ? max[phase] / mean : 1.0;
+    os_ << "  " << std::left << std::setw(10) << phase_name(phase) << std::right
+        << " min " << min[phase]
+        << " mean " << mean
+        << " max " << max[phase]
+        << " imbalance " << imbalance << "\n";
+  }
+  os_.setf(std::ios::fixed, std::ios::floatfield);
+  os_.precision(1);
+  double rss_min = peak_rss_by_rank[0];
+  double rss_max = peak_rss_by_rank[0];
+  double rss_sum = 0;
+  for (int r = 0; r < size; ++r) {
+    rss_min = std::min(rss_min, peak_rss_by_rank[r]);
+    rss_max = std::max(rss_max, peak_rss_by_rank[r]);
+    rss_sum += peak_rss_by_rank[r];
+  }
+  os_ << "Peak RSS (MB): min " << rss_min << " mean " << rss_sum / size
+      << " max " << rss_max << "\n";
+  for (int r = 0; r < size; ++r) {
+    os_ << "  rank " << r << " " << peak_rss_by_rank[r] << "\n";
+  }
+  if (activity_sum[1] > 0) {
+    os_ << "Active tiles: " << activity_sum[0] << " of " << activity_sum[1] << " swept ("
+        << 100.0 * activity_sum[0] / activity_sum[1] << "%), halo messages "
+        << activity_sum[2] << " of which " << activity_sum[3] << " unchanged markers\n";
+  }
+  os_.flush();
+  os_.flags(flags);
+  os_.precision(precision);
+}
@@ -0,0 +1,95 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <mpi.h>
+#include <ostream>
+
+class Tracer;
+class HardwareCounters;
+
+namespace {
+  enum Phase {
+    COMPUTE = 0,
+    REFLECT = 1,
+    HALO_POST = 2,
+    HALO_WAIT = 3,
+    OUTPUT = 4,
+    PHASE_COUNT = 5,
+  };
+}
+
+// Accumulates monotonic wall time per phase of a step on this rank. A phase
+// begun inside another one pauses it, so the totals are exclusive: halo
+// exchanges made from within compute, e.g. by the implicit solvers, count
+// as halo time only.
+class Profiler {
+ public:
+  Profiler();
+  ~Profiler();
+  void begin(int phase_);
+  void end(int phase_);
+  void reset();
+  double get_total(int phase_) const;
+  long get_count(int phase_) const;
+  // Work counters, so phase times can be turned into rates. A cell update
+  // is one cell of one stencil sweep, so rkl2 stages and implicit solver
+  // sweeps count as well as whole steps
+  void count_cell_updates(long cells_);
+  void count_halo_bytes(double bytes_);
+  long get_cell_updates() const;
+  double get_halo_bytes() const;
+  // Active tile tracking: tiles swept out of those considered, and halo
+  // messages posted out of which were bare "unchanged" markers
+  void count_tiles(long computed_, long considered_);
+  void count_halo_messages(long posted_, long unchanged_);
+  // Collective over comm_: min/mean/max and imbalance (max/mean) per phase,
+  // plus the peak RSS of every rank, printed by rank 0
+  void report(MPI_Comm comm_, std::ostream& os_) const;
+  static const char* phase_name(int phase_);
+  // Phases and messages are also recorded into tracer_ when one is set
+  void set_tracer(Tracer *tracer_);
+  void trace_message(int kind_, int peer_, double bytes_);
+  // Phases are also counted by counters_ when one is set
+  void set_counters(HardwareCounters *counters_);
+
+ private:
+  double _start[PHASE_COUNT];
+  double _resumed[PHASE_COUNT]; // since when the phase has been innermost
+  double _total[PHASE_COUNT];
+  int _open[PHASE_COUNT];       // phases begun and not ended, innermost last
+  int _depth;
+  long _count[PHASE_COUNT];
+  long _cell_updates;
+  double _halo_bytes;
+  long _tiles_computed;
+  long _tiles_considered;
+  long _halo_messages;
+  long _halo_unchanged;
+  Tracer *_tracer;
+  HardwareCounters *_counters;
+};
+
+// Times the enclosing scope; a null profiler makes it a no-op
+class ScopedPhase {
+ public:
+  ScopedPhase(Profiler *profiler_, int phase_);
+  ~ScopedPhase();
+
+ private:
+  Profiler * const _profiler;
+  const int _phase;
+};
+
+inline ScopedPhase::ScopedPhase(Profiler *profiler_, int phase_) : _profiler(profiler_),
+                                                                   _phase(phase_) {
+  if (_profiler) {
+    _profiler->begin(_phase);
+  }
+}
+
+inline ScopedPhase::~ScopedPhase() {
+  if (_profiler) {
+    _profiler->end(_phase);
+  }
+}
+#endif
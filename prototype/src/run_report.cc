@@ -0,0 +1,181 @@
+#include "run_report.h"
+
+#include <mpi.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+#include "tools-inl.h"
+#include "config_file.h"
+#include "profiler.h"
+#include "field_allocator.h"
+
+namespace {
+  // Fields gathered from each rank for the report
+  enum ReportField {
+    CELL_UPDATES = 0,
+    COMPUTE_TIME = 1,
+    HALO_BYTES = 2,
+    HALO_TIME = 3,
+    EXCHANGES = 4,
+    PROBE_BANDWIDTH = 5,
+    CACHE_RESIDENT = 6,
+    REPORT_FIELD_COUNT = 7,
+  };
+  // A rank whose cell rate is below this fraction of the median is flagged
+  const double kSlowRankFraction = 0.8;
+
+  double last_level_cache_bytes() {
+    long bytes = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (bytes <= 0) {
+      bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    }
+#endif
+    return bytes > 0 ? static_cast<double>(bytes) : 0.0;
+  }
+}
+
+const double RunReport::kBytesPerCellUpdate = 3 * sizeof(double);
+const double RunReport::kFlopsPerCellUpdate = 9;
+
+RunReport::RunReport(const ConfigFile& config_) : _probe_bandwidth(0) {
+  _probe_elements = config_.get_or_default("bandwidth_probe_elements", 1 << 22);
+  _probe_repetitions = config_.get_or_default("bandwidth_probe_repetitions", 5);
+  _cache_bytes = last_level_cache_bytes();
+}
+
+RunReport::~RunReport() {}
+
+void RunReport::probe_bandwidth(MPI_Comm comm_) {
+  const int n = _probe_elements;
+  std::vector<double> a(n, 1.0);
+  std::vector<double> b(n, 2.0);
+  std::vector<double> c(n, 0.5);
+  const double scalar = 3.0;
+  double best = 0;
+  for (int rep = 0; rep < _probe_repetitions; ++rep) {
+    MPI_Barrier(comm_);
+    const double start = monotonic_seconds();
+    for (int i = 0; i < n; ++i) {
+      a[i] = b[i] + scalar * c[i];
+    }
+    const double elapsed = monotonic_seconds() - start;
+    // Keep the sweep from being optimized away
+    b[rep % n] = a[(rep * 7) % n];
+    if (elapsed > 0) {
+      best = std::max(best, 3.0 * sizeof(double) * n / elapsed);
+    }
+  }
+  _probe_bandwidth = best;
+}
+
+double RunReport::get_probe_bandwidth() const {
+  return _probe_bandwidth;
+}
+
+void RunReport::report(const Profiler& profiler_, MPI_Comm comm_, std::ostream& os_) const {
+  int rank, size;
+  MPI_Comm_rank(comm_, &rank);
+  MPI_Comm_size(comm_, &size);
+  double local[REPORT_FIELD_COUNT];
+  local[CELL_UPDATES] = profiler_.get_cell_updates();
+  local[COMPUTE_TIME] = profiler_.get_total(COMPUTE);
+  local[HALO_BYTES] = profiler_.get_halo_bytes();
+  local[HALO_TIME] = profiler_.get_total(HALO_POST) + profiler_.get_total(HALO_WAIT);
+  local[EXCHANGES] = profiler_.get_count(HALO_WAIT);
+  local[PROBE_BANDWIDTH] = _probe_bandwidth;
+  // The last level cache is split between the ranks sharing this node
+  MPI_Comm node_comm;
+  MPI_Comm_split_type(comm_, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+  int node_size;
+  MPI_Comm_size(node_comm, &node_size);
+  MPI_Comm_free(&node_comm);
+  local[CACHE_RESIDENT] = _cache_bytes > 0
+                          && FieldAllocator::get_bytes_in_use() <= _cache_bytes / node_size;
+  std::vector<double> all(REPORT_FIELD_COUNT * size);
+  MPI_Gather(local, REPORT_FIELD_COUNT, MPI_DOUBLE,
+             &all[0], REPORT_FIELD_COUNT, MPI_DOUBLE, 0, comm_);
+  if (rank != 0) {
+    return;
+  }
+  std::vector<double> cell_rate(size);
+  for (int r = 0; r < size; ++r) {
+    const double *fields = &all[r * REPORT_FIELD_COUNT];
+    cell_rate[r] = fields[COMPUTE_TIME] > 0 ? fields[CELL_UPDATES] / fields[COMPUTE_TIME] : 0;
+  }
+  std::vector<double> sorted_rate(cell_rate);
+  std::sort(sorted_rate.begin(), sorted_rate.end());
+  const double median_rate = sorted_rate[size / 2];
+
+  std::ios::fmtflags flags = os_.flags();
+  std::streamsize precision = os_.precision();
+  os_.setf(std::ios::fixed, std::ios::floatfield);
+  os_.precision(2);
+  os_ << "Performance (diffuse kernel model: " << kBytesPerCellUpdate << " B, "
+      << kFlopsPerCellUpdate << " flop per cell update):\n";
+  os_ << std::setw(8) << "rank"
+      << std::setw(12) << "Mcell/s"
+      << std::setw(12) << "GB/s"
+      << std::setw(12) << "GFLOP/s"
+      << std::setw(12) << "probe GB/s"
+      << std::setw(10) << "%probe"
+      << std::setw(14) << "halo KB/exch"
+      << std::setw(12) << "halo MB/s" << "\n";
+  double total_cells = 0;
+  double max_compute = 0;
+  double total_probe = 0;
+  double total_halo_bytes = 0;
+  double max_halo_time = 0;
+  double total_exchanges = 0;
+  bool any_cached = false;
+  for (int r = 0; r < size; ++r) {
+    const double *fields = &all[r * REPORT_FIELD_COUNT];
+    const double bandwidth = cell_rate[r] * kBytesPerCellUpdate;
+    const double probe = fields[PROBE_BANDWIDTH];
+    const double exchanges = fields[EXCHANGES];
+    os_ << std::setw(8) << r
+        << std::setw(12) << cell_rate[r] * 1.0e-6
+        << std::setw(12) << bandwidth * 1.0e-9
+        << std::setw(12) << cell_rate[r] * kFlopsPerCellUpdate * 1.0e-9
+        << std::setw(12) << probe * 1.0e-9;
+    const bool cached = fields[CACHE_RESIDENT] > 0;
+    any_cached = any_cached || cached;
+    if (cached) {
+      os_ << std::setw(10) << "cache";
+    } else {
+      os_ << std::setw(10) << (probe > 0 ? 100.0 * bandwidth / probe : 0.0);
+    }
+    os_ << std::setw(14) << (exchanges > 0 ? fields[HALO_BYTES] / exchanges / 1024.0 : 0.0)
+        << std::setw(12) << (fields[HALO_TIME] > 0 ? fields[HALO_BYTES] / fields[HALO_TIME] * 1.0e-6 : 0.0)
+        << (cell_rate[r] < kSlowRankFraction * median_rate ? "  * slow" : "") << "\n";
+    total_cells += fields[CELL_UPDATES];
+    max_compute = std::max(max_compute, fields[COMPUTE_TIME]);
+    total_probe += probe;
+    total_halo_bytes += fields[HALO_BYTES];
+    max_halo_time = std::max(max_halo_time, fields[HALO_TIME]);
+    total_exchanges += exchanges;
+  }
+  // Aggregate rates are bounded by the slowest rank, as the step is synchronous
+  const double aggregate_rate = max_compute > 0 ? total_cells / max_compute : 0;
+  const double aggregate_bandwidth = aggregate_rate * kBytesPerCellUpdate;
+  os_ << std::setw(8) << "all"
+      << std::setw(12) << aggregate_rate * 1.0e-6
+      << std::setw(12) << aggregate_bandwidth * 1.0e-9
+      << std::setw(12) << aggregate_rate * kFlopsPerCellUpdate * 1.0e-9
+      << std::setw(12) << total_probe * 1.0e-9;
+  if (any_cached) {
+    os_ << std::setw(10) << "cache";
+  } else {
+    os_ << std::setw(10) << (total_probe > 0 ? 100.0 * aggregate_bandwidth / total_probe : 0.0);
+  }
+  os_ << std::setw(14) << (total_exchanges > 0 ? total_halo_bytes / total_exchanges / 1024.0 : 0.0)
+      << std::setw(12) << (max_halo_time > 0 ? total_halo_bytes / max_halo_time * 1.0e-6 : 0.0)
+      << "\n";
+  os_.flush();
+  os_.flags(flags);
+  os_.precision(precision);
+}
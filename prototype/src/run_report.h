@@ -0,0 +1,36 @@
+#ifndef RUN_REPORT_H
+#define RUN_REPORT_H
+
+#include <mpi.h>
+#include <ostream>
+
+class ConfigFile;
+class Profiler;
+// Turns the profiled phase times into achieved rates, set against a
+// STREAM-like triad probe of this rank's memory bandwidth taken after the
+// run. %probe reads "cache" for ranks whose fields fit in their share of
+// the last level cache, as their stencil does not stream from memory.
+class RunReport {
+ public:
+  // Per cell update of the 5 point explicit kernel, assuming neighbour reuse
+  // in cache: read u0, write u1 and the write-allocate of u1.
+  static const double kBytesPerCellUpdate;
+  // 5 multiplies and 4 adds; the centre coefficient is loop invariant
+  static const double kFlopsPerCellUpdate;
+
+  RunReport(const ConfigFile& config_);
+  ~RunReport();
+  // Best of several triad sweeps, run concurrently by every rank of comm_ so
+  // ranks sharing a node see their share of its bandwidth
+  void probe_bandwidth(MPI_Comm comm_);
+  double get_probe_bandwidth() const;
+  // Collective over comm_, rank 0 prints one line per rank then the aggregate
+  void report(const Profiler& profiler_, MPI_Comm comm_, std::ostream& os_) const;
+
+ private:
+  int _probe_elements;
+  int _probe_repetitions;
+  double _probe_bandwidth;
+  double _cache_bytes; // last level cache, 0 when unknown
+};
+#endif
@@ -8,6 +8,8 @@
 
 #include "tools-inl.h"
 #include "config_file.h"
+#include "profiler.h"
+#include "tracer.h"
 
 StaticBlockingMesh::StaticBlockingMesh(const ConfigFile& config_, 
            MPI_Comm cart_comm_,
@@ -35,8 +37,13 @@ StaticBlockingMesh::StaticBlockingMesh(const ConfigFile& config_,
 
   _node_augmented_row_count = _node_core_row_count + 2;
   _node_augmented_col_count = _node_core_col_count + 2;
-  _u0 = new double[_node_augmented_row_count * _node_augmented_col_count];
-  _u1 = new double[_node_augmented_row_count * _node_augmented_col_count];
+  _u0 = _field_allocator.allocate(_node_augmented_row_count * _node_augmented_col_count);
+  if (is_single_buffer()) {
+    // Calculation updates u0 in place, advance() swaps it with itself
+    _u1 = _u0;
+  } else {
+    _u1 = _field_allocator.allocate(_node_augmented_row_count * _node_augmented_col_count);
+  }
   // Create MPI vector datatype to deal with column sending.
   MPI_Type_vector(_node_core_row_count, // # column height
                   1,                // 1 column only
@@ -47,12 +54,18 @@ StaticBlockingMesh::StaticBlockingMesh(const ConfigFile& config_,
 }
 
 StaticBlockingMesh::~StaticBlockingMesh() {
-  delete[] _u0;
-  delete[] _u1;
+  _field_allocator.release(_u0);
+  if (_u1 != _u0) {
+    _field_allocator.release(_u1);
+  }
 }
 
 void StaticBlockingMesh::reflect_boundary(int boundary_) {
   // n.b. use u1 as we're in the current timestep
+  reflect_field(boundary_, _u1);
+}
+
+void StaticBlockingMesh::reflect_field(int boundary_, double *field_) {
   int x_span = get_node_augmented_col_count();
   switch (boundary_) {
     case (TOP): {
@@ -60,7 +73,7 @@ void StaticBlockingMesh::reflect_boundary(int boundary_) {
       for (int j = 1; j < get_node_core_col_count() + 1; ++j) {
         const int top = (i - 1) * x_span + j;
         const int center = i * x_span + j;
-        _u1[top] = _u1[center];
+        field_[top] = field_[center];
       } 
     } break;
     case (BOTTOM): {
@@ -68,7 +81,7 @@ void StaticBlockingMesh::reflect_boundary(int boundary_) {
       for (int j = 1; j < get_node_core_col_count() + 1; ++j) {
         const int bottom = (i + 1) * x_span + j;
         const int center = i * x_span + j;
-        _u1[bottom] = _u1[center];
+        field_[bottom] = field_[center];
       } 
     } break;
     case (LEFT): {
@@ -76,7 +89,7 @@ void StaticBlockingMesh::reflect_boundary(int boundary_) {
       for (int i = 1; i < get_node_core_row_count() + 1; ++i) {
         const int left = i * x_span + (j - 1);
         const int center = i * x_span + j;
-        _u1[left] = _u1[center];
+        field_[left] = field_[center];
       }
     } break;
     case (RIGHT): {
@@ -84,53 +97,68 @@ void StaticBlockingMesh::reflect_boundary(int boundary_) {
       for (int i = 1; i < get_node_core_row_count() + 1; ++i) {
         const int right = i * x_span + (j + 1);
         const int center = i * x_span + j;
-        _u1[right] = _u1[center];
+        field_[right] = field_[center];
       }
     } break;
   }
 }
 
 void StaticBlockingMesh::advance() {
-  if (!has_top_neighbour()) {
-    reflect_boundary(TOP);
-  }
-  if (!has_bottom_neighbour()) {
-    reflect_boundary(BOTTOM);
-  }
-  if (!has_left_neighbour()) {
-    reflect_boundary(LEFT);
-  }
-  if (!has_right_neighbour()) {
-    reflect_boundary(RIGHT);
-  }
-  exchange_boundaries();
+  update_halo(_u1);
   // Now we've finished updating u1, we can swap it to u0
   std::swap(_u0, _u1);
 }
 
+void StaticBlockingMesh::update_halo(double *field_) {
+  {
+    ScopedPhase phase(_profiler, REFLECT);
+    if (!has_top_neighbour()) {
+      reflect_field(TOP, field_);
+    }
+    if (!has_bottom_neighbour()) {
+      reflect_field(BOTTOM, field_);
+    }
+    if (!has_left_neighbour()) {
+      reflect_field(LEFT, field_);
+    }
+    if (!has_right_neighbour()) {
+      reflect_field(RIGHT, field_);
+    }
+  }
+  exchange_field(field_);
+}
+
 void StaticBlockingMesh::exchange_boundaries() {
+  exchange_field(_u1);
+}
+
+void StaticBlockingMesh::exchange_field(double *field_) {
   // Plan: Use sendrecv as follows:
   // Colwise, odd up, even down          - TAGGED TOP
   // Colwise, odd down, even up          - TAGGED BOTTOM
   // Rowwise, odd left, even right       - TAGGED LEFT
   // Rowwise, odd right, even left       - TAGGED RIGHT
+  // Sendrecv blocks, so the whole exchange is spent waiting
+  ScopedPhase phase(_profiler, HALO_WAIT);
   MPI_Status status;
+  double halo_bytes = 0; // sent and received
   const int x_span = get_node_augmented_col_count();
   const int horizontal_cells = get_node_core_col_count();
   const int vertical_cells = get_node_core_row_count();
   const bool odd_row = get_node_row() & 1;
   const bool odd_col = get_node_col() & 1;
-  double * const up_sendbuf    = &_u1[1 * x_span + 1];
-  double * const down_sendbuf  = &_u1[vertical_cells * x_span + 1];
+  double * const up_sendbuf    = &field_[1 * x_span + 1];
+  double * const down_sendbuf  = &field_[vertical_cells * x_span + 1];
   double * const left_sendbuf  = up_sendbuf;
-  double * const right_sendbuf = &_u1[x_span + horizontal_cells];
-  double * const up_recvbuf    = &_u1[1];
-  double * const down_recvbuf  = &_u1[(vertical_cells + 1) * x_span + 1];
-  double * const left_recvbuf  = &_u1[x_span];
-  double * const right_recvbuf = &_u1[x_span + horizontal_cells + 1]; 
+  double * const right_sendbuf = &field_[x_span + horizontal_cells];
+  double * const up_recvbuf    = &field_[1];
+  double * const down_recvbuf  = &field_[(vertical_cells + 1) * x_span + 1];
+  double * const left_recvbuf  = &field_[x_span];
+  double * const right_recvbuf = &field_[x_span + horizontal_cells + 1]; 
 
   // STEP 1: Odd rows up, evens down. Note - odds always have top neighbour
   if ((odd_row && has_top_neighbour()) || (!odd_row && has_bottom_neighbour())) {
+    trace_message(SEND_POST, odd_row ? get_neighbour_rank(TOP) : get_neighbour_rank(BOTTOM), horizontal_cells * sizeof(double));
     MPI_Sendrecv(odd_row ? up_sendbuf : down_sendbuf,
                  horizontal_cells,
                  MPI_DOUBLE,
@@ -143,10 +171,13 @@ void StaticBlockingMesh::exchange_boundaries() {
                  TOP,
                  _cart_comm,
                  &status);
+    trace_message(RECV_COMPLETE, odd_row ? get_neighbour_rank(TOP) : get_neighbour_rank(BOTTOM), horizontal_cells * sizeof(double));
+    halo_bytes += 2.0 * horizontal_cells * sizeof(double);
 
   }
   // STEP 2: Odd rows down, evens up
   if ((odd_row && has_bottom_neighbour()) || (!odd_row && has_top_neighbour())) {
+    trace_message(SEND_POST, odd_row ? get_neighbour_rank(BOTTOM) : get_neighbour_rank(TOP), horizontal_cells * sizeof(double));
     MPI_Sendrecv(odd_row ? down_sendbuf : up_sendbuf,
                  horizontal_cells,
                  MPI_DOUBLE,
@@ -159,9 +190,12 @@ void StaticBlockingMesh::exchange_boundaries() {
                  BOTTOM,
                  _cart_comm,
                  &status);
+    trace_message(RECV_COMPLETE, odd_row ? get_neighbour_rank(BOTTOM) : get_neighbour_rank(TOP), horizontal_cells * sizeof(double));
+    halo_bytes += 2.0 * horizontal_cells * sizeof(double);
   }
   // STEP 3: Odd cols left, evens right
   if ((odd_col && has_left_neighbour()) || (!odd_col && has_right_neighbour())) {
+  trace_message(SEND_POST, odd_col ? get_neighbour_rank(LEFT) : get_neighbour_rank(RIGHT), vertical_cells * sizeof(double));
   MPI_Sendrecv(odd_col ? left_sendbuf : right_sendbuf,
                1,
                _col_type,
@@ -174,9 +208,12 @@ void StaticBlockingMesh::exchange_boundaries() {
                LEFT,
                _cart_comm,
                &status);
+  trace_message(RECV_COMPLETE, odd_col ? get_neighbour_rank(LEFT) : get_neighbour_rank(RIGHT), vertical_cells * sizeof(double));
+  halo_bytes += 2.0 * vertical_cells * sizeof(double);
   }
   // STEP 3: Odd cols right, evens left
   if ((odd_col && has_right_neighbour()) || (!odd_col && has_left_neighbour())) {
+  trace_message(SEND_POST, odd_col ? get_neighbour_rank(RIGHT): get_neighbour_rank(LEFT), vertical_cells * sizeof(double));
   MPI_Sendrecv(odd_col ? right_sendbuf : left_sendbuf,
                1,
                _col_type,
@@ -189,6 +226,11 @@ void StaticBlockingMesh::exchange_boundaries() {
                RIGHT,
                _cart_comm,
                &status);
+  trace_message(RECV_COMPLETE, odd_col ? get_neighbour_rank(RIGHT): get_neighbour_rank(LEFT), vertical_cells * sizeof(double));
+  halo_bytes += 2.0 * vertical_cells * sizeof(double);
+  }
+  if (_profiler) {
+    _profiler->count_halo_bytes(halo_bytes);
   }
 }
 
@@ -13,6 +13,7 @@ class StaticBlockingMesh : public DistributedMesh {
 
   void advance();
   void reflect_boundary(int boundary_);
+  void update_halo(double *field_);
   double * get_u0();
   double * get_u1();
   int get_node_core_row_count() const;
@@ -46,5 +47,7 @@ class StaticBlockingMesh : public DistributedMesh {
   int _node_augmented_row_count;
   int _node_augmented_col_count;
   void exchange_boundaries();
+  void reflect_field(int boundary_, double *field_);
+  void exchange_field(double *field_);
 };
 #endif
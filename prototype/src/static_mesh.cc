@@ -5,9 +5,13 @@
 #include <vector>
 #include <sstream>
 #include <string>
+#include <cstring>
+#include <limits>
 
 #include "tools-inl.h"
 #include "config_file.h"
+#include "profiler.h"
+#include "tracer.h"
 
 StaticMesh::StaticMesh(const ConfigFile& config_, 
            MPI_Comm cart_comm_,
@@ -32,8 +36,13 @@ StaticMesh::StaticMesh(const ConfigFile& config_,
 
   _node_augmented_row_count = _node_core_row_count + 2;
   _node_augmented_col_count = _node_core_col_count + 2;
-  _u0 = new double[_node_augmented_row_count * _node_augmented_col_count];
-  _u1 = new double[_node_augmented_row_count * _node_augmented_col_count];
+  _u0 = _field_allocator.allocate(_node_augmented_row_count * _node_augmented_col_count);
+  if (is_single_buffer()) {
+    // Calculation updates u0 in place, advance() swaps it with itself
+    _u1 = _u0;
+  } else {
+    _u1 = _field_allocator.allocate(_node_augmented_row_count * _node_augmented_col_count);
+  }
   // Create MPI vector datatype to deal with column sending.
   MPI_Type_vector(_node_core_row_count, // # column height
                   1,                // 1 column only
@@ -41,15 +50,36 @@ StaticMesh::StaticMesh(const ConfigFile& config_,
                   MPI_DOUBLE,
                   &_col_type);
   MPI_Type_commit(&_col_type);
+  _skip_unchanged_halo = _config.get_or_default("active_tiles", false);
+  // Reflected sides follow the core edge, which the caller tracks itself
+  _halo_changed[TOP] = has_top_neighbour();
+  _halo_changed[BOTTOM] = has_bottom_neighbour();
+  _halo_changed[LEFT] = has_left_neighbour();
+  _halo_changed[RIGHT] = has_right_neighbour();
+  for (int boundary = TOP; boundary <= RIGHT; ++boundary) {
+    if (_skip_unchanged_halo) {
+      const int cells = boundary == TOP || boundary == BOTTOM ? _node_core_col_count
+                                                              : _node_core_row_count;
+      // NaN matches nothing, so the first exchange always sends in full
+      _last_sent[boundary].assign(cells, std::numeric_limits<double>::quiet_NaN());
+      _last_received[boundary].assign(cells, std::numeric_limits<double>::quiet_NaN());
+    }
+  }
 }
 
 StaticMesh::~StaticMesh() {
-  delete[] _u0;
-  delete[] _u1;
+  _field_allocator.release(_u0);
+  if (_u1 != _u0) {
+    _field_allocator.release(_u1);
+  }
 }
 
 void StaticMesh::reflect_boundary(int boundary_) {
   // n.b. use u1 as we're in the current timestep
+  reflect_field(boundary_, _u1);
+}
+
+void StaticMesh::reflect_field(int boundary_, double *field_) {
   int x_span = get_node_augmented_col_count();
   switch (boundary_) {
     case (TOP): {
@@ -57,7 +87,7 @@ void StaticMesh::reflect_boundary(int boundary_) {
       for (int j = 1; j < get_node_core_col_count() + 1; ++j) {
         const int top = (i - 1) * x_span + j;
         const int center = i * x_span + j;
-        _u1[top] = _u1[center];
+        field_[top] = field_[center];
       } 
     } break;
     case (BOTTOM): {
@@ -65,7 +95,7 @@ void StaticMesh::reflect_boundary(int boundary_) {
       for (int j = 1; j < get_node_core_col_count() + 1; ++j) {
         const int bottom = (i + 1) * x_span + j;
         const int center = i * x_span + j;
-        _u1[bottom] = _u1[center];
+        field_[bottom] = field_[center];
       } 
     } break;
     case (LEFT): {
@@ -73,7 +103,7 @@ void StaticMesh::reflect_boundary(int boundary_) {
       for (int i = 1; i < get_node_core_row_count() + 1; ++i) {
         const int left = i * x_span + (j - 1);
         const int center = i * x_span + j;
-        _u1[left] = _u1[center];
+        field_[left] = field_[center];
       }
     } break;
     case (RIGHT): {
@@ -81,78 +111,219 @@ void StaticMesh::reflect_boundary(int boundary_) {
       for (int i = 1; i < get_node_core_row_count() + 1; ++i) {
         const int right = i * x_span + (j + 1);
         const int center = i * x_span + j;
-        _u1[right] = _u1[center];
+        field_[right] = field_[center];
       }
     } break;
   }
 }
 
 void StaticMesh::advance() {
-  if (!has_top_neighbour()) {
-    reflect_boundary(TOP);
-  }
-  if (!has_bottom_neighbour()) {
-    reflect_boundary(BOTTOM);
-  }
-  if (!has_left_neighbour()) {
-    reflect_boundary(LEFT);
-  }
-  if (!has_right_neighbour()) {
-    reflect_boundary(RIGHT);
-  }
-  exchange_boundaries();
+  update_halo(_u1);
   // Now we've finished updating u1, we can swap it to u0
   std::swap(_u0, _u1);
 }
 
+void StaticMesh::swap_fields() {
+  std::swap(_u0, _u1);
+}
+
+void StaticMesh::update_halo(double *field_) {
+  {
+    ScopedPhase phase(_profiler, REFLECT);
+    if (!has_top_neighbour()) {
+      reflect_field(TOP, field_);
+    }
+    if (!has_bottom_neighbour()) {
+      reflect_field(BOTTOM, field_);
+    }
+    if (!has_left_neighbour()) {
+      reflect_field(LEFT, field_);
+    }
+    if (!has_right_neighbour()) {
+      reflect_field(RIGHT, field_);
+    }
+  }
+  exchange_field(field_);
+}
+
 void StaticMesh::exchange_boundaries() {
+  exchange_field(_u1);
+}
+
+void StaticMesh::exchange_field(double *field_) {
   // Use a very simple | 0 | 1 | 0 | 1 | scheme
   // 0 sends right, 1 sends left, then flip
   const int x_span = get_node_augmented_col_count();
   const int horizontal_cells = get_node_core_col_count();
   int paircount = 0;
-  MPI_Request send_request[4]; // Has to be present but are not consulted
+  MPI_Request send_request[4];
   MPI_Request recv_request[4];
   MPI_Status  recv_status[4];
-  // TOP 
-  if (has_top_neighbour()){
-    const int i = 0;
-    const int j = 1;
-    MPI_Isend(&_u1[(i + 1) * x_span + j], horizontal_cells, MPI_DOUBLE, get_neighbour_rank(TOP), TOP, _cart_comm, &send_request[paircount]);
-    MPI_Irecv(&_u1[i * x_span + j], horizontal_cells, MPI_DOUBLE, get_neighbour_rank(TOP), BOTTOM, _cart_comm, &recv_request[paircount]);
-    ++paircount;
+  int recv_peer[4];
+  int recv_boundary[4];
+  double recv_bytes[4];
+  int unchanged_sends = 0;
+  double halo_bytes = 0; // sent, then received
+  {
+    ScopedPhase phase(_profiler, HALO_POST);
+    // TOP 
+    if (has_top_neighbour()){
+      const int i = 0;
+      const int j = 1;
+      const int count = is_send_unchanged(TOP, field_) ? 0 : horizontal_cells;
+      MPI_Isend(&field_[(i + 1) * x_span + j], count, MPI_DOUBLE, get_neighbour_rank(TOP), TOP, _cart_comm, &send_request[paircount]);
+      MPI_Irecv(&field_[i * x_span + j], horizontal_cells, MPI_DOUBLE, get_neighbour_rank(TOP), BOTTOM, _cart_comm, &recv_request[paircount]);
+      recv_boundary[paircount] = TOP;
+      unchanged_sends += count == 0;
+      recv_peer[paircount] = get_neighbour_rank(TOP);
+      recv_bytes[paircount] = horizontal_cells * sizeof(double);
+      trace_message(SEND_POST, recv_peer[paircount], recv_bytes[paircount]);
+      trace_message(RECV_POST, recv_peer[paircount], recv_bytes[paircount]);
+      ++paircount;
+      halo_bytes += 1.0 * count * sizeof(double);
+    }
+    // LEFT
+    if (has_left_neighbour()) {
+      const int i = 1;
+      const int j = 0;
+      // irecv to i, j; isend from i, j+1
+      const int count = is_send_unchanged(LEFT, field_) ? 0 : 1;
+      MPI_Isend(&field_[i * x_span + (j + 1)], count, _col_type, get_neighbour_rank(LEFT), LEFT, _cart_comm, &send_request[paircount]);
+      MPI_Irecv(&field_[i * x_span + j], 1, _col_type, get_neighbour_rank(LEFT), RIGHT, _cart_comm, &recv_request[paircount]);
+      recv_boundary[paircount] = LEFT;
+      unchanged_sends += count == 0;
+      recv_peer[paircount] = get_neighbour_rank(LEFT);
+      recv_bytes[paircount] = get_node_core_row_count() * sizeof(double);
+      trace_message(SEND_POST, recv_peer[paircount], recv_bytes[paircount]);
+      trace_message(RECV_POST, recv_peer[paircount], recv_bytes[paircount]);
+      ++paircount;
+      halo_bytes += 1.0 * count * get_node_core_row_count() * sizeof(double);
+    }
+    // BOTTOM
+    if (has_bottom_neighbour()){
+      const int i = get_node_core_row_count();
+      const int j = 1;
+      const int count = is_send_unchanged(BOTTOM, field_) ? 0 : horizontal_cells;
+      MPI_Isend(&field_[i * x_span + j], count, MPI_DOUBLE, get_neighbour_rank(BOTTOM), BOTTOM, _cart_comm, &send_request[paircount]);
+      MPI_Irecv(&field_[(i + 1) * x_span + j], horizontal_cells, MPI_DOUBLE, get_neighbour_rank(BOTTOM), TOP, _cart_comm, &recv_request[paircount]);
+      recv_boundary[paircount] = BOTTOM;
+      unchanged_sends += count == 0;
+      recv_peer[paircount] = get_neighbour_rank(BOTTOM);
+      recv_bytes[paircount] = horizontal_cells * sizeof(double);
+      trace_message(SEND_POST, recv_peer[paircount], recv_bytes[paircount]);
+      trace_message(RECV_POST, recv_peer[paircount], recv_bytes[paircount]);
+      ++paircount;
+      halo_bytes += 1.0 * count * sizeof(double);
+    }
+    // RIGHT
+    if (has_right_neighbour()) {
+      const int i = 1; 
+      const int j = get_node_core_col_count();
+      // irecv to i, j+1; isend from i, j
+      const int count = is_send_unchanged(RIGHT, field_) ? 0 : 1;
+      MPI_Isend(&field_[i * x_span + j], count, _col_type, get_neighbour_rank(RIGHT), RIGHT, _cart_comm, &send_request[paircount]);
+      MPI_Irecv(&field_[i * x_span + (j + 1)], 1, _col_type, get_neighbour_rank(RIGHT), LEFT, _cart_comm, &recv_request[paircount]);
+      recv_boundary[paircount] = RIGHT;
+      unchanged_sends += count == 0;
+      recv_peer[paircount] = get_neighbour_rank(RIGHT);
+      recv_bytes[paircount] = get_node_core_row_count() * sizeof(double);
+      trace_message(SEND_POST, recv_peer[paircount], recv_bytes[paircount]);
+      trace_message(RECV_POST, recv_peer[paircount], recv_bytes[paircount]);
+      ++paircount;
+      halo_bytes += 1.0 * count * get_node_core_row_count() * sizeof(double);
+    }
+
   }
-  // LEFT
-  if (has_left_neighbour()) {
-    const int i = 1;
-    const int j = 0;
-    // irecv to i, j; isend from i, j+1
-    MPI_Isend(&_u1[i * x_span + (j + 1)], 1, _col_type, get_neighbour_rank(LEFT), LEFT, _cart_comm, &send_request[paircount]);
-    MPI_Irecv(&_u1[i * x_span + j], 1, _col_type, get_neighbour_rank(LEFT), RIGHT, _cart_comm, &recv_request[paircount]);
-    ++paircount;
+  ScopedPhase phase(_profiler, HALO_WAIT);
+  MPI_Waitall(paircount, recv_request, recv_status);
+  // The sent core edges must not change until the sends are done, and a
+  // single buffered step starts overwriting them as soon as this returns
+  MPI_Waitall(paircount, send_request, MPI_STATUSES_IGNORE);
+  for (int req = 0; req < paircount; ++req) {
+    trace_message(RECV_COMPLETE, recv_peer[req], recv_bytes[req]);
   }
-  // BOTTOM
-  if (has_bottom_neighbour()){
-    const int i = get_node_core_row_count();
-    const int j = 1;
-    MPI_Isend(&_u1[i * x_span + j], horizontal_cells, MPI_DOUBLE, get_neighbour_rank(BOTTOM), BOTTOM, _cart_comm, &send_request[paircount]);
-    MPI_Irecv(&_u1[(i + 1) * x_span + j], horizontal_cells, MPI_DOUBLE, get_neighbour_rank(BOTTOM), TOP, _cart_comm, &recv_request[paircount]);
-    ++paircount;
+  for (int req = 0; req < paircount; ++req) {
+    if (_skip_unchanged_halo) {
+      int elements = 0;
+      MPI_Get_elements(&recv_status[req], MPI_DOUBLE, &elements);
+      settle_ghost(recv_boundary[req], field_, elements == 0);
+      halo_bytes += elements * sizeof(double);
+    } else {
+      halo_bytes += recv_bytes[req];
+    }
   }
-  // RIGHT
-  if (has_right_neighbour()) {
-    const int i = 1; 
-    const int j = get_node_core_col_count();
-    // irecv to i, j+1; isend from i, j
-    MPI_Isend(&_u1[i * x_span + j], 1, _col_type, get_neighbour_rank(RIGHT), RIGHT, _cart_comm, &send_request[paircount]);
-    MPI_Irecv(&_u1[i * x_span + (j + 1)], 1, _col_type, get_neighbour_rank(RIGHT), LEFT, _cart_comm, &recv_request[paircount]);
-    ++paircount;
+  if (_profiler) {
+    _profiler->count_halo_bytes(halo_bytes);
+    if (_skip_unchanged_halo) {
+      _profiler->count_halo_messages(paircount, unchanged_sends);
+    }
   }
+}
 
-  for (int req = 0; req < paircount; ++req) {
-    MPI_Request_free(&send_request[req]);
+bool StaticMesh::is_halo_changed(int boundary_) const {
+  return _halo_changed[boundary_];
+}
+
+void StaticMesh::edge_line(int boundary_, bool ghost_, int& start_, int& stride_, int& count_) const {
+  const int x_span = _node_augmented_col_count;
+  switch (boundary_) {
+    case (TOP):
+      start_ = (ghost_ ? 0 : 1) * x_span + 1;
+      stride_ = 1;
+      count_ = _node_core_col_count;
+      break;
+    case (BOTTOM):
+      start_ = (ghost_ ? _node_core_row_count + 1 : _node_core_row_count) * x_span + 1;
+      stride_ = 1;
+      count_ = _node_core_col_count;
+      break;
+    case (LEFT):
+      start_ = x_span + (ghost_ ? 0 : 1);
+      stride_ = x_span;
+      count_ = _node_core_row_count;
+      break;
+    default: // RIGHT
+      start_ = x_span + (ghost_ ? _node_core_col_count + 1 : _node_core_col_count);
+      stride_ = x_span;
+      count_ = _node_core_row_count;
+      break;
   }
-  MPI_Waitall(paircount, recv_request, recv_status);
+}
+
+bool StaticMesh::is_send_unchanged(int boundary_, const double *field_) {
+  if (!_skip_unchanged_halo) {
+    return false;
+  }
+  int start, stride, count;
+  edge_line(boundary_, false, start, stride, count);
+  double *last = &_last_sent[boundary_][0];
+  bool unchanged = true;
+  // Bitwise, so -0.0 is a change and the first (NaN) comparison always is
+  for (int c = 0; c < count; ++c) {
+    const double value = field_[start + c * stride];
+    if (std::memcmp(&value, &last[c], sizeof(double)) != 0) {
+      unchanged = false;
+      last[c] = value;
+    }
+  }
+  return unchanged;
+}
+
+void StaticMesh::settle_ghost(int boundary_, double *field_, bool unchanged_) {
+  int start, stride, count;
+  edge_line(boundary_, true, start, stride, count);
+  double *last = &_last_received[boundary_][0];
+  bool changed = false;
+  for (int c = 0; c < count; ++c) {
+    double& ghost = field_[start + c * stride];
+    if (unchanged_) {
+      ghost = last[c];
+    } else if (std::memcmp(&ghost, &last[c], sizeof(double)) != 0) {
+      changed = true;
+      last[c] = ghost;
+    }
+  }
+  _halo_changed[boundary_] = changed;
 }
 
 double * StaticMesh::get_u0() { return _u0; }
@@ -13,6 +13,9 @@ class StaticMesh : public DistributedMesh {
 
   void advance();
   void reflect_boundary(int boundary_);
+  void update_halo(double *field_);
+  // Exchanges u0 and u1 alone, for callers that keep the halo themselves
+  void swap_fields();
   double * get_u0();
   double * get_u1();
   int get_node_core_row_count() const;
@@ -30,6 +33,7 @@ class StaticMesh : public DistributedMesh {
   double get_core_col_x(int col_) const;
   double get_y_coord(int row_) const;
   double get_x_coord(int col_) const;
+  bool is_halo_changed(int boundary_) const;
 
  private:
   double *_u0;
@@ -44,5 +48,18 @@ class StaticMesh : public DistributedMesh {
   int _node_augmented_row_count;
   int _node_augmented_col_count;
   void exchange_boundaries();
+  void reflect_field(int boundary_, double *field_);
+  void exchange_field(double *field_);
+  // With active_tiles, a core edge equal to the one last sent to that
+  // neighbour goes as a zero-length message and the receiver restores the
+  // ghost line it last received
+  bool _skip_unchanged_halo;
+  bool _halo_changed[4];
+  std::vector<double> _last_sent[4];
+  std::vector<double> _last_received[4];
+  // First cell and stride of the core edge (or of the ghost line) on a side
+  void edge_line(int boundary_, bool ghost_, int& start_, int& stride_, int& count_) const;
+  bool is_send_unchanged(int boundary_, const double *field_);
+  void settle_ghost(int boundary_, double *field_, bool unchanged_);
 };
 #endif
@@ -0,0 +1,281 @@
+#include "static_mesh_3d.h"
+
+#include <mpi.h>
+#include <algorithm>
+#include <vector>
+
+#include "tools-inl.h"
+#include "config_file.h"
+#include "profiler.h"
+#include "tracer.h"
+
+StaticMesh3D::StaticMesh3D(const ConfigFile& config_,
+                           MPI_Comm cart_comm_,
+                           const std::vector<int>& dim_nodes_) : DistributedMesh(config_,
+                                                                                 cart_comm_,
+                                                                                 dim_nodes_) {
+  _node_core_row_count = calculate_local_span(get_node_row(),
+                                              get_vertical_nodes_count(),
+                                              get_world_core_row_count());
+  _node_core_col_count = calculate_local_span(get_node_col(),
+                                              get_horizontal_nodes_count(),
+                                              get_world_core_col_count());
+  _node_core_layer_count = calculate_local_span(get_node_layer(),
+                                                get_depth_nodes_count(),
+                                                get_world_core_layer_count());
+  _core_origin_y = get_del_y() * calculate_local_offset(get_node_row(),
+                                                        get_vertical_nodes_count(),
+                                                        get_world_core_row_count());
+  _core_origin_x = get_del_x() * calculate_local_offset(get_node_col(),
+                                                        get_horizontal_nodes_count(),
+                                                        get_world_core_col_count());
+  _core_origin_z = get_del_z() * calculate_local_offset(get_node_layer(),
+                                                        get_depth_nodes_count(),
+                                                        get_world_core_layer_count());
+  _node_augmented_row_count = _node_core_row_count + 2;
+  _node_augmented_col_count = _node_core_col_count + 2;
+  _node_augmented_layer_count = _node_core_layer_count + 2;
+  _u0 = _field_allocator.allocate(get_node_augmented_cell_count());
+  if (is_single_buffer()) {
+    // Calculation updates u0 in place, advance() swaps it with itself
+    _u1 = _u0;
+  } else {
+    _u1 = _field_allocator.allocate(get_node_augmented_cell_count());
+  }
+  const int plane = _node_augmented_row_count * _node_augmented_col_count;
+  // A row of every core layer
+  MPI_Type_vector(_node_core_layer_count,
+                  _node_core_col_count,
+                  plane,
+                  MPI_DOUBLE,
+                  &_row_face_type);
+  MPI_Type_commit(&_row_face_type);
+  // A column of every core layer
+  MPI_Datatype column;
+  MPI_Type_vector(_node_core_row_count, 1, _node_augmented_col_count, MPI_DOUBLE, &column);
+  MPI_Type_create_hvector(_node_core_layer_count,
+                          1,
+                          static_cast<MPI_Aint>(plane) * sizeof(double),
+                          column,
+                          &_col_face_type);
+  MPI_Type_commit(&_col_face_type);
+  MPI_Type_free(&column);
+  // The core of one layer
+  MPI_Type_vector(_node_core_row_count,
+                  _node_core_col_count,
+                  _node_augmented_col_count,
+                  MPI_DOUBLE,
+                  &_layer_face_type);
+  MPI_Type_commit(&_layer_face_type);
+}
+
+StaticMesh3D::~StaticMesh3D() {
+  _field_allocator.release(_u0);
+  if (_u1 != _u0) {
+    _field_allocator.release(_u1);
+  }
+  MPI_Type_free(&_row_face_type);
+  MPI_Type_free(&_col_face_type);
+  MPI_Type_free(&_layer_face_type);
+}
+
+void StaticMesh3D::reflect_boundary(int boundary_) {
+  // n.b. use u1 as we're in the current timestep
+  reflect_field(boundary_, _u1);
+}
+
+void StaticMesh3D::reflect_field(int boundary_, double *field_) {
+  const int x_span = _node_augmented_col_count;
+  const int plane = _node_augmented_row_count * x_span;
+  const int rows = _node_core_row_count;
+  const int cols = _node_core_col_count;
+  const int layers = _node_core_layer_count;
+  switch (boundary_) {
+    case (TOP):
+    case (BOTTOM): {
+      const int i = boundary_ == TOP ? 1 : rows;
+      const int ghost = boundary_ == TOP ? -x_span : x_span;
+      for (int k = 1; k < layers + 1; ++k) {
+        for (int j = 1; j < cols + 1; ++j) {
+          const int center = k * plane + i * x_span + j;
+          field_[center + ghost] = field_[center];
+        }
+      }
+    } break;
+    case (LEFT):
+    case (RIGHT): {
+      const int j = boundary_ == LEFT ? 1 : cols;
+      const int ghost = boundary_ == LEFT ? -1 : 1;
+      for (int k = 1; k < layers + 1; ++k) {
+        for (int i = 1; i < rows + 1; ++i) {
+          const int center = k * plane + i * x_span + j;
+          field_[center + ghost] = field_[center];
+        }
+      }
+    } break;
+    case (FRONT):
+    case (BACK): {
+      const int k = boundary_ == FRONT ? 1 : layers;
+      const int ghost = boundary_ == FRONT ? -plane : plane;
+      for (int i = 1; i < rows + 1; ++i) {
+        for (int j = 1; j < cols + 1; ++j) {
+          const int center = k * plane + i * x_span + j;
+          field_[center + ghost] = field_[center];
+        }
+      }
+    } break;
+  }
+}
+
+void StaticMesh3D::advance() {
+  update_halo(_u1);
+  // Now we've finished updating u1, we can swap it to u0
+  std::swap(_u0, _u1);
+}
+
+void StaticMesh3D::update_halo(double *field_) {
+  {
+    ScopedPhase phase(_profiler, REFLECT);
+    if (!has_top_neighbour()) {
+      reflect_field(TOP, field_);
+    }
+    if (!has_bottom_neighbour()) {
+      reflect_field(BOTTOM, field_);
+    }
+    if (!has_left_neighbour()) {
+      reflect_field(LEFT, field_);
+    }
+    if (!has_right_neighbour()) {
+      reflect_field(RIGHT, field_);
+    }
+    if (!has_front_neighbour()) {
+      reflect_field(FRONT, field_);
+    }
+    if (!has_back_neighbour()) {
+      reflect_field(BACK, field_);
+    }
+  }
+  exchange_field(field_);
+}
+
+void StaticMesh3D::exchange_boundaries() {
+  exchange_field(_u1);
+}
+
+void StaticMesh3D::exchange_field(double *field_) {
+  const int x_span = _node_augmented_col_count;
+  const int plane = _node_augmented_row_count * x_span;
+  const int rows = _node_core_row_count;
+  const int cols = _node_core_col_count;
+  const int layers = _node_core_layer_count;
+  // Cell offsets of the sent core face and the received ghost face
+  int send_offset[6];
+  int recv_offset[6];
+  send_offset[TOP] = plane + x_span + 1;
+  recv_offset[TOP] = plane + 1;
+  send_offset[BOTTOM] = plane + rows * x_span + 1;
+  recv_offset[BOTTOM] = plane + (rows + 1) * x_span + 1;
+  send_offset[LEFT] = plane + x_span + 1;
+  recv_offset[LEFT] = plane + x_span;
+  send_offset[RIGHT] = plane + x_span + cols;
+  recv_offset[RIGHT] = plane + x_span + cols + 1;
+  send_offset[FRONT] = plane + x_span + 1;
+  recv_offset[FRONT] = x_span + 1;
+  send_offset[BACK] = layers * plane + x_span + 1;
+  recv_offset[BACK] = (layers + 1) * plane + x_span + 1;
+  const int opposite[6] = {BOTTOM, TOP, RIGHT, LEFT, BACK, FRONT};
+  const bool has_neighbour[6] = {has_top_neighbour(), has_bottom_neighbour(),
+                                 has_left_neighbour(), has_right_neighbour(),
+                                 has_front_neighbour(), has_back_neighbour()};
+  const MPI_Datatype face_type[6] = {_row_face_type, _row_face_type,
+                                     _col_face_type, _col_face_type,
+                                     _layer_face_type, _layer_face_type};
+  const double face_bytes[6] = {1.0 * cols * layers * sizeof(double),
+                                1.0 * cols * layers * sizeof(double),
+                                1.0 * rows * layers * sizeof(double),
+                                1.0 * rows * layers * sizeof(double),
+                                1.0 * rows * cols * sizeof(double),
+                                1.0 * rows * cols * sizeof(double)};
+  int paircount = 0;
+  MPI_Request send_request[6];
+  MPI_Request recv_request[6];
+  MPI_Status  recv_status[6];
+  int recv_peer[6];
+  double recv_bytes[6];
+  double halo_bytes = 0; // sent and received
+  {
+    ScopedPhase phase(_profiler, HALO_POST);
+    for (int face = 0; face < 6; ++face) {
+      if (!has_neighbour[face]) {
+        continue;
+      }
+      const int peer = get_neighbour_rank(face);
+      MPI_Isend(&field_[send_offset[face]], 1, face_type[face], peer, face, _cart_comm, &send_request[paircount]);
+      MPI_Irecv(&field_[recv_offset[face]], 1, face_type[face], peer, opposite[face], _cart_comm, &recv_request[paircount]);
+      recv_peer[paircount] = peer;
+      recv_bytes[paircount] = face_bytes[face];
+      trace_message(SEND_POST, peer, face_bytes[face]);
+      trace_message(RECV_POST, peer, face_bytes[face]);
+      ++paircount;
+      halo_bytes += 2.0 * face_bytes[face];
+    }
+  }
+  ScopedPhase phase(_profiler, HALO_WAIT);
+  MPI_Waitall(paircount, recv_request, recv_status);
+  // The sent core edges must not change until the sends are done, and a
+  // single buffered step starts overwriting them as soon as this returns
+  MPI_Waitall(paircount, send_request, MPI_STATUSES_IGNORE);
+  for (int req = 0; req < paircount; ++req) {
+    trace_message(RECV_COMPLETE, recv_peer[req], recv_bytes[req]);
+  }
+  if (_profiler) {
+    _profiler->count_halo_bytes(halo_bytes);
+  }
+}
+
+double * StaticMesh3D::get_u0() { return _u0; }
+double * StaticMesh3D::get_u1() { return _u1; }
+int StaticMesh3D::get_node_core_row_count() const { return _node_core_row_count; }
+int StaticMesh3D::get_node_core_col_count() const { return _node_core_col_count; }
+int StaticMesh3D::get_node_core_layer_count() const { return _node_core_layer_count; }
+int StaticMesh3D::get_node_augmented_row_count() const { return _node_augmented_row_count; }
+int StaticMesh3D::get_node_augmented_col_count() const { return _node_augmented_col_count; }
+int StaticMesh3D::get_node_augmented_layer_count() const { return _node_augmented_layer_count; }
+int StaticMesh3D::get_node_core_cell_count() const {
+  return get_node_core_row_count() * get_node_core_col_count() * get_node_core_layer_count();
+}
+
+int StaticMesh3D::get_node_augmented_cell_count() const {
+  return get_node_augmented_row_count() * get_node_augmented_col_count()
+         * get_node_augmented_layer_count();
+}
+
+int StaticMesh3D::get_current_row_offset() const {
+  return 1;
+}
+
+int StaticMesh3D::get_current_col_offset() const {
+  return 1;
+}
+
+int StaticMesh3D::get_current_layer_offset() const {
+  return 1;
+}
+
+int StaticMesh3D::get_previous_row_offset() const {
+  return 1;
+}
+
+int StaticMesh3D::get_previous_col_offset() const {
+  return 1;
+}
+
+double StaticMesh3D::get_y_coord(int row_) const {
+  return _core_origin_y + (row_ - 1) * get_del_y();
+}
+double StaticMesh3D::get_x_coord(int col_) const {
+  return _core_origin_x + (col_ - 1) * get_del_x();
+}
+double StaticMesh3D::get_z_coord(int layer_) const {
+  return _core_origin_z + (layer_ - 1) * get_del_z();
+}
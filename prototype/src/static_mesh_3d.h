@@ -0,0 +1,62 @@
+#ifndef STATIC_MESH_3D_H
+#define STATIC_MESH_3D_H
+#include "distributed_mesh.h"
+#include <mpi.h>
+#include <vector>
+class ConfigFile;
+// StaticMesh for 3D domains: a fixed block of a 3D cartesian decomposition
+// with one ghost cell on each of its six faces. Edges and corners are not
+// exchanged, the 7-point stencil does not read them.
+class StaticMesh3D : public DistributedMesh {
+ public:
+  StaticMesh3D(const ConfigFile& config_,
+               MPI_Comm cart_comm_,
+               const std::vector<int>& dim_nodes_);
+  virtual ~StaticMesh3D();
+
+  void advance();
+  void reflect_boundary(int boundary_);
+  void update_halo(double *field_);
+  void exchange_boundaries();
+  double * get_u0();
+  double * get_u1();
+  int get_node_core_row_count() const;
+  int get_node_core_col_count() const;
+  int get_node_core_layer_count() const;
+  int get_node_augmented_row_count() const;
+  int get_node_augmented_col_count() const;
+  int get_node_augmented_layer_count() const;
+  int get_node_core_cell_count() const;
+  int get_node_augmented_cell_count() const;
+  int get_current_row_offset() const;
+  int get_current_col_offset() const;
+  int get_current_layer_offset() const;
+  int get_previous_row_offset() const;
+  int get_previous_col_offset() const;
+
+  double get_y_coord(int row_) const;
+  double get_x_coord(int col_) const;
+  double get_z_coord(int layer_) const;
+
+ private:
+  void reflect_field(int boundary_, double *field_);
+  void exchange_field(double *field_);
+  double *_u0;
+  double *_u1;
+  // Faces normal to each axis, as seen from the first core cell
+  MPI_Datatype _row_face_type;   // TOP, BOTTOM
+  MPI_Datatype _col_face_type;   // LEFT, RIGHT
+  MPI_Datatype _layer_face_type; // FRONT, BACK
+  // core meaning not including boundaries, ghosts
+  int _node_core_row_count;
+  int _node_core_col_count;
+  int _node_core_layer_count;
+  double _core_origin_x;
+  double _core_origin_y;
+  double _core_origin_z;
+  // augmented meaning boundaries, ghosts are included
+  int _node_augmented_row_count;
+  int _node_augmented_col_count;
+  int _node_augmented_layer_count;
+};
+#endif
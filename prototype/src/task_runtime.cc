@@ -0,0 +1,405 @@
+#include "task_runtime.h"
+
+#include <mpi.h>
+#include <sched.h>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "config_file.h"
+#include "static_mesh.h"
+#include "profiler.h"
+
+TaskRuntime::TaskRuntime(const ConfigFile& config_, StaticMesh *mesh_)
+                        : _mesh(mesh_), _profiler(0), _receives_outstanding(0),
+                          _steps(0), _rx(0), _ry(0), _tasks_left(0) {
+  _diffusivity = config_.get_or_default("diffusivity", 1.0);
+  if (config_.get_or_default("scheme", std::string("explicit")) != "explicit"
+      || config_.get_or_default("mesh_type", std::string("static")) != "static"
+      || _mesh->get_dimension_count() == 3 || _mesh->is_single_buffer()
+      || config_.get_or_default("active_tiles", false)
+      || !config_.get_line_or_default("conductivity", "").empty()
+      || !config_.get_line_or_default("conductivity_field", "").empty()
+      || !config_.get_line_or_default("conductivity_subregions", "").empty()) {
+    throw std::logic_error("task_runtime runs the explicit scheme on a 2D static mesh "
+                           "with two buffers, without active_tiles or conductivity");
+  }
+  // Worker threads run alongside the master thread's MPI calls
+  int provided;
+  MPI_Query_thread(&provided);
+  if (provided < MPI_THREAD_FUNNELED) {
+    throw std::logic_error("task_runtime needs MPI_THREAD_FUNNELED from the MPI library");
+  }
+  const int size = config_.get_or_default("task_tile_size", 64);
+  if (size < 1) {
+    throw std::logic_error("task_tile_size must be positive");
+  }
+  _threads = config_.get_or_default("task_threads", 0);
+#ifdef _OPENMP
+  if (_threads <= 0) {
+    _threads = omp_get_max_threads();
+  }
+#else
+  _threads = 1;
+#endif
+  // Its own communicator, so halo tags never meet the mesh's
+  MPI_Comm_dup(_mesh->get_cart_comm(), &_comm);
+  _x_span = _mesh->get_node_augmented_col_count();
+  const int rows = _mesh->get_node_core_row_count();
+  const int cols = _mesh->get_node_core_col_count();
+  const int tile_rows = (rows + size - 1) / size;
+  const int tile_cols = (cols + size - 1) / size;
+  // A segment is named by its place along the receiver's side and the
+  // side, which the ranks either side of it agree on even when their
+  // blocks hold different numbers of tiles; the parity then doubles it
+  const int segments = std::max(tile_rows, tile_cols);
+  int *tag_ub = 0;
+  int has_tag_ub = 0;
+  MPI_Comm_get_attr(_comm, MPI_TAG_UB, &tag_ub, &has_tag_ub);
+  // The standard guarantees 32767 at least
+  if (static_cast<long>(segments) * 8 - 1 > (has_tag_ub ? *tag_ub : 32767)) {
+    std::stringstream msg;
+    msg << "task_tile_size " << size << " gives " << segments
+        << " segments along a side, too many for MPI_TAG_UB";
+    throw std::logic_error(msg.str());
+  }
+  _tiles.resize(tile_rows * tile_cols);
+  for (int a = 0; a < tile_rows; ++a) {
+    for (int b = 0; b < tile_cols; ++b) {
+      const int index = a * tile_cols + b;
+      Tile& tile = _tiles[index];
+      tile.row_begin = 1 + a * size;
+      tile.row_end = std::min(tile.row_begin + size, rows + 1);
+      tile.col_begin = 1 + b * size;
+      tile.col_end = std::min(tile.col_begin + size, cols + 1);
+      tile.neighbours[TOP] = a > 0 ? index - tile_cols : -1;
+      tile.neighbours[BOTTOM] = a + 1 < tile_rows ? index + tile_cols : -1;
+      tile.neighbours[LEFT] = b > 0 ? index - 1 : -1;
+      tile.neighbours[RIGHT] = b + 1 < tile_cols ? index + 1 : -1;
+      tile.dependencies = 1;
+      for (int boundary = TOP; boundary <= RIGHT; ++boundary) {
+        tile.halos[boundary] = -1;
+        if (tile.neighbours[boundary] >= 0) {
+          ++tile.dependencies;
+        } else if (_mesh->get_neighbour_rank(boundary) >= 0) {
+          const int segment = boundary == TOP || boundary == BOTTOM ? b : a;
+          const int count = boundary == TOP || boundary == BOTTOM
+              ? tile.col_end - tile.col_begin : tile.row_end - tile.row_begin;
+          Halo halo;
+          halo.tile = index;
+          halo.boundary = boundary;
+          halo.peer = _mesh->get_neighbour_rank(boundary);
+          // TOP and BOTTOM, LEFT and RIGHT differ in the lowest bit
+          halo.send_tag = segment * 4 + (boundary ^ 1);
+          halo.receive_tag = segment * 4 + boundary;
+          for (int parity = 0; parity < 2; ++parity) {
+            halo.send[parity].resize(count);
+            halo.receive[parity].resize(count);
+            halo.send_request[parity] = MPI_REQUEST_NULL;
+          }
+          tile.halos[boundary] = static_cast<int>(_halos.size());
+          _halos.push_back(halo);
+          ++tile.dependencies;
+        }
+      }
+    }
+  }
+  _receive_requests.assign(_halos.size() * 2, MPI_REQUEST_NULL);
+  _receive_levels.assign(_halos.size() * 2, 0);
+  _indices.resize(_halos.size() * 2);
+  _ready.resize(_threads);
+#ifdef _OPENMP
+  _locks.resize(_threads + 1);
+  for (int l = 0; l <= _threads; ++l) {
+    omp_init_lock(&_locks[l]);
+  }
+#endif
+}
+
+TaskRuntime::~TaskRuntime() {
+#ifdef _OPENMP
+  for (int l = 0; l <= _threads; ++l) {
+    omp_destroy_lock(&_locks[l]);
+  }
+#endif
+  MPI_Comm_free(&_comm);
+}
+
+void TaskRuntime::set_profiler(Profiler *profiler_) {
+  _profiler = profiler_;
+}
+
+void TaskRuntime::lock(int lock_) {
+#ifdef _OPENMP
+  omp_set_lock(&_locks[lock_]);
+#endif
+}
+
+void TaskRuntime::unlock(int lock_) {
+#ifdef _OPENMP
+  omp_unset_lock(&_locks[lock_]);
+#endif
+}
+
+void TaskRuntime::run(int steps_, double dt_) {
+  if (steps_ <= 0) {
+    return;
+  }
+  const double dx = _mesh->get_del_x();
+  const double dy = _mesh->get_del_y();
+  // As Calculation::step scales it
+  const double dt = _diffusivity * dt_;
+  _rx = dt / (dx * dx);
+  _ry = dt / (dy * dy);
+  _fields[0] = _mesh->get_u0();
+  _fields[1] = _mesh->get_u1();
+  _steps = steps_;
+  const int tiles = static_cast<int>(_tiles.size());
+  _tasks_left = static_cast<long>(tiles) * steps_;
+  for (int t = 0; t < tiles; ++t) {
+    _tiles[t].step = 0;
+    _tiles[t].unmet[0] = 0;
+    _tiles[t].unmet[1] = _tiles[t].dependencies;
+    // Neighbouring tiles start on the same thread
+    _ready[static_cast<long>(t) * _threads / tiles].push_back(t);
+  }
+  for (int h = 0; h < static_cast<int>(_halos.size()); ++h) {
+    post_receive(h, 1);
+    if (steps_ > 1) {
+      post_receive(h, 2);
+    }
+  }
+#ifdef _OPENMP
+#pragma omp parallel num_threads(_threads)
+#endif
+  {
+#ifdef _OPENMP
+    const int thread = omp_get_thread_num();
+#else
+    const int thread = 0;
+#endif
+    int tile;
+    for (;;) {
+      if (thread == 0) {
+        progress();
+      }
+      if (take(thread, tile)) {
+        execute(thread, tile);
+        continue;
+      }
+      long left;
+#ifdef _OPENMP
+#pragma omp atomic read seq_cst
+#endif
+      left = _tasks_left;
+      if (left == 0) {
+        if (thread != 0) {
+          break;
+        }
+        // The master stays until the last halos are in and out
+        lock(_threads);
+        const bool sent = _outbox.empty();
+        unlock(_threads);
+        if (sent && _receives_outstanding == 0) {
+          break;
+        }
+      }
+      sched_yield();
+    }
+  }
+  for (int h = 0; h < static_cast<int>(_halos.size()); ++h) {
+    MPI_Waitall(2, _halos[h].send_request, MPI_STATUSES_IGNORE);
+  }
+  if (steps_ % 2 == 1) {
+    _mesh->swap_fields();
+  }
+}
+
+bool TaskRuntime::take(int thread_, int& tile_) {
+  // Newest first from our own deque, oldest first from another's
+  for (int k = 0; k < _threads; ++k) {
+    const int victim = (thread_ + k) % _threads;
+    std::deque<int>& ready = _ready[victim];
+    lock(victim);
+    if (!ready.empty()) {
+      if (k == 0) {
+        tile_ = ready.back();
+        ready.pop_back();
+      } else {
+        tile_ = ready.front();
+        ready.pop_front();
+      }
+      unlock(victim);
+      return true;
+    }
+    unlock(victim);
+  }
+  return false;
+}
+
+void TaskRuntime::release(int thread_, int tile_, int step_) {
+  if (step_ >= _steps) {
+    return;
+  }
+  int unmet;
+  int& counter = _tiles[tile_].unmet[step_ % 2];
+#ifdef _OPENMP
+#pragma omp atomic capture seq_cst
+#endif
+  unmet = --counter;
+  if (unmet == 0) {
+    lock(thread_);
+    _ready[thread_].push_back(tile_);
+    unlock(thread_);
+  }
+}
+
+void TaskRuntime::execute(int thread_, int tile_) {
+  Tile& tile = _tiles[tile_];
+  const int step = tile.step;
+  const double *u0 = _fields[step % 2];
+  double *u1 = _fields[(step + 1) % 2];
+  const double rx = _rx;
+  const double ry = _ry;
+  const int x_span = _x_span;
+  // As Calculation::diffuse, over the tile
+  for (int i = tile.row_begin; i < tile.row_end; ++i) {
+    for (int j = tile.col_begin; j < tile.col_end; ++j) {
+      const int center = i * x_span + j;
+      const int top = (i - 1) * x_span + j;
+      const int bottom = (i + 1) * x_span + j;
+      const int left = i * x_span + (j - 1);
+      const int right = i * x_span + (j + 1);
+      u1[center] = (1.0 - 2.0*rx - 2.0*ry) *u0[center] + rx * u0[left]
+                         + rx * u0[right] + ry * u0[top] + ry * u0[bottom];
+    }
+  }
+  for (int boundary = TOP; boundary <= RIGHT; ++boundary) {
+    if (tile.neighbours[boundary] < 0 && tile.halos[boundary] < 0) {
+      int core, ghost, stride;
+      edge(tile, boundary, false, core, stride);
+      edge(tile, boundary, true, ghost, stride);
+      const int count = stride == 1 ? tile.col_end - tile.col_begin
+                                    : tile.row_end - tile.row_begin;
+      for (int c = 0; c < count; ++c) {
+        u1[ghost + c * stride] = u1[core + c * stride];
+      }
+    }
+  }
+  // Nothing waits on step + 2 until step + 1 is done, so its count can
+  // take this step's slot
+  tile.step = step + 1;
+  const int next = step + 2 < _steps ? tile.dependencies : 0;
+#ifdef _OPENMP
+#pragma omp atomic write seq_cst
+#endif
+  tile.unmet[step % 2] = next;
+  bool sends = false;
+  for (int boundary = TOP; boundary <= RIGHT; ++boundary) {
+    sends = sends || tile.halos[boundary] >= 0;
+  }
+  if (sends) {
+    lock(_threads);
+    for (int boundary = TOP; boundary <= RIGHT; ++boundary) {
+      if (tile.halos[boundary] >= 0) {
+        _outbox.push_back(tile.halos[boundary]);
+        _outbox.push_back(step + 1);
+      }
+    }
+    unlock(_threads);
+  }
+  release(thread_, tile_, step + 1);
+  for (int boundary = TOP; boundary <= RIGHT; ++boundary) {
+    if (tile.neighbours[boundary] >= 0) {
+      release(thread_, tile.neighbours[boundary], step + 1);
+    }
+  }
+#ifdef _OPENMP
+#pragma omp atomic update seq_cst
+#endif
+  --_tasks_left;
+}
+
+void TaskRuntime::progress() {
+  lock(_threads);
+  _sending.swap(_outbox);
+  unlock(_threads);
+  for (size_t s = 0; s < _sending.size(); s += 2) {
+    Halo& halo = _halos[_sending[s]];
+    const int level = _sending[s + 1];
+    const int parity = level % 2;
+    std::vector<double>& buffer = halo.send[parity];
+    // Two levels back, long since received, but MPI must be told
+    MPI_Wait(&halo.send_request[parity], MPI_STATUS_IGNORE);
+    int start, stride;
+    edge(_tiles[halo.tile], halo.boundary, false, start, stride);
+    const double *field = _fields[parity];
+    for (size_t c = 0; c < buffer.size(); ++c) {
+      buffer[c] = field[start + c * stride];
+    }
+    MPI_Isend(&buffer[0], static_cast<int>(buffer.size()), MPI_DOUBLE, halo.peer,
+              halo.send_tag * 2 + parity, _comm, &halo.send_request[parity]);
+    if (_profiler) {
+      _profiler->count_halo_bytes(buffer.size() * sizeof(double));
+    }
+  }
+  _sending.clear();
+  if (_receives_outstanding == 0) {
+    return;
+  }
+  int done;
+  MPI_Testsome(static_cast<int>(_receive_requests.size()), &_receive_requests[0], &done,
+               &_indices[0], MPI_STATUSES_IGNORE);
+  for (int d = 0; d < done && done != MPI_UNDEFINED; ++d) {
+    const int h = _indices[d] / 2;
+    const int level = _receive_levels[_indices[d]];
+    Halo& halo = _halos[h];
+    const std::vector<double>& buffer = halo.receive[level % 2];
+    int start, stride;
+    edge(_tiles[halo.tile], halo.boundary, true, start, stride);
+    double *field = _fields[level % 2];
+    for (size_t c = 0; c < buffer.size(); ++c) {
+      field[start + c * stride] = buffer[c];
+    }
+    --_receives_outstanding;
+    release(0, halo.tile, level);
+    if (level + 2 <= _steps) {
+      post_receive(h, level + 2);
+    }
+  }
+}
+
+void TaskRuntime::post_receive(int halo_, int level_) {
+  Halo& halo = _halos[halo_];
+  // Levels of either parity are posted in no particular order, so the
+  // parity is part of the tag
+  const int index = halo_ * 2 + level_ % 2;
+  std::vector<double>& buffer = halo.receive[level_ % 2];
+  _receive_levels[index] = level_;
+  MPI_Irecv(&buffer[0], static_cast<int>(buffer.size()), MPI_DOUBLE, halo.peer,
+            halo.receive_tag * 2 + level_ % 2, _comm, &_receive_requests[index]);
+  ++_receives_outstanding;
+}
+
+void TaskRuntime::edge(const Tile& tile_, int boundary_, bool ghost_,
+                       int& start_, int& stride_) const {
+  switch (boundary_) {
+    case (TOP):
+      start_ = (ghost_ ? tile_.row_begin - 1 : tile_.row_begin) * _x_span + tile_.col_begin;
+      stride_ = 1;
+      break;
+    case (BOTTOM):
+      start_ = (ghost_ ? tile_.row_end : tile_.row_end - 1) * _x_span + tile_.col_begin;
+      stride_ = 1;
+      break;
+    case (LEFT):
+      start_ = tile_.row_begin * _x_span + (ghost_ ? tile_.col_begin - 1 : tile_.col_begin);
+      stride_ = _x_span;
+      break;
+    default:
+      start_ = tile_.row_begin * _x_span + (ghost_ ? tile_.col_end : tile_.col_end - 1);
+      stride_ = _x_span;
+      break;
+  }
+}
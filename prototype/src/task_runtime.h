@@ -0,0 +1,98 @@
+#ifndef TASK_RUNTIME_H
+#define TASK_RUNTIME_H
+
+#include <mpi.h>
+#include <deque>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+class ConfigFile;
+class Profiler;
+class StaticMesh;
+// Steps the explicit 2D scheme on a StaticMesh as a graph of tile tasks,
+// in place of Calculation and advance(), when task_runtime is set:
+//   task_tile_size - core rows and columns of a tile (64)
+//   task_threads   - worker threads, 0 for the OpenMP default
+// A tile's step waits only for the previous step of itself, of the tiles
+// beside it and of the neighbouring ranks' edge segments it reads, so
+// inner tiles run ahead while edge tiles wait on the network. A released
+// tile goes on the deque of the thread that released it and idle threads
+// steal from the others. Only the master thread calls MPI.
+class TaskRuntime {
+ public:
+  TaskRuntime(const ConfigFile& config_, StaticMesh *mesh_);
+  ~TaskRuntime();
+  // steps_ steps of dt_ from u0, left in u0 with current ghosts, as that
+  // many calls of Calculation::step() and advance() would
+  void run(int steps_, double dt_);
+  // Halo bytes go to profiler_ when one is set
+  void set_profiler(Profiler *profiler_);
+
+ private:
+  struct Tile {
+    // Core cells, as augmented indices [begin, end)
+    int row_begin;
+    int row_end;
+    int col_begin;
+    int col_end;
+    int neighbours[4]; // tile beside it on each Boundary, -1 for none
+    int halos[4];      // _halos entry of a side facing another rank, -1
+    int dependencies;  // of each step after the first
+    int step;          // next step to take
+    int unmet[2];      // unmet dependencies of the next steps, by parity
+  };
+  // A tile edge shared with a neighbouring rank; buffers by level parity
+  struct Halo {
+    int tile;
+    int boundary;
+    int peer;
+    int send_tag;
+    int receive_tag;
+    std::vector<double> send[2];
+    std::vector<double> receive[2];
+    MPI_Request send_request[2];
+  };
+  void execute(int thread_, int tile_);
+  // One dependency of tile_'s step_ is met
+  void release(int thread_, int tile_, int step_);
+  bool take(int thread_, int& tile_);
+  // Master only: posts queued sends and handles arrived halos
+  void progress();
+  void post_receive(int halo_, int level_);
+  // First cell and stride of a tile's core edge, or of the ghosts beyond it
+  void edge(const Tile& tile_, int boundary_, bool ghost_, int& start_, int& stride_) const;
+  void lock(int lock_);
+  void unlock(int lock_);
+
+  StaticMesh * const _mesh;
+  Profiler *_profiler;
+  MPI_Comm _comm;
+  int _threads;
+  int _x_span;
+  std::vector<Tile> _tiles;
+  std::vector<Halo> _halos;
+  // Receives by _halos entry * 2 + level parity, and the level each awaits
+  std::vector<MPI_Request> _receive_requests;
+  std::vector<int> _receive_levels;
+  int _receives_outstanding;
+  // (halo, level) pairs whose edge is ready to send, for the master
+  std::vector<int> _outbox;
+  std::vector<int> _sending;
+  std::vector<std::deque<int> > _ready; // per thread
+  std::vector<int> _indices;            // Testsome scratch
+  // One lock per thread's deque, then the outbox's
+#ifdef _OPENMP
+  std::vector<omp_lock_t> _locks;
+#endif
+  // Per run
+  double *_fields[2]; // level n lives in _fields[n % 2]
+  int _steps;
+  double _diffusivity;
+  double _rx;
+  double _ry;
+  long _tasks_left;
+};
+#endif
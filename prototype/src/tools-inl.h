@@ -5,6 +5,7 @@
 #include <sys/time.h>
 #include <sys/times.h>
 #include <sys/resource.h>
+#include <time.h>
 
 // Classic version
 inline int calculate_local_span(int dim_proc_, int dim_procs_, int global_span_) {
@@ -66,4 +67,11 @@ inline void timers(double& wall_, double& cpu_)
   cpu_ = r.ru_utime.tv_sec + r.ru_utime.tv_usec*1.0e-6; 
 }
 
+// Monotonic wall clock in seconds, unaffected by system clock adjustments
+inline double monotonic_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
 #endif
@@ -0,0 +1,213 @@
+#include "topology_mapper.h"
+
+#include <sstream>
+#include <stdexcept>
+
+#include "config_file.h"
+#include "distributed_mesh.h"
+
+namespace {
+
+// Row major index of coords_ in a grid of dims_
+int row_major(const std::vector<int>& coords_, const std::vector<int>& dims_) {
+  int index = 0;
+  for (std::size_t d = 0; d < dims_.size(); ++d) {
+    index = index * dims_[d] + coords_[d];
+  }
+  return index;
+}
+
+// Inverse of row_major
+std::vector<int> unravel(int index_, const std::vector<int>& dims_) {
+  std::vector<int> coords(dims_.size(), 0);
+  for (int d = static_cast<int>(dims_.size()) - 1; d >= 0; --d) {
+    coords[d] = index_ % dims_[d];
+    index_ /= dims_[d];
+  }
+  return coords;
+}
+
+// Tries every split of remaining_ ranks over the dimensions from d_ on,
+// keeping in best_ the block whose faces towards other nodes are smallest
+void search_blocks(const std::vector<int>& dim_nodes_,
+                   const std::vector<double>& extents_,
+                   std::size_t d_, int remaining_,
+                   std::vector<int>& block_,
+                   std::vector<int>& best_, double& best_cost_) {
+  if (d_ == dim_nodes_.size()) {
+    if (remaining_ != 1) {
+      return;
+    }
+    double cost = 0;
+    for (std::size_t d = 0; d < block_.size(); ++d) {
+      if (dim_nodes_[d] == block_[d]) {
+        continue; // the node spans this dimension, no faces to cut
+      }
+      double face = 2;
+      for (std::size_t e = 0; e < block_.size(); ++e) {
+        if (e != d) {
+          face *= block_[e] * extents_[e];
+        }
+      }
+      cost += face;
+    }
+    if (best_.empty() || cost < best_cost_) {
+      best_ = block_;
+      best_cost_ = cost;
+    }
+    return;
+  }
+  for (int b = 1; b <= dim_nodes_[d_]; ++b) {
+    if (dim_nodes_[d_] % b == 0 && remaining_ % b == 0) {
+      block_[d_] = b;
+      search_blocks(dim_nodes_, extents_, d_ + 1, remaining_ / b,
+                    block_, best_, best_cost_);
+    }
+  }
+}
+
+} // namespace
+
+TopologyMapper::TopologyMapper(const ConfigFile& config_) : _config(config_),
+                                                            _node(0),
+                                                            _node_count(1),
+                                                            _node_rank(0),
+                                                            _node_size(1),
+                                                            _uniform(true) {
+  _mapping = _config.get_or_default("topology_mapping", std::string("node"));
+  _ranks_per_node = _config.get_or_default("topology_ranks_per_node", 0);
+  if (_mapping != "node" && _mapping != "mpi") {
+    std::stringstream ss;
+    ss << "Unknown topology_mapping: " << _mapping << std::endl;
+    throw std::logic_error(ss.str());
+  }
+}
+
+TopologyMapper::~TopologyMapper() {
+}
+
+MPI_Comm TopologyMapper::create_cart(MPI_Comm comm_,
+                                     const std::vector<int>& dim_nodes_,
+                                     const std::vector<int>& dim_periods_,
+                                     bool mpi_reorder_) {
+  discover_nodes(comm_);
+  const int ndims = dim_nodes_.size();
+  std::vector<int> dims(dim_nodes_);
+  std::vector<int> periods(dim_periods_);
+  MPI_Comm cart_comm;
+  if (_mapping == "mpi") {
+    MPI_Cart_create(comm_, ndims, &dims[0], &periods[0], mpi_reorder_, &cart_comm);
+    return cart_comm;
+  }
+  int size;
+  MPI_Comm_size(comm_, &size);
+  // Grouping node by node is the fallback: each node then holds a run of
+  // whole rows (or a part of one) of the row major grid
+  int key = _node * size + _node_rank;
+  _block = node_block(dim_nodes_);
+  const std::vector<int>& block = _block;
+  if (!block.empty()) {
+    std::vector<int> node_grid(ndims);
+    for (int d = 0; d < ndims; ++d) {
+      node_grid[d] = dim_nodes_[d] / block[d];
+    }
+    std::vector<int> node_coords = unravel(_node, node_grid);
+    std::vector<int> local_coords = unravel(_node_rank, block);
+    std::vector<int> coords(ndims);
+    for (int d = 0; d < ndims; ++d) {
+      coords[d] = node_coords[d] * block[d] + local_coords[d];
+    }
+    key = row_major(coords, dim_nodes_);
+  }
+  // Renumber so the cartesian rank of every process is its key, then lay
+  // the grid over that order as is
+  MPI_Comm ordered;
+  MPI_Comm_split(comm_, 0, key, &ordered);
+  MPI_Cart_create(ordered, ndims, &dims[0], &periods[0], 0, &cart_comm);
+  MPI_Comm_free(&ordered);
+  return cart_comm;
+}
+
+void TopologyMapper::discover_nodes(MPI_Comm comm_) {
+  int rank;
+  MPI_Comm_rank(comm_, &rank);
+  MPI_Comm node_comm;
+  if (_ranks_per_node > 0) {
+    MPI_Comm_split(comm_, rank / _ranks_per_node, rank, &node_comm);
+  } else {
+    MPI_Comm_split_type(comm_, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+  }
+  MPI_Comm_rank(node_comm, &_node_rank);
+  MPI_Comm_size(node_comm, &_node_size);
+  // Number the nodes by the order of their first ranks
+  MPI_Comm leaders;
+  MPI_Comm_split(comm_, _node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &leaders);
+  if (leaders != MPI_COMM_NULL) {
+    MPI_Comm_rank(leaders, &_node);
+    MPI_Comm_size(leaders, &_node_count);
+    MPI_Comm_free(&leaders);
+  }
+  MPI_Bcast(&_node, 1, MPI_INT, 0, node_comm);
+  MPI_Bcast(&_node_count, 1, MPI_INT, 0, node_comm);
+  MPI_Comm_free(&node_comm);
+  int sizes[2] = { _node_size, -_node_size };
+  MPI_Allreduce(MPI_IN_PLACE, sizes, 2, MPI_INT, MPI_MAX, comm_);
+  _uniform = (sizes[0] == -sizes[1]);
+}
+
+std::vector<int> TopologyMapper::node_block(const std::vector<int>& dim_nodes_) const {
+  std::vector<int> best;
+  if (!_uniform) {
+    return best;
+  }
+  std::vector<int> logical = _config.get_or_default("logical_dimensions",
+                                                     std::vector<int>());
+  // Cells per rank along each dimension weigh the faces
+  std::vector<double> extents(dim_nodes_.size(), 1.0);
+  for (std::size_t d = 0; d < extents.size() && d < logical.size(); ++d) {
+    extents[d] = static_cast<double>(logical[d]) / dim_nodes_[d];
+  }
+  std::vector<int> block(dim_nodes_.size(), 1);
+  double best_cost = 0;
+  search_blocks(dim_nodes_, extents, 0, _node_size, block, best, best_cost);
+  return best;
+}
+
+void TopologyMapper::report(const DistributedMesh& mesh_, std::ostream& os_) const {
+  MPI_Comm comm = mesh_.get_cart_comm();
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+  std::vector<int> nodes(size);
+  int node = _node;
+  MPI_Allgather(&node, 1, MPI_INT, &nodes[0], 1, MPI_INT, comm);
+  const double rows = mesh_.get_node_core_row_count();
+  const double cols = mesh_.get_node_core_col_count();
+  const double layers = mesh_.get_node_core_layer_count();
+  const double face[6] = { cols * layers, cols * layers,  // TOP, BOTTOM
+                           rows * layers, rows * layers,  // LEFT, RIGHT
+                           rows * cols, rows * cols };    // FRONT, BACK
+  // Bytes this rank sends: [0] on its node, [1] to other nodes
+  double bytes[2] = { 0, 0 };
+  for (int b = 0; b < 6; ++b) {
+    const int neighbour = mesh_.get_neighbour_rank(b);
+    if (neighbour >= 0) {
+      bytes[nodes[neighbour] == _node ? 0 : 1] += face[b] * sizeof(double);
+    }
+  }
+  double totals[2];
+  MPI_Reduce(bytes, totals, 2, MPI_DOUBLE, MPI_SUM, 0, comm);
+  if (rank == 0) {
+    os_ << "Topology: " << _node_count << " node(s), " << _mapping << " mapping";
+    for (std::size_t d = 0; d < _block.size(); ++d) {
+      os_ << (d == 0 ? ", node blocks " : "x") << _block[d];
+    }
+    os_ << "\n"
+        << "  halo bytes per exchange: intra-node " << totals[0]
+        << ", inter-node " << totals[1];
+    if (totals[0] > 0) {
+      os_ << " (inter/intra " << totals[1] / totals[0] << ")";
+    }
+    os_ << std::endl;
+  }
+}
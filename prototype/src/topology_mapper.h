@@ -0,0 +1,48 @@
+#ifndef TOPOLOGY_MAPPER_H
+#define TOPOLOGY_MAPPER_H
+
+#include <mpi.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class ConfigFile;
+class DistributedMesh;
+// Places the ranks of the cartesian topology so that every node holds a
+// compact sub-block of it, keeping as much halo traffic as possible on-node.
+//   topology_mapping        - node (default) or mpi, which leaves placement
+//                             to MPI_Cart_create and mpi_reorder
+//   topology_ranks_per_node - group world ranks into nodes of this many
+//                             instead of asking MPI which share memory
+//                             (0, for testing placements on one machine)
+// Nodes are found with MPI_Comm_split_type. When they are all the same size
+// the sub-block shape is the divisor of dim_nodes with the least
+// inter-node surface; otherwise ranks are only grouped node by node.
+class TopologyMapper {
+ public:
+  TopologyMapper(const ConfigFile& config_);
+  ~TopologyMapper();
+  // Collective over comm_: a cartesian communicator over dim_nodes_ whose
+  // row major rank order puts each node's ranks in one sub-block
+  MPI_Comm create_cart(MPI_Comm comm_, const std::vector<int>& dim_nodes_,
+                       const std::vector<int>& dim_periods_, bool mpi_reorder_);
+  // Collective over the mesh's communicator: rank 0 prints the halo bytes
+  // of one exchange that stay on a node and that cross between nodes
+  void report(const DistributedMesh& mesh_, std::ostream& os_) const;
+
+ private:
+  void discover_nodes(MPI_Comm comm_);
+  // Ranks per node along each dimension, dividing dim_nodes_
+  std::vector<int> node_block(const std::vector<int>& dim_nodes_) const;
+
+  const ConfigFile& _config;
+  std::string _mapping;
+  int _ranks_per_node;
+  int _node;       // index of this rank's node, nodes ordered by first rank
+  int _node_count;
+  int _node_rank;  // rank within the node
+  int _node_size;
+  bool _uniform;   // every node has _node_size ranks
+  std::vector<int> _block; // ranks per node along each dimension, if mapped
+};
+#endif
@@ -0,0 +1,147 @@
+#include "tracer.h"
+
+#include <mpi.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "tools-inl.h"
+#include "profiler.h"
+
+namespace {
+  const char *message_name(int kind_) {
+    switch (kind_) {
+      case (SEND_POST): return "send_post";
+      case (RECV_POST): return "recv_post";
+      case (RECV_COMPLETE): return "recv_complete";
+    }
+    return "unknown";
+  }
+}
+
+Tracer::Tracer(int capacity_) : _recorded(0), _origin(0) {
+  if (capacity_ < 1) {
+    throw std::logic_error("Trace buffer must hold at least one event");
+  }
+  _events.resize(capacity_);
+}
+
+Tracer::~Tracer() {}
+
+void Tracer::start(MPI_Comm comm_) {
+  MPI_Barrier(comm_);
+  _origin = monotonic_seconds();
+}
+
+void Tracer::push(const Event& event_) {
+  _events[_recorded % _events.size()] = event_;
+  ++_recorded;
+}
+
+void Tracer::record_phase(int phase_, double start_, double end_) {
+  Event event;
+  event.start = start_;
+  event.end = end_;
+  event.bytes = 0;
+  event.kind = phase_;
+  event.peer = -1;
+  push(event);
+}
+
+void Tracer::record_message(int kind_, int peer_, double bytes_, double time_) {
+  Event event;
+  event.start = time_;
+  event.end = time_;
+  event.bytes = bytes_;
+  event.kind = PHASE_COUNT + kind_;
+  event.peer = peer_;
+  push(event);
+}
+
+void Tracer::write(const std::string& filename_, MPI_Comm comm_) const {
+  int rank, size;
+  MPI_Comm_rank(comm_, &rank);
+  MPI_Comm_size(comm_, &size);
+  // Unroll the ring into chronological order
+  const long capacity = _events.size();
+  const long kept = _recorded < capacity ? _recorded : capacity;
+  std::vector<Event> ordered(kept);
+  for (long e = 0; e < kept; ++e) {
+    ordered[e] = _events[(_recorded - kept + e) % capacity];
+    ordered[e].start -= _origin;
+    ordered[e].end -= _origin;
+  }
+  long dropped = _recorded - kept;
+  std::vector<long> dropped_by_rank(size, 0);
+  MPI_Gather(&dropped, 1, MPI_LONG, &dropped_by_rank[0], 1, MPI_LONG, 0, comm_);
+  // Events travel whole, and one rank at a time to rank 0, so neither the
+  // counts nor rank 0's buffer grow with the number of ranks
+  MPI_Datatype event_type;
+  MPI_Type_contiguous(sizeof(Event), MPI_BYTE, &event_type);
+  MPI_Type_commit(&event_type);
+  // Rank 0 opens the file first and tells the others whether to bother
+  std::ofstream ofs;
+  int opened = 1;
+  if (rank == 0) {
+    ofs.open(filename_.c_str());
+    opened = ofs.good() ? 1 : 0;
+  }
+  MPI_Bcast(&opened, 1, MPI_INT, 0, comm_);
+  if (!opened) {
+    MPI_Type_free(&event_type);
+    if (rank == 0) {
+      std::stringstream msg;
+      msg << "Cannot open trace file " << filename_;
+      throw std::logic_error(msg.str());
+    }
+    return;
+  }
+  if (rank != 0) {
+    const int count = static_cast<int>(kept);
+    MPI_Send(&count, 1, MPI_INT, 0, 0, comm_);
+    MPI_Send(ordered.empty() ? 0 : &ordered[0], count, event_type, 0, 1, comm_);
+    MPI_Type_free(&event_type);
+    return;
+  }
+  ofs.setf(std::ios::fixed, std::ios::floatfield);
+  ofs.precision(3);
+  ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  std::vector<Event> received;
+  for (int r = 0; r < size; ++r) {
+    ofs << (r == 0 ? "\n" : ",\n");
+    ofs << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << r
+        << ",\"args\":{\"name\":\"rank " << r << "\",\"dropped_events\":"
+        << dropped_by_rank[r] << "}}";
+    const Event *events = ordered.empty() ? 0 : &ordered[0];
+    int count = static_cast<int>(kept);
+    if (r != 0) {
+      MPI_Recv(&count, 1, MPI_INT, r, 0, comm_, MPI_STATUS_IGNORE);
+      received.resize(count);
+      MPI_Recv(received.empty() ? 0 : &received[0], count, event_type, r, 1, comm_,
+               MPI_STATUS_IGNORE);
+      events = received.empty() ? 0 : &received[0];
+    }
+    for (int e = 0; e < count; ++e) {
+      const Event& event = events[e];
+      // Chrome traces are in microseconds
+      ofs << ",\n";
+      if (event.kind < PHASE_COUNT) {
+        ofs << "{\"name\":\"" << Profiler::phase_name(event.kind)
+            << "\",\"cat\":\"phase\",\"ph\":\"X\",\"pid\":" << r << ",\"tid\":0"
+            << ",\"ts\":" << event.start * 1.0e6
+            << ",\"dur\":" << (event.end - event.start) * 1.0e6 << "}";
+      } else {
+        ofs << "{\"name\":\"" << message_name(event.kind - PHASE_COUNT)
+            << "\",\"cat\":\"message\",\"ph\":\"i\",\"s\":\"t\",\"pid\":" << r << ",\"tid\":0"
+            << ",\"ts\":" << event.start * 1.0e6
+            << ",\"args\":{\"peer\":" << event.peer
+            << ",\"bytes\":" << static_cast<long>(event.bytes) << "}}";
+      }
+    }
+  }
+  MPI_Type_free(&event_type);
+  ofs << "\n]}\n";
+  ofs.close();
+}
@@ -0,0 +1,45 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <mpi.h>
+#include <string>
+#include <vector>
+
+namespace {
+  enum TraceMessage {
+    SEND_POST = 0,
+    RECV_POST = 1,
+    RECV_COMPLETE = 2,
+  };
+}
+
+// Records timestamped phase and message events into a ring buffer that is
+// allocated up front, so tracing adds no allocation to the step loop. Once
+// full, the oldest events are overwritten. write() merges every rank's
+// events into one Chrome trace (chrome://tracing, ui.perfetto.dev) with one
+// process per rank.
+class Tracer {
+ public:
+  Tracer(int capacity_);
+  ~Tracer();
+  // Collective: aligns the per-rank clocks after a barrier on comm_
+  void start(MPI_Comm comm_);
+  void record_phase(int phase_, double start_, double end_);
+  void record_message(int kind_, int peer_, double bytes_, double time_);
+  // Collective over comm_, rank 0 writes filename_
+  void write(const std::string& filename_, MPI_Comm comm_) const;
+
+ private:
+  struct Event {
+    double start;
+    double end;
+    double bytes;
+    int kind;   // phase, or PHASE_COUNT + TraceMessage
+    int peer;
+  };
+  void push(const Event& event_);
+  std::vector<Event> _events;
+  long _recorded;
+  double _origin;
+};
+#endif
@@ -82,24 +82,38 @@ void VtkWriter::writeVtk(int step, double time)
     const int row_offset = _mesh->get_current_row_offset();
     const int col_offset = _mesh->get_current_col_offset();
 
-    const int horizontal_points = core_rows + 1;
-    const int vertical_points = core_cols + 1;
+    // Cells go out columns fastest, so X runs along the columns; points
+    // are the faces of the core cells, from the core's origin
+    const int horizontal_points = core_cols + 1;
+    const int vertical_points = core_rows + 1;
+    // 3D meshes add their layers as the third grid dimension
+    const bool three_d = _mesh->get_dimension_count() == 3;
+    const int core_layers = _mesh->get_node_core_layer_count();
+    const int layer_offset = _mesh->get_current_layer_offset();
+    const int depth_points = three_d ? core_layers + 1 : 1;
     file << "DIMENSIONS " << horizontal_points << " " << vertical_points 
-         << " 1" << std::endl;
+         << " " << depth_points << std::endl;
 
     file << "X_COORDINATES " << horizontal_points << " float" << std::endl;
     for(int j = 0; j < horizontal_points; ++j) {
-        file << _mesh->get_x_coord(j) << " ";
+        file << _mesh->get_x_coord(col_offset + j) << " ";
     }
     file << std::endl;
     file << "Y_COORDINATES " << vertical_points << " float" << std::endl;
     for(int i = 0; i < vertical_points; ++i) {
-        file << _mesh->get_y_coord(i) << " ";
+        file << _mesh->get_y_coord(row_offset + i) << " ";
     }
     file << std::endl;
 
-    file << "Z_COORDINATES 1 float" << std::endl;
-    file << "0.0000" << std::endl;
+    file << "Z_COORDINATES " << depth_points << " float" << std::endl;
+    if (three_d) {
+      for (int k = 0; k < depth_points; ++k) {
+        file << _mesh->get_z_coord(layer_offset + k) << " ";
+      }
+      file << std::endl;
+    } else {
+      file << "0.0000" << std::endl;
+    }
 
     file << "CELL_DATA " << core_cells << std::endl;
 
@@ -108,13 +122,16 @@ void VtkWriter::writeVtk(int step, double time)
     file << "u 1 " << core_cells << " double" <<  std::endl;
 
     int x_span = _mesh->get_node_augmented_col_count();
+    int plane = _mesh->get_node_augmented_row_count() * x_span;
     double *u0 = _mesh->get_u0();
     // N.B. Deal with padding
-    for (int i = row_offset; i < core_rows + row_offset; ++i) {
-      for (int j = col_offset; j < core_cols + col_offset; ++j) {
-        file << u0[i * x_span + j] << " ";
+    for (int k = layer_offset; k < core_layers + layer_offset; ++k) {
+      for (int i = row_offset; i < core_rows + row_offset; ++i) {
+        for (int j = col_offset; j < core_cols + col_offset; ++j) {
+          file << u0[k * plane + i * x_span + j] << " ";
+        }
+        file << std::endl;
       }
-      file << std::endl;
     }
     file.close();
 }
@@ -3,8 +3,10 @@
 
 #include <string>
 
+#include "writer.h"
+
 class Mesh;
-class VtkWriter {
+class VtkWriter : public Writer {
     public:
         VtkWriter(std::string basename, Mesh* mesh_, int world_rank_, int world_size_);
         void write(int step, double time);
@@ -0,0 +1,11 @@
+#ifndef WRITER_H
+#define WRITER_H
+// Base class for per-rank field output; one file per rank per output step
+class Writer {
+ public:
+  virtual ~Writer() = 0;
+  virtual void write(int step, double time) = 0;
+};
+
+inline Writer::~Writer() {}
+#endif
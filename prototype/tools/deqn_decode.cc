@@ -0,0 +1,101 @@
+// Reconstructs .vtk files from the .dqz dumps written by CompressedWriter
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "field_codec.h"
+
+namespace {
+  void write_vtk(const std::string& filename_,
+                 const FieldHeader& header_,
+                 const std::vector<double>& values_) {
+    std::ofstream file(filename_.c_str());
+    file.setf(std::ios::fixed, std::ios::floatfield);
+    file.precision(8);
+    file << "# vtk DataFile Version 3.0\nvtk output\nASCII\n";
+    file << "DATASET RECTILINEAR_GRID" << std::endl;
+    file << "FIELD FieldData 2" << std::endl;
+    file << "TIME 1 1 double" << std::endl;
+    file << header_.time << std::endl;
+    file << "CYCLE 1 1 int" << std::endl;
+    file << header_.step << std::endl;
+    const int x_points = header_.cols + 1;
+    const int y_points = header_.rows + 1;
+    file << "DIMENSIONS " << x_points << " " << y_points << " 1" << std::endl;
+    file << "X_COORDINATES " << x_points << " float" << std::endl;
+    for (int j = 0; j < x_points; ++j) {
+      file << header_.origin_x + j * header_.del_x << " ";
+    }
+    file << std::endl;
+    file << "Y_COORDINATES " << y_points << " float" << std::endl;
+    for (int i = 0; i < y_points; ++i) {
+      file << header_.origin_y + i * header_.del_y << " ";
+    }
+    file << std::endl;
+    file << "Z_COORDINATES 1 float" << std::endl;
+    file << "0.0000" << std::endl;
+    const int cells = header_.rows * header_.cols;
+    file << "CELL_DATA " << cells << std::endl;
+    file << "FIELD FieldData 1" << std::endl;
+    file << "u 1 " << cells << " double" << std::endl;
+    for (int i = 0; i < header_.rows; ++i) {
+      for (int j = 0; j < header_.cols; ++j) {
+        file << values_[i * header_.cols + j] << " ";
+      }
+      file << std::endl;
+    }
+    file.close();
+  }
+
+  void write_raw(const std::string& filename_, const std::vector<double>& values_) {
+    std::ofstream file(filename_.c_str(), std::ofstream::out | std::ofstream::binary);
+    if (!values_.empty()) {
+      file.write(reinterpret_cast<const char *>(&values_[0]),
+                 values_.size() * sizeof(double));
+    }
+    file.close();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  bool raw = false;
+  std::vector<std::string> inputs;
+  for (int arg = 1; arg < argc; ++arg) {
+    std::string value(argv[arg]);
+    if (value == "--raw") {
+      raw = true;
+    } else {
+      inputs.push_back(value);
+    }
+  }
+  if (inputs.empty()) {
+    std::cerr << "Usage: deqn-decode [--raw] <file.dqz>..." << std::endl;
+    return 1;
+  }
+  try {
+    for (std::size_t f = 0; f < inputs.size(); ++f) {
+      FieldHeader header;
+      std::vector<unsigned char> payload;
+      FieldCodec::read_file(inputs[f], header, payload);
+      FieldCodec codec(header.error_bound);
+      std::vector<double> values;
+      codec.decode(payload, header.rows, header.cols, values);
+      std::string stem = inputs[f];
+      std::size_t dot = stem.rfind(".dqz");
+      if (dot != std::string::npos) {
+        stem.erase(dot);
+      }
+      if (raw) {
+        write_raw(stem + ".raw", values);
+      } else {
+        write_vtk(stem + ".vtk", header, values);
+      }
+    }
+  } catch (std::logic_error& ex) {
+    std::cerr << "Exception thrown: " << ex.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
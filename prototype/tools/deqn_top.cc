@@ -0,0 +1,235 @@
+// Follows the live metrics of a running deqn, as published with live_metrics,
+// e.g. deqn-top /dev/shm/prototype_static.*.live
+// Prints one row per rank and an aggregate, every --interval seconds until
+// every rank has finished, or once with --once. A rank is flagged
+//   slow   - median step time over --slow times the median across ranks
+//   behind - more than one step behind the furthest rank
+//   stale  - nothing published for --stale seconds while running
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "live_metrics.h"
+
+namespace {
+  struct Options {
+    double interval;
+    double slow;
+    double stale;
+    bool once;
+  };
+
+  struct Source {
+    std::string filename;
+    const MetricsRecord *shared;
+  };
+
+  double epoch_seconds() {
+    struct timeval t;
+    gettimeofday(&t, 0);
+    return t.tv_sec + t.tv_usec * 1.0e-6;
+  }
+
+  // Maps filename_ read only, null when it is not a metrics file (yet)
+  const MetricsRecord *map_record(const std::string& filename_) {
+    const int fd = open(filename_.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return 0;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(MetricsRecord))) {
+      close(fd);
+      return 0;
+    }
+    void *map = mmap(0, sizeof(MetricsRecord), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+      return 0;
+    }
+    const MetricsRecord *record = static_cast<const MetricsRecord *>(map);
+    if (std::memcmp(record->magic, LiveMetrics::kMagic, sizeof(LiveMetrics::kMagic)) != 0) {
+      munmap(map, sizeof(MetricsRecord));
+      return 0;
+    }
+    return record;
+  }
+
+  double median(std::vector<double> values_) {
+    if (values_.empty()) {
+      return 0.0;
+    }
+    std::sort(values_.begin(), values_.end());
+    const std::size_t n = values_.size();
+    return (n % 2) ? values_[n / 2] : 0.5 * (values_[n / 2 - 1] + values_[n / 2]);
+  }
+
+  bool by_rank(const MetricsRecord& a_, const MetricsRecord& b_) {
+    return a_.rank < b_.rank;
+  }
+
+  // Prints a screen of the records, returns whether they have all finished
+  bool show(std::vector<MetricsRecord>& records_, int missing_, const Options& opts_) {
+    std::sort(records_.begin(), records_.end(), by_rank);
+    const double now = epoch_seconds();
+    long long first_step = records_.empty() ? 0 : records_[0].step;
+    long long last_step = first_step;
+    std::vector<double> p50s;
+    double cells_per_second = 0;
+    double halo_bytes = 0;
+    double halo_wait = 0;
+    double worst_p99 = 0;
+    int running = 0;
+    int expected = 0;
+    for (std::size_t r = 0; r < records_.size(); ++r) {
+      const MetricsRecord& record = records_[r];
+      first_step = std::min(first_step, record.step);
+      last_step = std::max(last_step, record.step);
+      p50s.push_back(record.step_p50);
+      cells_per_second += record.cells_per_second;
+      halo_bytes += record.halo_bytes;
+      halo_wait += record.halo_wait;
+      worst_p99 = std::max(worst_p99, record.step_p99);
+      running += record.state == 0 ? 1 : 0;
+      expected = std::max(expected, record.ranks);
+    }
+    const double typical_p50 = median(p50s);
+    std::cout << "deqn-top: " << records_.size() << " of " << expected << " ranks, "
+              << running << " running, steps " << first_step << ".." << last_step;
+    if (missing_ > 0) {
+      std::cout << ", " << missing_ << " files unreadable";
+    }
+    std::cout << "\n";
+    std::cout << std::right << std::setw(6) << "rank"
+              << std::setw(9) << "pid"
+              << std::setw(10) << "step"
+              << std::setw(12) << "sim time"
+              << std::setw(10) << "p50 ms"
+              << std::setw(10) << "p90 ms"
+              << std::setw(10) << "p99 ms"
+              << std::setw(10) << "max ms"
+              << std::setw(10) << "Mcell/s"
+              << std::setw(10) << "halo MB"
+              << std::setw(10) << "wait s"
+              << std::setw(8) << "wait%"
+              << std::setw(8) << "age s"
+              << "  flags\n";
+    std::cout.setf(std::ios::fixed, std::ios::floatfield);
+    for (std::size_t r = 0; r < records_.size(); ++r) {
+      const MetricsRecord& record = records_[r];
+      const double busy = record.compute + record.halo_wait;
+      const double age = now - record.updated;
+      std::string flags;
+      if (record.state != 0) {
+        flags += " done";
+      }
+      if (typical_p50 > 0 && record.step_p50 > opts_.slow * typical_p50) {
+        flags += " slow";
+      }
+      if (record.step < last_step - 1) {
+        flags += " behind";
+      }
+      if (record.state == 0 && age > opts_.stale) {
+        flags += " stale";
+      }
+      std::cout << std::setw(6) << record.rank
+                << std::setw(9) << record.pid
+                << std::setw(10) << record.step
+                << std::setprecision(4) << std::setw(12) << record.sim_time
+                << std::setprecision(3)
+                << std::setw(10) << 1.0e3 * record.step_p50
+                << std::setw(10) << 1.0e3 * record.step_p90
+                << std::setw(10) << 1.0e3 * record.step_p99
+                << std::setw(10) << 1.0e3 * record.step_max
+                << std::setprecision(2)
+                << std::setw(10) << 1.0e-6 * record.cells_per_second
+                << std::setw(10) << 1.0e-6 * record.halo_bytes
+                << std::setw(10) << record.halo_wait
+                << std::setprecision(1)
+                << std::setw(8) << (busy > 0 ? 100.0 * record.halo_wait / busy : 0.0)
+                << std::setw(8) << age
+                << " " << flags << "\n";
+    }
+    std::cout << std::setprecision(2)
+              << "total: " << 1.0e-6 * cells_per_second << " Mcell/s, "
+              << 1.0e-6 * halo_bytes << " MB exchanged, " << halo_wait << " s waiting; "
+              << std::setprecision(3) << "median p50 " << 1.0e3 * typical_p50
+              << " ms, worst p99 " << 1.0e3 * worst_p99 << " ms" << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    return !records_.empty() && running == 0
+           && static_cast<int>(records_.size()) >= expected;
+  }
+
+  void usage() {
+    std::cerr << "Usage: deqn-top [--once] [--interval S] [--slow F] [--stale S] <file.live>..."
+              << std::endl;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  Options opts;
+  opts.interval = 1.0;
+  opts.slow = 1.25;
+  opts.stale = 10.0;
+  opts.once = false;
+  std::vector<Source> sources;
+  for (int arg = 1; arg < argc; ++arg) {
+    std::string flag(argv[arg]);
+    if (flag == "--once") {
+      opts.once = true;
+    } else if (arg + 1 < argc && flag == "--interval") {
+      opts.interval = std::atof(argv[++arg]);
+    } else if (arg + 1 < argc && flag == "--slow") {
+      opts.slow = std::atof(argv[++arg]);
+    } else if (arg + 1 < argc && flag == "--stale") {
+      opts.stale = std::atof(argv[++arg]);
+    } else if (!flag.empty() && flag[0] == '-') {
+      usage();
+      return 1;
+    } else {
+      Source source;
+      source.filename = flag;
+      source.shared = 0;
+      sources.push_back(source);
+    }
+  }
+  if (sources.empty()) {
+    usage();
+    return 1;
+  }
+  bool finished = false;
+  while (!finished) {
+    std::vector<MetricsRecord> records;
+    int missing = 0;
+    for (std::size_t s = 0; s < sources.size(); ++s) {
+      // Files that are not there yet are looked for again next time round
+      if (!sources[s].shared) {
+        sources[s].shared = map_record(sources[s].filename);
+      }
+      MetricsRecord record;
+      if (sources[s].shared && LiveMetrics::read(sources[s].shared, record)) {
+        records.push_back(record);
+      } else {
+        ++missing;
+      }
+    }
+    if (!opts.once) {
+      // Home the cursor and clear, as top does
+      std::cout << "\033[H\033[2J";
+    }
+    finished = show(records, missing, opts) || opts.once;
+    if (!finished) {
+      usleep(static_cast<useconds_t>(opts.interval * 1.0e6));
+    }
+  }
+  return 0;
+}
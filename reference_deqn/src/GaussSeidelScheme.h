@@ -0,0 +1,23 @@
+#ifndef GAUSS_SEIDEL_SCHEME_H_
+#define GAUSS_SEIDEL_SCHEME_H_
+
+#include "ImplicitScheme.h"
+
+/*
+ * The implicit step by red-black Gauss-Seidel: red cells (j+k even), then
+ * black cells from the new red values, in place. It converges in about
+ * half the sweeps Jacobi takes, with no scratch field.
+ * sor_omega (1.0) over-relaxes the update when above one.
+ */
+class GaussSeidelScheme : public ImplicitScheme {
+    private:
+        double omega;
+
+        double sweep(const double* b, double* x, double rx, double ry,
+                int colour);
+    protected:
+        double iterate(const double* b, double* x, double rx, double ry);
+    public:
+        GaussSeidelScheme(const InputFile* input, Mesh* m);
+};
+#endif
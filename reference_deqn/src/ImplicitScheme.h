@@ -0,0 +1,38 @@
+#ifndef IMPLICIT_SCHEME_H_
+#define IMPLICIT_SCHEME_H_
+
+#include "Scheme.h"
+#include "InputFile.h"
+
+/*
+ * Backward Euler, solved matrix-free: each step finds u1 with
+ *
+ *   (1+2rx+2ry) u1[j,k] - rx (u1[j-1,k] + u1[j+1,k])
+ *                       - ry (u1[j,k-1] + u1[j,k+1]) = u0[j,k]
+ *
+ * by a stationary iteration from u0, until an iteration changes no cell
+ * by more than solver_tolerance (1e-10) or solver_max_iterations (1000)
+ * have run. Subclasses supply the iteration.
+ */
+class ImplicitScheme : public Scheme {
+    protected:
+        Mesh* mesh;
+
+        /*
+         * One iteration of the solve for x, with right hand side b and
+         * ghost cells of x current; returns the largest change to a cell
+         * and leaves the ghost cells of x current.
+         */
+        virtual double iterate(const double* b, double* x,
+                double rx, double ry) = 0;
+    private:
+        double tolerance;
+        int max_iterations;
+    public:
+        ImplicitScheme(const InputFile* input, Mesh* m);
+
+        void doAdvance(const double dt);
+
+        void init();
+};
+#endif
@@ -0,0 +1,23 @@
+#ifndef JACOBI_SCHEME_H_
+#define JACOBI_SCHEME_H_
+
+#include "ImplicitScheme.h"
+
+/*
+ * The implicit step by Jacobi iteration. Each iteration is a pair of
+ * sweeps, into a scratch field and back, so the result always lands in u1.
+ */
+class JacobiScheme : public ImplicitScheme {
+    private:
+        double* scratch;
+
+        double sweep(const double* b, const double* x, double* x_new,
+                double rx, double ry);
+    protected:
+        double iterate(const double* b, double* x, double rx, double ry);
+    public:
+        JacobiScheme(const InputFile* input, Mesh* m);
+
+        ~JacobiScheme();
+};
+#endif
@@ -41,6 +41,18 @@ class Mesh {
         double* getU0();
         double* getU1();
 
+        /*
+         * Exchanges u0 and u1, so a scheme that has written the new
+         * field into u1 makes it current without copying it.
+         */
+        void swapFields();
+
+        /*
+         * Copies the outermost cells of field into its ghost cells,
+         * on all four sides (zero flux boundaries).
+         */
+        void reflectBoundaries(double* field);
+
         double* getDx();
         int* getNx();
         int* getMin();
@@ -7,6 +7,8 @@ class Scheme {
     private:
         Mesh* mesh;
     public:
+        virtual ~Scheme() {}
+
         virtual void doAdvance(const double dt) = 0;
 
         virtual void init() = 0;